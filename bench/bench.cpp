@@ -0,0 +1,189 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace {
+
+thread_local std::uint64_t thread_allocations = 0;
+
+} // anonymous namespace
+
+// Allocations are counted per thread, so that the counting does not add contention to the benchmarks
+void* operator new(std::size_t size) {
+    ++thread_allocations;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    ++thread_allocations;
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+namespace dmn { namespace bench {
+
+namespace {
+
+struct registered_t {
+    std::string name;
+    std::size_t threads;
+    benchmark_t benchmark;
+};
+
+std::vector<registered_t>& registry() {
+    static std::vector<registered_t> benchmarks;
+    return benchmarks;
+}
+
+struct result_t {
+    double          ns_per_op = 0;
+    double          allocs_per_op = 0;
+};
+
+// All the threads start together, so that the wall time covers the contended part only
+result_t run_once(const registered_t& b, std::size_t iterations) {
+    const context_t context{iterations, b.threads};
+    const body_t body = b.benchmark(context);
+
+    std::atomic<std::size_t> ready{0};
+    std::atomic<bool> start{false};
+    std::vector<std::uint64_t> allocations(b.threads, 0);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 1; t < b.threads; ++t) {
+        threads.emplace_back([&, t]() {
+            ready.fetch_add(1);
+            while (!start.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+
+            const std::uint64_t before = this_thread_allocations();
+            body(t);
+            allocations[t] = this_thread_allocations() - before;
+        });
+    }
+    while (ready.load() != b.threads - 1) {
+        std::this_thread::yield();
+    }
+
+    const auto started = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    const std::uint64_t before = this_thread_allocations();
+    body(0);
+    allocations[0] = this_thread_allocations() - before;
+    for (auto& t: threads) {
+        t.join();
+    }
+    const auto duration = std::chrono::steady_clock::now() - started;
+
+    const double ops = static_cast<double>(iterations * b.threads);
+    result_t res;
+    res.ns_per_op = std::chrono::duration<double, std::nano>(duration).count() / ops;
+    for (std::uint64_t a: allocations) {
+        res.allocs_per_op += static_cast<double>(a);
+    }
+    res.allocs_per_op /= ops;
+    return res;
+}
+
+void usage(const char* self) {
+    std::cerr << "Usage: " << self << " [--filter <substring>] [--min-time-ms <ms>] [--out <file.csv>]\n";
+}
+
+} // anonymous namespace
+
+void add(std::string name, std::size_t threads, benchmark_t benchmark) {
+    registry().push_back(registered_t{std::move(name), (std::max)(threads, std::size_t{1}), std::move(benchmark)});
+}
+
+std::uint64_t this_thread_allocations() noexcept {
+    return thread_allocations;
+}
+
+}} // namespace dmn::bench
+
+// Prints CSV with a line per benchmark: "benchmark,threads,iterations,ns_per_op,allocs_per_op".
+// ns_per_op is the wall time divided by the operations of all the threads.
+int main(int argc, char** argv) {
+    using namespace dmn::bench;
+
+    std::string filter;
+    std::chrono::milliseconds min_time{200};
+    std::string out_path;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 == argc) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        if (arg == "--filter") {
+            filter = argv[++i];
+        } else if (arg == "--min-time-ms") {
+            min_time = std::chrono::milliseconds{std::strtoul(argv[++i], nullptr, 10)};
+        } else if (arg == "--out") {
+            out_path = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    register_core_benchmarks();
+
+    std::ofstream file;
+    if (!out_path.empty()) {
+        file.open(out_path, std::ios::trunc);
+    }
+    std::ostream& out = (out_path.empty() ? std::cout : file);
+    out << "benchmark,threads,iterations,ns_per_op,allocs_per_op\n" << std::fixed;
+
+    const double min_ns = std::chrono::duration<double, std::nano>(min_time).count();
+    for (const auto& b: registry()) {
+        if (b.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        // Grows the iterations till a run takes at least `min_time`
+        std::size_t iterations = 1;
+        result_t res = run_once(b, iterations);
+        while (res.ns_per_op * static_cast<double>(iterations * b.threads) < min_ns) {
+            const double ns = (std::max)(res.ns_per_op * static_cast<double>(iterations * b.threads), 1.0);
+            const double scale = (std::min)((std::max)(min_ns * 1.2 / ns, 2.0), 100.0);
+            iterations = static_cast<std::size_t>(static_cast<double>(iterations) * scale);
+            res = run_once(b, iterations);
+        }
+
+        out << b.name << ',' << b.threads << ',' << iterations << ','
+            << std::setprecision(2) << res.ns_per_op << ','
+            << std::setprecision(3) << res.allocs_per_op << '\n' << std::flush;
+    }
+
+    if (!out) {
+        std::cerr << "Failed to write the results\n";
+        return 1;
+    }
+    return 0;
+}
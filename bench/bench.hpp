@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace dmn { namespace bench {
+
+struct context_t {
+    std::size_t iterations;     // Operations per thread
+    std::size_t threads;
+};
+
+// Runs `context_t::iterations` operations on the thread with the given index
+using body_t = std::function<void(std::size_t thread)>;
+
+// Prepares the data for a run and returns its body. Only the body is measured, so the setup and
+// the destruction of the data captured by the body are not accounted.
+using benchmark_t = std::function<body_t(const context_t&)>;
+
+void add(std::string name, std::size_t threads, benchmark_t benchmark);
+
+// Heap allocations made by the calling thread via the global operator new
+std::uint64_t this_thread_allocations() noexcept;
+
+// Keeps the compiler from optimizing out the computation of `value`
+template <class T>
+void do_not_optimize(const T& value) noexcept {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+void register_core_benchmarks();
+
+}} // namespace dmn::bench
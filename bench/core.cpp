@@ -0,0 +1,241 @@
+#include "bench.hpp"
+
+#include "impl/circular_iterator.hpp"
+#include "impl/net/shared_packet.hpp"
+#include "impl/net/slab_allocator.hpp"
+#include "impl/node_parts/packets_gatherer.hpp"
+#include "impl/packet.hpp"
+#include "impl/silent_mt_queue.hpp"
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dmn { namespace bench {
+
+namespace {
+
+// Field types of a packet, as used by the nodes: string types and interned tags
+const char* const field_types[] = {"seq", "payload", "user_id", "timestamp", "score", "source", "flags", "trace"};
+constexpr field_id_t field_tags[] = {"seq"_tag, "payload"_tag, "user_id"_tag, "timestamp"_tag, "score"_tag, "source"_tag, "flags"_tag, "trace"_tag};
+constexpr std::size_t fields_max = sizeof(field_types) / sizeof(field_types[0]);
+
+struct packet_shape_t {
+    std::size_t         fields;
+    std::uint32_t       field_size;
+    packet_layout_enum  layout;
+    bool                tags;   // Interned field ids instead of the string types
+};
+
+std::string name_of(const char* prefix, const packet_shape_t& s) {
+    return std::string{prefix} + "/" + (s.layout == packet_layout_enum::LINEAR ? "linear" : "indexed")
+        + (s.tags ? "_tags/" : "/") + std::to_string(s.fields) + "x" + std::to_string(s.field_size) + "B";
+}
+
+packet_t make_packet(const packet_shape_t& s, const unsigned char* data) {
+    packet_t p;
+    p.place_header();
+    p.header().version = s.layout;
+    for (std::size_t i = 0; i < s.fields; ++i) {
+        if (s.tags) {
+            p.add_data(data, s.field_size, field_tags[i]);
+        } else {
+            p.add_data(data, s.field_size, field_types[i]);
+        }
+    }
+    return p;
+}
+
+const packet_shape_t packet_shapes[] = {
+    {1, 16, packet_layout_enum::INDEXED, false},
+    {8, 16, packet_layout_enum::INDEXED, false},
+    {8, 16, packet_layout_enum::INDEXED, true},
+    {8, 16, packet_layout_enum::LINEAR, false},
+    {8, 256, packet_layout_enum::INDEXED, false},
+    {1, 64 * 1024, packet_layout_enum::INDEXED, false},
+};
+
+// Operation is building a whole packet
+void add_packet_add_data() {
+    for (const auto& shape: packet_shapes) {
+        add(name_of("packet_t/add_data", shape), 1, [shape](const context_t& c) {
+            auto data = std::make_shared<std::vector<unsigned char>>(shape.field_size, 0x5a);
+            return [shape, data, c](std::size_t /*thread*/) {
+                for (std::size_t i = 0; i < c.iterations; ++i) {
+                    packet_t p = make_packet(shape, data->data());
+                    do_not_optimize(p);
+                }
+            };
+        });
+    }
+}
+
+// Operation is a lookup of one of the fields, the last field is the slowest one for LINEAR packets
+void add_packet_get_data() {
+    for (const auto& shape: packet_shapes) {
+        add(name_of("packet_t/get_data", shape), 1, [shape](const context_t& c) {
+            const std::vector<unsigned char> data(shape.field_size, 0x5a);
+            auto p = std::make_shared<packet_t>(make_packet(shape, data.data()));
+            return [shape, p, c](std::size_t /*thread*/) {
+                for (std::size_t i = 0; i < c.iterations; ++i) {
+                    const std::size_t field = i % shape.fields;
+                    const auto res = shape.tags ? p->get_data(field_tags[field]) : p->get_data(field_types[field]);
+                    do_not_optimize(res);
+                }
+            };
+        });
+    }
+}
+
+packet_network_t make_part(wave_id_t wave, std::uint16_t edge) {
+    packet_t native;
+    const unsigned char d[64] = {};
+    native.add_data(d, sizeof(d), "part");
+    native.header().wave_id = wave;
+    native.header().edge_id = edge;
+    return packet_network_t{std::move(native)};
+}
+
+// Operation is combining a single part. Each thread delivers parts of its own edges, parts of
+// different waves are interleaved as if each edge was delivering its own stream.
+void add_packets_gatherer() {
+    for (std::size_t edges: {std::size_t{2}, std::size_t{16}, std::size_t{128}}) {
+        for (std::size_t threads: {std::size_t{1}, std::size_t{2}, std::size_t{4}}) {
+            if (edges < threads) {
+                continue;
+            }
+
+            const std::string name = "packets_gatherer_t/combine_packets/" + std::to_string(edges) + "_edges";
+            add(name, threads, [edges](const context_t& c) {
+                const std::size_t waves = c.iterations * c.threads / edges + 1;
+                auto parts = std::make_shared<std::vector<std::vector<packet_network_t>>>(c.threads);
+                for (std::size_t e = 0; e < edges; ++e) {
+                    auto& thread_parts = (*parts)[e % c.threads];
+                    for (std::size_t w = 0; w < waves && thread_parts.size() < c.iterations; ++w) {
+                        thread_parts.push_back(make_part(make_wave_id(1, 0, static_cast<std::uint32_t>(w)), static_cast<std::uint16_t>(e)));
+                    }
+                }
+
+                auto gatherer = std::make_shared<packets_gatherer_t>(edges, (std::numeric_limits<std::size_t>::max)(), [](packet_network_t) {});
+                return [parts, gatherer](std::size_t thread) {
+                    for (auto& p: (*parts)[thread]) {
+                        auto res = gatherer->combine_packets(std::move(p));
+                        do_not_optimize(res);
+                    }
+                };
+            });
+        }
+    }
+}
+
+// Operation is a push and a pop of a packet of an out-edge
+void add_silent_mt_queue() {
+    for (std::size_t threads: {std::size_t{1}, std::size_t{2}, std::size_t{4}}) {
+        add("silent_mt_queue/push_pop/shared_packet_t", threads, [](const context_t& c) {
+            auto queue = std::make_shared<silent_mt_queue<shared_packet_t>>();
+            return [queue, c](std::size_t /*thread*/) {
+                for (std::size_t i = 0; i < c.iterations; ++i) {
+                    queue->silent_push(shared_packet_t{});
+                    auto p = queue->try_pop();
+                    do_not_optimize(p);
+                }
+            };
+        });
+    }
+
+    // Ring overflows, pushes go into the mutex protected storage till it is drained
+    add("silent_mt_queue/push_pop_burst_4096/shared_packet_t", 1, [](const context_t& c) {
+        auto queue = std::make_shared<silent_mt_queue<shared_packet_t>>();
+        return [queue, c](std::size_t /*thread*/) {
+            constexpr std::size_t burst = 4096;
+            for (std::size_t i = 0; i < c.iterations; i += burst) {
+                const std::size_t n = (std::min)(burst, c.iterations - i);
+                for (std::size_t j = 0; j < n; ++j) {
+                    queue->silent_push(shared_packet_t{});
+                }
+                for (std::size_t j = 0; j < n; ++j) {
+                    auto p = queue->try_pop();
+                    do_not_optimize(p);
+                }
+            }
+        };
+    });
+}
+
+// Operation is an allocation and a deallocation, as done for each asio handler of a link
+template <class Allocator>
+void add_slab_allocator(const char* name, std::size_t size) {
+    add(std::string{"slab_allocator_basic_t/"} + name + "/" + std::to_string(size) + "B", 1, [size](const context_t& c) {
+        auto allocator = std::make_shared<Allocator>();
+        return [allocator, size, c](std::size_t /*thread*/) {
+            for (std::size_t i = 0; i < c.iterations; ++i) {
+                void* p = allocator->allocate(size);
+                do_not_optimize(p);
+                allocator->deallocate(p);
+            }
+        };
+    });
+}
+
+// Operation is sharing a body between `receivers` out-edges, as done by node_impl_write_n
+void add_shared_body() {
+    for (std::size_t receivers: {std::size_t{1}, std::size_t{4}, std::size_t{16}}) {
+        for (std::uint32_t body: {std::uint32_t{64}, std::uint32_t{4096}}) {
+            const std::string name = "shared_body_t/share/" + std::to_string(receivers) + "_receivers/" + std::to_string(body) + "B";
+            add(name, 1, [receivers, body](const context_t& c) {
+                auto data = std::make_shared<std::vector<unsigned char>>(body, 0x5a);
+                return [receivers, data, c](std::size_t /*thread*/) {
+                    std::vector<shared_packet_t> sent;
+                    sent.reserve(receivers);
+                    for (std::size_t i = 0; i < c.iterations; ++i) {
+                        packet_t native;
+                        native.add_data(data->data(), static_cast<std::uint32_t>(data->size()), "payload");
+                        const packet_header_t header = native.header();
+                        const shared_body_ptr_t shared = make_shared_body(packet_network_t{std::move(native)});
+                        for (std::size_t r = 0; r < receivers; ++r) {
+                            sent.push_back(shared_packet_t{header, shared});
+                        }
+                        do_not_optimize(sent);
+                        sent.clear();
+                    }
+                };
+            });
+        }
+    }
+}
+
+// Operation is a single step of the iterator, as done when links are probed starting from a random one
+void add_circular_iterator() {
+    for (std::size_t size: {std::size_t{4}, std::size_t{64}}) {
+        add("circular_iterator/step/" + std::to_string(size) + "_elements", 1, [size](const context_t& c) {
+            auto values = std::make_shared<std::vector<std::size_t>>(size, 1);
+            return [values, size, c](std::size_t /*thread*/) {
+                std::size_t sum = 0;
+                for (std::size_t i = 0; i < c.iterations; i += size) {
+                    using it_t = circular_iterator<std::vector<std::size_t>>;
+                    for (it_t it{*values, i, (std::min)(size, c.iterations - i)}; it != it_t{}; ++it) {
+                        sum += *it;
+                    }
+                }
+                do_not_optimize(sum);
+            };
+        });
+    }
+}
+
+} // anonymous namespace
+
+void register_core_benchmarks() {
+    add_packet_add_data();
+    add_packet_get_data();
+    add_packets_gatherer();
+    add_silent_mt_queue();
+    add_slab_allocator<slab_allocator_t>("slab_allocator_t", 64);
+    add_slab_allocator<slab_allocator_t>("slab_allocator_t", 256);
+    add_slab_allocator<write_slab_allocator_t>("write_slab_allocator_t", 64 * 12);
+    add_shared_body();
+    add_circular_iterator();
+}
+
+}} // namespace dmn::bench
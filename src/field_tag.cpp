@@ -0,0 +1,57 @@
+#include "field_tag.hpp"
+#include "utility.hpp"
+
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <boost/assert.hpp>
+
+namespace dmn {
+
+#if DMN_DEBUG
+namespace {
+
+struct field_names_registry_t {
+    std::mutex                                          names_mutex_;
+    std::unordered_map<std::uint32_t, std::string>      names_;
+};
+
+field_names_registry_t& registry() {
+    static field_names_registry_t r;
+    return r;
+}
+
+} // anonymous namespace
+#endif
+
+field_id_t register_field_name(const char* type) {
+    BOOST_ASSERT_MSG(type, "Registering field without a name");
+    const std::size_t type_len = std::strlen(type);
+    const field_id_t id = static_cast<field_id_t>(field_hash(type, type_len));
+
+#if DMN_DEBUG
+    auto& r = registry();
+    std::lock_guard<std::mutex> l(r.names_mutex_);
+    const auto it = r.names_.emplace(static_cast<std::uint32_t>(id), std::string(type, type_len)).first;
+    BOOST_ASSERT_MSG(it->second == type, "Different field names have the same field_id_t. Rename one of the fields");
+#endif
+
+    return id;
+}
+
+const char* field_name(field_id_t id) noexcept {
+#if DMN_DEBUG
+    auto& r = registry();
+    std::lock_guard<std::mutex> l(r.names_mutex_);
+    const auto it = r.names_.find(static_cast<std::uint32_t>(id));
+    if (it != r.names_.cend()) {
+        return it->second.c_str();
+    }
+#else
+    (void)id;
+#endif
+    return nullptr;
+}
+
+} // namespace dmn
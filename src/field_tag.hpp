@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dmn {
+
+// Compile time interned type of the data in packet. Packet stores only the 32 bit id
+// instead of the whole type name:
+//
+//      s.add<"seq"_tag>(data, size);
+//      const auto seq = s.get_data<"seq"_tag>();
+enum class field_id_t: std::uint32_t {};
+
+// FNV-1a
+constexpr std::uint32_t field_hash(const char* type, std::size_t type_len) noexcept {
+    std::uint32_t h = 2166136261u;
+    for (std::size_t i = 0; i < type_len; ++i) {
+        h ^= static_cast<unsigned char>(type[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+inline namespace literals {
+
+constexpr field_id_t operator""_tag(const char* type, std::size_t type_len) noexcept {
+    return static_cast<field_id_t>(field_hash(type, type_len));
+}
+
+} // namespace literals
+
+// Debug-only registry of field names, for tooling and for detecting collisions of ids.
+// Names of the fields defined with DMN_FIELD are registered automatically. In release
+// builds registration does nothing and field_name() always returns nullptr.
+field_id_t register_field_name(const char* type);
+const char* field_name(field_id_t id) noexcept;
+
+} // namespace dmn
+
+// Defines a field id at namespace scope and registers its name on start up:
+//
+//      DMN_FIELD(seq_field, "seq");
+//      s.add<seq_field>(data, size);
+#define DMN_FIELD(var, name)                                                                   \
+    constexpr ::dmn::field_id_t var = ::dmn::literals::operator""_tag(name, sizeof(name) - 1); \
+    static const ::dmn::field_id_t var ## _registered = ::dmn::register_field_name(name)       \
+    /**/
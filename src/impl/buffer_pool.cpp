@@ -0,0 +1,259 @@
+#include "impl/buffer_pool.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include <boost/assert.hpp>
+
+namespace dmn {
+
+namespace {
+
+constexpr std::size_t min_block_size_log2 = 6;      // 64 bytes
+constexpr std::size_t size_classes_count = 15;      // up to 1MB
+constexpr std::uint32_t not_pooled = 0xFFFFFFFFu;
+
+std::atomic<std::size_t> g_max_cached_blocks{64};
+
+class buffer_pool_t;
+
+struct alignas(std::max_align_t) block_header_t {
+    buffer_pool_t*  owner;
+    block_header_t* next;       // used only while the block is free
+    std::uint32_t   size_class;
+};
+
+std::uint32_t size_class_for(std::size_t size) noexcept {
+    std::uint32_t cls = 0;
+    while (cls < size_classes_count && (std::size_t{1} << (cls + min_block_size_log2)) < size) {
+        ++cls;
+    }
+
+    return cls == size_classes_count ? not_pooled : cls;
+}
+
+std::size_t block_size(std::uint32_t cls) noexcept {
+    return std::size_t{1} << (cls + min_block_size_log2);
+}
+
+block_header_t* heap_allocate(buffer_pool_t* owner, std::uint32_t cls, std::size_t size) {
+    void* p = ::operator new(sizeof(block_header_t) + (cls == not_pooled ? size : block_size(cls)));
+    return new (p) block_header_t{owner, nullptr, cls};
+}
+
+void heap_deallocate(block_header_t* b) noexcept {
+    ::operator delete(b);
+}
+
+// Blocks allocated by the pool hold a reference to it, so the pool outlives its thread
+// while any of its buffers are in use.
+class buffer_pool_t {
+    std::atomic<std::size_t>        refs_{1};   // owning thread + blocks on heap
+    std::atomic<bool>               orphaned_{false};
+    std::atomic<block_header_t*>    remote_frees_{nullptr};
+
+    // Owner thread only
+    block_header_t*                 free_[size_classes_count] = {};
+    std::size_t                     free_count_[size_classes_count] = {};
+
+    void add_ref() noexcept {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() noexcept;
+
+    void free_block(block_header_t* b) noexcept {
+        heap_deallocate(b);
+        release();
+    }
+
+    void cache_block(block_header_t* b) noexcept {
+        const auto cls = b->size_class;
+        if (free_count_[cls] >= g_max_cached_blocks.load(std::memory_order_relaxed)) {
+            free_block(b);
+            return;
+        }
+
+        b->next = free_[cls];
+        free_[cls] = b;
+        ++free_count_[cls];
+    }
+
+    // Any thread may drain remote frees after the owner has exited, so it takes all of them at once
+    template <class F>
+    void drain_remote(F f) noexcept {
+        block_header_t* b = remote_frees_.exchange(nullptr, std::memory_order_acquire);
+        while (b) {
+            block_header_t* next = b->next;
+            f(b);
+            b = next;
+        }
+    }
+
+public:
+    std::atomic<std::uint64_t>      hits_{0};
+    std::atomic<std::uint64_t>      misses_{0};
+    std::atomic<std::uint64_t>      remote_frees_count_{0};
+
+    block_header_t* allocate(std::uint32_t cls) {
+        if (!free_[cls]) {
+            drain_remote([this](block_header_t* b) { cache_block(b); });
+        }
+
+        block_header_t* b = free_[cls];
+        if (b) {
+            free_[cls] = b->next;
+            --free_count_[cls];
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return b;
+        }
+
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        b = heap_allocate(this, cls, block_size(cls));
+        add_ref();
+        return b;
+    }
+
+    void deallocate_local(block_header_t* b) noexcept {
+        cache_block(b);
+    }
+
+    void deallocate_remote(block_header_t* b) noexcept {
+        remote_frees_count_.fetch_add(1, std::memory_order_relaxed);
+        add_ref(); // Keeping the pool alive, because the owner may free `b` right after the push
+
+        b->next = remote_frees_.load(std::memory_order_relaxed);
+        while (!remote_frees_.compare_exchange_weak(b->next, b, std::memory_order_seq_cst, std::memory_order_relaxed)) {}
+
+        if (orphaned_.load(std::memory_order_seq_cst)) {
+            drain_remote([this](block_header_t* v) { free_block(v); });
+        }
+        release();
+    }
+
+    void on_thread_exit() noexcept {
+        orphaned_.store(true, std::memory_order_seq_cst);
+        for (std::size_t cls = 0; cls < size_classes_count; ++cls) {
+            while (free_[cls]) {
+                block_header_t* next = free_[cls]->next;
+                free_block(free_[cls]);
+                free_[cls] = next;
+            }
+            free_count_[cls] = 0;
+        }
+
+        drain_remote([this](block_header_t* b) { free_block(b); });
+        release();
+    }
+};
+
+struct pools_registry_t {
+    std::mutex                      pools_mutex_;
+    std::vector<buffer_pool_t*>     pools_;
+    buffer_pool_stats_t             retired_;
+};
+
+pools_registry_t& registry() {
+    static pools_registry_t* r = new pools_registry_t; // Never destroyed: pools may be released after the static objects destruction
+    return *r;
+}
+
+void buffer_pool_t::release() noexcept {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    {
+        auto& r = registry();
+        std::lock_guard<std::mutex> l(r.pools_mutex_);
+        r.retired_.hits += hits_.load(std::memory_order_relaxed);
+        r.retired_.misses += misses_.load(std::memory_order_relaxed);
+        r.retired_.remote_frees += remote_frees_count_.load(std::memory_order_relaxed);
+        r.pools_.erase(std::find(r.pools_.begin(), r.pools_.end(), this));
+    }
+    delete this;
+}
+
+struct thread_pool_holder_t {
+    buffer_pool_t* pool;
+
+    thread_pool_holder_t()
+        : pool(new buffer_pool_t)
+    {
+        auto& r = registry();
+        std::lock_guard<std::mutex> l(r.pools_mutex_);
+        r.pools_.push_back(pool);
+    }
+
+    ~thread_pool_holder_t();
+};
+
+thread_local bool t_pool_destroyed = false;  // Trivially destructible, remains valid after holder destruction
+
+thread_pool_holder_t::~thread_pool_holder_t() {
+    t_pool_destroyed = true;
+    pool->on_thread_exit();
+}
+
+buffer_pool_t* local_pool() {
+    if (t_pool_destroyed) {
+        return nullptr;
+    }
+
+    thread_local thread_pool_holder_t holder;
+    return holder.pool;
+}
+
+} // anonymous namespace
+
+void* buffer_pool_allocate(std::size_t size) {
+    const std::uint32_t cls = size_class_for(size);
+    buffer_pool_t* const pool = local_pool();
+
+    block_header_t* b = (cls == not_pooled || !pool)
+        ? heap_allocate(nullptr, not_pooled, size)
+        : pool->allocate(cls);
+
+    return b + 1;
+}
+
+void buffer_pool_deallocate(void* p) noexcept {
+    if (!p) {
+        return;
+    }
+
+    block_header_t* const b = static_cast<block_header_t*>(p) - 1;
+    if (!b->owner) {
+        heap_deallocate(b);
+        return;
+    }
+
+    if (b->owner == local_pool()) {
+        b->owner->deallocate_local(b);
+    } else {
+        b->owner->deallocate_remote(b);
+    }
+}
+
+buffer_pool_stats_t buffer_pool_stats() noexcept {
+    auto& r = registry();
+    std::lock_guard<std::mutex> l(r.pools_mutex_);
+
+    buffer_pool_stats_t res = r.retired_;
+    for (const buffer_pool_t* p : r.pools_) {
+        res.hits += p->hits_.load(std::memory_order_relaxed);
+        res.misses += p->misses_.load(std::memory_order_relaxed);
+        res.remote_frees += p->remote_frees_count_.load(std::memory_order_relaxed);
+    }
+
+    return res;
+}
+
+void buffer_pool_set_max_cached(std::size_t blocks_per_size_class) noexcept {
+    g_max_cached_blocks.store(blocks_per_size_class, std::memory_order_relaxed);
+}
+
+} // namespace dmn
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dmn {
+
+// Per-thread size-classed pool of buffers. Buffer freed on a thread other than the one that
+// allocated it is returned to the pool of the allocating thread.
+void* buffer_pool_allocate(std::size_t size);
+void buffer_pool_deallocate(void* p) noexcept;
+
+struct buffer_pool_stats_t {
+    std::uint64_t hits = 0;           // allocations served from the pool
+    std::uint64_t misses = 0;         // allocations that went to the heap
+    std::uint64_t remote_frees = 0;   // buffers returned to the pool by non owning threads
+};
+
+// Sum of the counters from all the threads
+buffer_pool_stats_t buffer_pool_stats() noexcept;
+
+// Maximal count of free buffers cached by a thread for each size class
+void buffer_pool_set_max_cached(std::size_t blocks_per_size_class) noexcept;
+
+template <class T>
+struct pool_allocator {
+    using value_type = T;
+
+    pool_allocator() noexcept = default;
+
+    template <class U>
+    pool_allocator(const pool_allocator<U>& /*other*/) noexcept {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(buffer_pool_allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t /*n*/) noexcept {
+        buffer_pool_deallocate(p);
+    }
+
+    template <class U>
+    bool operator==(const pool_allocator<U>& /*other*/) const noexcept {
+        return true;
+    }
+
+    template <class U>
+    bool operator!=(const pool_allocator<U>& /*other*/) const noexcept {
+        return false;
+    }
+};
+
+} // namespace dmn
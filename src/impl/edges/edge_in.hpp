@@ -2,8 +2,10 @@
 
 #include "impl/net/netlink.hpp"
 #include "impl/net/packet_network.hpp"
+#include "impl/net/packets_reader.hpp"
 #include "impl/net/tcp_read_proto.hpp"
 #include "impl/compare_addrs.hpp"
+#include "impl/metrics.hpp"
 
 #include <deque>
 #include <memory>
@@ -21,7 +23,29 @@ private:
         std::unique_ptr<link_t>
     >   netlinks_;
 
+    metrics_counter_t   received_packets_;
+    metrics_counter_t   received_bytes_;
+
+    // Last member, metrics are unregistered before the sources are destroyed
+    metrics_registry_t::registrations_t metrics_registrations_;
+
 public:
+    // Accounts packets received over the links or directly from the writers of the same process
+    void on_received(std::size_t packets, std::size_t bytes) noexcept {
+        received_packets_.add(packets);
+        received_bytes_.add(bytes);
+    }
+
+    void register_metrics(metrics_registry_t& registry, const metric_labels_t& labels) {
+        auto& r = metrics_registrations_;
+        r.push_back(registry.add_counter("dmn_in_edge_received_packets_total", "Packets received from the writers", labels, received_packets_));
+        r.push_back(registry.add_counter("dmn_in_edge_received_bytes_total", "Bytes received from the writers", labels, received_bytes_));
+        r.push_back(registry.add_gauge("dmn_in_edge_links", "Connected links of the edge", labels, [this]() {
+            std::unique_lock<std::mutex> guard(netlinks_mutex_);
+            return static_cast<double>(netlinks_.size());
+        }));
+    }
+
     void close_links() noexcept {
         std::unique_lock<std::mutex> guard(netlinks_mutex_);
         for (auto& v: netlinks_) {   // TODO: balancing
@@ -29,6 +53,14 @@ public:
         }
     }
 
+    template <class F>
+    void for_each_link(F f) {
+        std::unique_lock<std::mutex> guard(netlinks_mutex_);
+        for (auto& v: netlinks_) {
+            f(*v);
+        }
+    }
+
     link_t& add_link(std::unique_ptr<link_t> link_ptr) {
         std::unique_lock<std::mutex> guard(netlinks_mutex_);
         auto it = std::lower_bound(netlinks_.begin(), netlinks_.end(), link_ptr);
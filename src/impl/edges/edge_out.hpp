@@ -1,53 +1,161 @@
 #pragma once
 
-#include "impl/circular_iterator.hpp"
+#include "impl/edges/idle_links.hpp"
+#include "impl/edges/wave_hash_ring.hpp"
 #include "impl/lazy_array.hpp"
+#include "impl/metrics.hpp"
 #include "impl/silent_mt_queue.hpp"
+#include "impl/net/credits.hpp"
 #include "impl/net/netlink.hpp"
 #include "impl/net/packet_network.hpp"
+#include "impl/net/packets_batch.hpp"
+#include "impl/net/shared_packet.hpp"
 #include "impl/net/tcp_write_proto.hpp"
 #include "impl/packet.hpp"
+#include "impl/tracing.hpp"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <boost/optional.hpp>
 
 namespace dmn {
 
+struct write_batch_stats_t {
+    std::uint64_t batches = 0;
+    std::uint64_t packets = 0;
+    std::uint64_t bytes = 0;
+};
+
+// Load of a single link, as seen by the balancer
+struct link_score_t {
+    std::uint64_t in_flight_bytes = 0;  // Bytes of the write in progress
+    std::uint64_t latency_ns = 0;       // Moving average of the write completion latency
+    std::uint64_t score = 0;            // Lower is better
+};
+
 template <class Packet>
-struct edge_out_t {
-    using link_t = netlink_t<Packet, tcp_write_proto_t>;
+struct alignas(hardware_destructive_interference_size) edge_out_t {
+    using batch_t = packets_batch_t<Packet>;
+    using link_t = netlink_t<batch_t, tcp_write_proto_t>;
     using netlinks_t = lazy_array<link_t>;
 
 private:
     const std::uint16_t     edge_id_for_receiver_;
+    write_batch_limits_t    limits_{};  // `const` after set_batch_limits()
+
+    metrics_counter_t   batches_sent_;
+    metrics_counter_t   packets_sent_;
+    metrics_counter_t   bytes_sent_;
+    metrics_counter_t   packets_sent_directly_;
+
+    // Packets waiting for a free link or for credits. Edge is overloaded when there are too many of them
+    // and stays overloaded till the queue is half empty.
+    std::atomic<std::size_t>    queued_{0};
+    std::atomic<bool>           overloaded_{false};
+    std::function<void()>       on_unloaded_;   // `const` after set_on_unloaded()
+
+    struct link_load_t {
+        std::atomic<std::uint64_t>  in_flight_bytes{0};
+        std::atomic<std::uint64_t>  latency_ns{0};
+
+        // Guarded by the link lock
+        std::chrono::steady_clock::time_point   write_started{};
+        std::uint64_t                           write_bytes = 0;
+#if DMN_TRACING
+        std::uint64_t                           write_started_ns = 0;   // For the trace, comparable between hosts
+#endif
+    };
+    std::unique_ptr<link_load_t[]>  links_load_;
+
+    // Latency is scaled by the count of these units in flight
+    static constexpr std::uint64_t score_bytes_unit = 4096;
+
+    void on_write_started(link_t& link, std::uint64_t bytes) noexcept {
+        auto& load = links_load_[netlinks_.index_of(link)];
+        load.write_started = std::chrono::steady_clock::now();
+        load.write_bytes = bytes;
+#if DMN_TRACING
+        if (tracer_) {
+            load.write_started_ns = timestamp_now();
+        }
+#endif
+        load.in_flight_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+#if DMN_TRACING
+    const wave_tracer_t*    tracer_ = nullptr;  // `const` after set_tracer()
+#endif
 
 protected:
     netlinks_t              netlinks_{}; // `const` after set_links()
 
-    template <class Link>
-    static boost::asio::const_buffers_1 get_buf(netlink_t<packet_network_t, Link>& link, packet_network_t v) noexcept {
-        BOOST_ASSERT(!empty_packet(v));
+private:
+    // Last member, metrics are unregistered before the sources are destroyed
+    metrics_registry_t::registrations_t metrics_registrations_;
+
+protected:
+
+    // Must be called with the link lock held, after the link finished or failed the write.
+    // Failed writes double the latency of the link, so the balancer avoids it for a while.
+    void on_write_finished(link_t& link, bool failed = false) noexcept {
+        auto& load = links_load_[netlinks_.index_of(link)];
+        if (!load.write_bytes) {
+            return; // Link was connected, nothing was written
+        }
+
+#if DMN_TRACING
+        if (tracer_) {
+            const std::uint64_t end_ns = timestamp_now();
+            link.packet.for_each([this, &load, end_ns, failed](const Packet& p) {
+                tracer_->complete(failed ? "tcp_write_failed" : "tcp_write", wave_of(p), load.write_started_ns, end_ns);
+            });
+        }
+#endif
+
+        const std::int64_t sample = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - load.write_started
+        ).count();
+        const std::int64_t prev = static_cast<std::int64_t>(load.latency_ns.load(std::memory_order_relaxed));
+        std::int64_t latency = prev ? prev + (sample - prev) / 8 : sample;
+        if (failed) {
+            latency = (std::max)(latency, prev) * 2;
+        }
 
-        auto p = std::move(v); // workaround for self move
-        link.packet = std::move(p);
+        load.latency_ns.store(static_cast<std::uint64_t>((std::max<std::int64_t>)(latency, 1)), std::memory_order_relaxed);
+        load.in_flight_bytes.fetch_sub(load.write_bytes, std::memory_order_relaxed);
+        load.write_bytes = 0;
+    }
 
-        return link.packet.const_buffer();
+    // Sequentially consistent, so that a writer that queued packets and a link that became idle do not miss each other
+    void on_queued(std::size_t packets) noexcept {
+        if (queued_.fetch_add(packets) + packets >= max_queued_packets) {
+            overloaded_.store(true, std::memory_order_release);
+        }
     }
 
-    template <class Link>
-    static boost::asio::const_buffers_1 get_buf(netlink_t<boost::asio::const_buffer, Link>& link, boost::asio::const_buffer v) noexcept {
-        BOOST_ASSERT(!empty_packet(v));
+    std::size_t queued() const noexcept {
+        return queued_.load();
+    }
 
-        link.packet = std::move(v);
-        return boost::asio::const_buffers_1{link.packet};
+    void on_dequeued(std::size_t packets) {
+        const std::size_t left = queued_.fetch_sub(packets, std::memory_order_acq_rel) - packets;
+        if (left <= max_queued_packets / 2
+            && overloaded_.load(std::memory_order_acquire)
+            && overloaded_.exchange(false, std::memory_order_acq_rel)
+            && on_unloaded_)
+        {
+            on_unloaded_();
+        }
     }
 
-    template <class Link>
-    static std::array<boost::asio::const_buffer, 2> get_buf(netlink_t<std::pair<packet_header_t, boost::asio::const_buffer>, Link>& link, const std::pair<packet_header_t, boost::asio::const_buffer>& v) noexcept {
-        BOOST_ASSERT(!empty_packet(v));
+    static wave_id_t wave_of(const packet_network_t& p) noexcept {
+        return p.wave_id_from_packet();
+    }
 
-        link.packet = std::move(v);
-        return {
-            boost::asio::const_buffer{static_cast<const void*>(&link.packet.first), sizeof(packet_header_t)},
-            link.packet.second
-        };
+    static wave_id_t wave_of(const shared_packet_t& p) noexcept {
+        return p.header.wave_id;
     }
 
     static bool empty_packet(boost::asio::const_buffer buf) noexcept {
@@ -58,11 +166,49 @@ protected:
         return p.empty();
     }
 
-    static bool empty_packet(const std::pair<packet_header_t, boost::asio::const_buffer>& /*p*/) noexcept {
+    static bool empty_packet(const shared_packet_t& /*p*/) noexcept {
         return false;
     }
 
+    // Moves up to limits_ packets from the queue into the link and sends them all with a single write.
+    // Returns false if there was nothing to send.
+    template <class Queue>
+    bool send_batch(link_t& link, Queue& queue, tcp_write_proto_t::guard_t& guard) {
+        auto& batch = link.packet;
+        BOOST_ASSERT_MSG(batch.empty(), "Sending new batch while the previous one is not finished");
+
+        const std::size_t max_packets = (std::min)(limits_.max_packets, link.available_credits());
+        while (batch.size() < max_packets && batch.bytes() < limits_.max_bytes) {
+            auto p = queue.try_pop();
+            if (!p) {
+                break;
+            }
+
+            BOOST_ASSERT(!empty_packet(*p));
+            batch.push_back(std::move(*p));
+        }
+
+        if (batch.empty()) {
+            return false;
+        }
+
+        link.consume_credits(batch.size());
+        on_dequeued(batch.size());
+        on_write_started(link, batch.bytes());
+
+        batches_sent_.add(1);
+        packets_sent_.add(batch.size());
+        bytes_sent_.add(batch.bytes());
+
+        link.async_send(std::move(guard), batch.buffers());
+        return true;
+    }
+
+    virtual void on_credits(link_t& link) = 0;
+
 public:
+    static constexpr std::size_t max_queued_packets = 4 * credits_window;
+
     explicit edge_out_t(std::uint16_t edge_id_for_receiver)
         : edge_id_for_receiver_(edge_id_for_receiver)
     {}
@@ -71,18 +217,101 @@ public:
         return edge_id_for_receiver_;
     }
 
+    void set_batch_limits(write_batch_limits_t limits) noexcept {
+        BOOST_ASSERT_MSG(limits.max_packets > 0, "Batch must hold at least one packet");
+        limits_ = limits;
+    }
+
+    write_batch_stats_t batch_stats() const noexcept {
+        write_batch_stats_t res;
+        res.batches = batches_sent_.value();
+        res.packets = packets_sent_.value();
+        res.bytes = bytes_sent_.value();
+        return res;
+    }
+
+#if DMN_TRACING
+    // Writes of the sampled waves are traced. Must be called before the links are connected.
+    void set_tracer(const wave_tracer_t* tracer) noexcept {
+        tracer_ = tracer;
+    }
+#endif
+
+    // Packet bypassed the links, see direct_edge_t
+    void on_sent_directly() noexcept {
+        packets_sent_directly_.add(1);
+    }
+
+    // Registers metrics of the edge and of its links. Must be called after the links are constructed.
+    void register_metrics(metrics_registry_t& registry, const metric_labels_t& labels) {
+        auto& r = metrics_registrations_;
+        r.push_back(registry.add_gauge("dmn_out_edge_queued_packets", "Packets waiting for a free link or for credits", labels, [this]() {
+            return static_cast<double>(queued());
+        }));
+        r.push_back(registry.add_counter("dmn_out_edge_sent_batches_total", "Batches written to the links", labels, batches_sent_));
+        r.push_back(registry.add_counter("dmn_out_edge_sent_packets_total", "Packets written to the links", labels, packets_sent_));
+        r.push_back(registry.add_counter("dmn_out_edge_sent_bytes_total", "Bytes written to the links", labels, bytes_sent_));
+        r.push_back(registry.add_counter("dmn_out_edge_direct_packets_total", "Packets handed over to the receivers of the same process", labels, packets_sent_directly_));
+
+        for (std::size_t i = 0; i < links_count(); ++i) {
+            const metric_labels_t link_labels = with_label(labels, "link", std::to_string(i));
+            r.push_back(registry.add_gauge("dmn_out_link_in_flight_bytes", "Bytes of the write in progress", link_labels, [this, i]() {
+                return static_cast<double>(link_score(i).in_flight_bytes);
+            }));
+            r.push_back(registry.add_gauge("dmn_out_link_latency_seconds", "Moving average of the write completion latency", link_labels, [this, i]() {
+                return static_cast<double>(link_score(i).latency_ns) / 1e9;
+            }));
+            r.push_back(registry.add(
+                "dmn_out_link_connects_total", "Successful connects, including the first one",
+                metrics_registry_t::type_enum::COUNTER, link_labels,
+                [this, i]() { return static_cast<double>(netlinks_[i].connects()); }
+            ));
+            r.push_back(registry.add(
+                "dmn_out_link_connect_failures_total", "Failed connect attempts",
+                metrics_registry_t::type_enum::COUNTER, link_labels,
+                [this, i]() { return static_cast<double>(netlinks_[i].connect_failures()); }
+            ));
+        }
+    }
+
+    std::size_t links_count() const noexcept {
+        return netlinks_.size();
+    }
+
+    // Thread safe
+    link_score_t link_score(std::size_t i) const noexcept {
+        const auto& load = links_load_[i];
+        link_score_t res;
+        res.in_flight_bytes = load.in_flight_bytes.load(std::memory_order_relaxed);
+        res.latency_ns = load.latency_ns.load(std::memory_order_relaxed);
+        res.score = (res.latency_ns + 1) * (1 + res.in_flight_bytes / score_bytes_unit);
+        return res;
+    }
+
     static link_t& link_from_guard(const tcp_write_proto_t::guard_t& guard) noexcept {
         BOOST_ASSERT_MSG(guard, "Empty link guard");
         return static_cast<link_t&>(*guard.mutex());
     }
 
-    void preinit_links(std::size_t count) {
+    virtual void preinit_links(std::size_t count) {
         netlinks_.init(count);
+        links_load_.reset(new link_load_t[count]);
     }
 
     template <class... Args>
     void inplace_construct_link(std::size_t i, Args&&... args) {
         netlinks_.inplace_construct(i, std::forward<Args>(args)...);
+        netlinks_[i].set_on_credits([this](tcp_write_proto_t& link) { on_credits(static_cast<link_t&>(link)); });
+        netlinks_[i].set_on_connect_failed([this](const tcp_write_proto_t::guard_t& guard) { on_link_error(guard); });
+    }
+
+    // Called when the overloaded edge gets back to normal
+    void set_on_unloaded(std::function<void()> on_unloaded) {
+        on_unloaded_ = std::move(on_unloaded);
+    }
+
+    bool overloaded() const noexcept {
+        return overloaded_.load(std::memory_order_acquire);
     }
 
     void connect_links() noexcept {
@@ -97,6 +326,15 @@ public:
         }
     }
 
+    // Link the wave must be sent to, if the edge routes waves to exact hosts
+    virtual boost::optional<std::size_t> preferred_link(wave_id_t /*wave*/) const {
+        return boost::none;
+    }
+
+    // Link failed to connect and is going to retry. Send errors are not reported here: the link
+    // reconnects and a transient error does not move the waves to other hosts.
+    virtual void on_link_error(const tcp_write_proto_t::guard_t& /*guard*/) {}
+
     virtual void try_steal_work(tcp_write_proto_t::guard_t guard) = 0;
     virtual void reschedule_packet_from_link(const tcp_write_proto_t::guard_t& guard) = 0;
     virtual void push(wave_id_t wave, Packet p) = 0;
@@ -105,8 +343,11 @@ public:
 
 
 
+// Sends each batch to one of the idle links. Picks the less loaded of two idle links ("power of two
+// choices"), so that a degraded host gets less data. Busy links take the next batch themselves when
+// their write finishes.
 template <class Packet>
-struct edge_out_round_robin_t final: public edge_out_t<Packet> {
+struct edge_out_balanced_t final: public edge_out_t<Packet> {
     using base_t = edge_out_t<Packet>;
 
     using queue_t = silent_mt_queue<Packet>;
@@ -114,162 +355,242 @@ struct edge_out_round_robin_t final: public edge_out_t<Packet> {
     using netlinks_t = typename base_t::netlinks_t;
 
 private:
-    std::atomic_uintmax_t   last_used_link{0};
     queue_t                 data_to_send_{};
+    idle_links_t            idle_links_;
+
+    static std::size_t random_hint() noexcept {
+        thread_local std::uint64_t state = reinterpret_cast<std::uintptr_t>(&state) | 1;
+        state ^= state << 13; // xorshift64
+        state ^= state >> 7;
+        state ^= state << 17;
+        return static_cast<std::size_t>(state);
+    }
 
-    template <class Container>
-    struct round_robin_balancer_t {
-        Container&             c_;
-        const std::size_t      start_index_;
-
-        circular_iterator<Container> begin() const noexcept {
-            return circular_iterator<Container>(c_, start_index_, c_.size());
-        }
-
-        circular_iterator<Container> end() const noexcept {
-            return circular_iterator<Container>();
+    // Unlocks the link that has nothing to send and rechecks for the packets pushed meanwhile
+    void release_link(tcp_write_proto_t::guard_t guard) {
+        const std::size_t i = base_t::netlinks_.index_of(base_t::link_from_guard(guard));
+        guard.unlock();
+        idle_links_.release(i);
+        if (base_t::queued()) {
+            try_send();
         }
-    };
-
-    round_robin_balancer_t<netlinks_t> links_balancer() noexcept {
-        return {base_t::netlinks_, last_used_link.fetch_add(1, std::memory_order_relaxed)};
     }
 
     void try_send() {
-        for (auto& v: links_balancer()) {
-            tcp_write_proto_t::guard_t lock = v.try_lock();
+        // Each idle link is tried at most once, some of them may have no credits left
+        for (std::size_t attempts = base_t::links_count(); attempts; --attempts) {
+            const std::size_t i = idle_links_.claim(random_hint(), [this](std::size_t link) {
+                return base_t::link_score(link).score;
+            });
+            if (i == idle_links_t::npos) {
+                return;
+            }
+
+            auto& link = base_t::netlinks_[i];
+            tcp_write_proto_t::guard_t lock = link.try_lock();
             if (!lock) {
-                continue;
+                continue;   // Locked for reconnect, link gets back to the idle ones after that
             }
 
-            auto p = data_to_send_.try_pop();
-            if (!p) {
+            if (base_t::send_batch(link, data_to_send_, lock)) {
                 return;
             }
 
-            const auto buf = base_t::get_buf(v, std::move(*p));
-            v.async_send(std::move(lock), buf);
-            break;
+            const bool no_credits = !link.available_credits();
+            lock.unlock();
+            idle_links_.release(i);
+            if (!no_credits) {
+                return; // Nothing to send
+            }
         }
     }
 
+    void on_credits(link_t& /*link*/) final {
+        try_send();
+    }
+
 public:
-    explicit edge_out_round_robin_t(std::uint16_t edge_id_for_receiver)
+    explicit edge_out_balanced_t(std::uint16_t edge_id_for_receiver)
         : base_t(edge_id_for_receiver)
     {}
 
+    void preinit_links(std::size_t count) final {
+        base_t::preinit_links(count);
+        idle_links_.init(count);
+    }
+
     void assert_no_more_data() noexcept {
         //BOOST_ASSERT_MSG(!data_to_send_.try_pop(), "Have data to send");
     }
 
     void try_steal_work(tcp_write_proto_t::guard_t guard) final {
-        auto v = data_to_send_.try_pop();
-        if (!v) {
-            return;
-        }
-
         auto& link = base_t::link_from_guard(guard);
-        const auto buf = base_t::get_buf(link, std::move(*v));
-        link.async_send(std::move(guard), buf);
+        base_t::on_write_finished(link);
+        link.packet.clear();
+        if (!base_t::send_batch(link, data_to_send_, guard)) {
+            release_link(std::move(guard));
+        }
     }
 
     void reschedule_packet_from_link(const tcp_write_proto_t::guard_t& guard) final {
         auto& link = base_t::link_from_guard(guard);
-        auto p = std::move(link.packet);
+        base_t::on_write_finished(link, true);
 
-        BOOST_ASSERT_MSG(!base_t::empty_packet(p), "Scheduling an empty packet without headers for push_immediate sending. This must not be produced by accepting vertexes");
-        data_to_send_.silent_push_front(std::move(p));
+        BOOST_ASSERT_MSG(!link.packet.empty(), "Scheduling an empty batch for push_immediate sending. This must not be produced by accepting vertexes");
+        link.packet.extract_unsent_reversed(link.last_bytes_written(), [this](Packet p) {
+            data_to_send_.silent_push_front(std::move(p));
+            base_t::on_queued(1);
+        });
         try_send();
     }
 
     void push(wave_id_t /*wave*/, Packet p) final {
         BOOST_ASSERT_MSG(!base_t::empty_packet(p), "Scheduling an empy packet without headers for sending. This must not be produced by accepting vertexes");
         data_to_send_.silent_push(std::move(p));
+        base_t::on_queued(1);
         try_send(); // Rechecking for case when some write operation was finished before we pushed into the data_to_send_
     }
 };
 
+// Sends all the packets of a wave to the same host, so that a vertex with multiple in-edges
+// and multiple hosts gets all the parts of the wave on one host. Hosts are picked by the consistent
+// hashing, links that failed are skipped till they reconnect.
 template <class Packet>
 struct edge_out_exact_t final: public edge_out_t<Packet> {
     using base_t = edge_out_t<Packet>;
 
-    using queue_t = silent_mt_queue<Packet>;
+    using queue_t = silent_mt_queue<Packet, credits_window>;
     using link_t = typename base_t::link_t;
     using netlinks_t = typename base_t::netlinks_t;
 
 private:
-    std::atomic_uintmax_t   last_used_link{0};
-    queue_t                 data_to_send_{};
-
-    template <class Container>
-    struct round_robin_balancer_t {
-        Container&             c_;
-        const std::size_t      start_index_;
-
-        circular_iterator<Container> begin() const noexcept {
-            return circular_iterator<Container>(c_, start_index_, c_.size());
-        }
+    const wave_hash_ring_t                          ring_;
+    const std::size_t                               links_count_;
+    lazy_array<queue_t>                             data_to_send_{};    // Queue per link
+    // Health of the links as seen by this writer. A link goes down only when its reconnect fails,
+    // writers that have not tried to connect yet still route its waves to the failed host. So while
+    // the host is failing, parts of a wave from different writers may go to different hosts: such
+    // waves are never gathered and expire by the partial waves timeout of packets_gatherer_t.
+    const std::unique_ptr<std::atomic<bool>[]>      link_up_;
+
+    std::size_t link_for(wave_id_t wave) const {
+        return ring_.host_for(wave, [this](std::size_t i) {
+            return link_up_[i].load(std::memory_order_relaxed);
+        });
+    }
 
-        circular_iterator<Container> end() const noexcept {
-            return circular_iterator<Container>();
+    bool has_links_up() const noexcept {
+        for (std::size_t i = 0; i < links_count_; ++i) {
+            if (link_up_[i].load(std::memory_order_relaxed)) {
+                return true;
+            }
         }
-    };
-
-    round_robin_balancer_t<netlinks_t> links_balancer() noexcept {
-        return {base_t::netlinks_, last_used_link.fetch_add(1, std::memory_order_relaxed)};
+        return false;
     }
 
-    void try_send() {
-        for (auto& v: links_balancer()) {
-            tcp_write_proto_t::guard_t lock = v.try_lock();
-            if (!lock) {
-                continue;
-            }
+    // Unlocks the link that has nothing to send. Returns true if packets were pushed meanwhile: pushers that
+    // failed to lock the link rely on its owner to send them. Links without credits are retried by on_credits().
+    bool release_link(tcp_write_proto_t::guard_t guard) {
+        auto& link = base_t::link_from_guard(guard);
+        const bool has_credits = !!link.available_credits();
+        guard.unlock();
+        std::atomic_thread_fence(std::memory_order_seq_cst);    // Pairs with on_queued() of the pushers
+        return has_credits && !data_to_send_[base_t::netlinks_.index_of(link)].empty();
+    }
 
-            auto p = data_to_send_.try_pop();
-            if (!p) {
+    void try_send(std::size_t i) {
+        auto& link = base_t::netlinks_[i];
+        for (;;) {
+            tcp_write_proto_t::guard_t lock = link.try_lock();
+            if (!lock || base_t::send_batch(link, data_to_send_[i], lock) || !release_link(std::move(lock))) {
                 return;
             }
-
-            const auto buf = base_t::get_buf(v, std::move(*p));
-            v.async_send(std::move(lock), buf);
-            break;
         }
     }
 
+    void on_credits(link_t& link) final {
+        try_send(base_t::netlinks_.index_of(link));
+    }
+
 public:
-    explicit edge_out_exact_t(std::uint16_t edge_id_for_receiver)
+    template <class Hosts>
+    edge_out_exact_t(std::uint16_t edge_id_for_receiver, const Hosts& hosts)
         : base_t(edge_id_for_receiver)
-    {}
+        , ring_(hosts)
+        , links_count_(hosts.size())
+        , link_up_(new std::atomic<bool>[links_count_])
+    {
+        data_to_send_.init(links_count_);
+        for (std::size_t i = 0; i < links_count_; ++i) {
+            data_to_send_.inplace_construct(i);
+            link_up_[i].store(true, std::memory_order_relaxed);   // Till the first error, so that all the writers agree on routing
+        }
+    }
 
     void assert_no_more_data() noexcept {
-        BOOST_ASSERT_MSG(!data_to_send_.try_pop(), "Have data to send");
+        for (auto& q: data_to_send_) {
+            BOOST_ASSERT_MSG(!q.try_pop(), "Have data to send");
+        }
     }
 
-    void try_steal_work(tcp_write_proto_t::guard_t guard) final {
-        auto v = data_to_send_.try_pop();
-        if (!v) {
-            return;
-        }
+    boost::optional<std::size_t> preferred_link(wave_id_t wave) const final {
+        return link_for(wave);
+    }
 
+    void try_steal_work(tcp_write_proto_t::guard_t guard) final {
         auto& link = base_t::link_from_guard(guard);
-        const auto buf = base_t::get_buf(link, std::move(*v));
-        link.async_send(std::move(guard), buf);
+        const std::size_t i = base_t::netlinks_.index_of(link);
+        link_up_[i].store(true, std::memory_order_relaxed);   // Connected or finished a write
+
+        base_t::on_write_finished(link);
+        link.packet.clear();
+        if (!base_t::send_batch(link, data_to_send_[i], guard) && release_link(std::move(guard))) {
+            try_send(i);
+        }
     }
 
     void reschedule_packet_from_link(const tcp_write_proto_t::guard_t& guard) final {
         auto& link = base_t::link_from_guard(guard);
-        auto p = std::move(link.packet);
+        auto& queue = data_to_send_[base_t::netlinks_.index_of(link)];
+        base_t::on_write_finished(link, true);
+
+        BOOST_ASSERT_MSG(!link.packet.empty(), "Scheduling an empty batch for push_immediate sending. This must not be produced by accepting vertexes");
+        link.packet.extract_unsent_reversed(link.last_bytes_written(), [this, &queue](Packet p) {
+            queue.silent_push_front(std::move(p));
+            base_t::on_queued(1);
+        });
+    }
 
-        BOOST_ASSERT_MSG(!base_t::empty_packet(p), "Scheduling an empty packet without headers for push_immediate sending. This must not be produced by accepting vertexes");
-        data_to_send_.silent_push_front(std::move(p));
-        try_send();
+    // Waves of the link that failed to reconnect go to the other hosts, as if the host was removed from the ring
+    void on_link_error(const tcp_write_proto_t::guard_t& guard) final {
+        const std::size_t failed = base_t::netlinks_.index_of(base_t::link_from_guard(guard));
+        link_up_[failed].store(false, std::memory_order_relaxed);
+        if (!has_links_up()) {
+            return; // Packets wait for the reconnect
+        }
+
+        while (auto p = data_to_send_[failed].try_pop()) {
+            const std::size_t i = link_for(base_t::wave_of(*p));
+            if (i == failed) {
+                data_to_send_[i].silent_push_front(std::move(*p));
+                break;  // All the other links failed meanwhile
+            }
+            data_to_send_[i].silent_push(std::move(*p));
+        }
+
+        for (std::size_t i = 0; i < links_count_; ++i) {
+            if (i != failed) {
+                try_send(i);
+            }
+        }
     }
 
-    void push(wave_id_t /*wave*/, Packet p) final {
+    void push(wave_id_t wave, Packet p) final {
         BOOST_ASSERT_MSG(!base_t::empty_packet(p), "Scheduling an empy packet without headers for sending. This must not be produced by accepting vertexes");
-        data_to_send_.silent_push(std::move(p));
-        try_send(); // Rechecking for case when some write operation was finished before we pushed into the data_to_send_
+        const std::size_t i = link_for(wave);
+        data_to_send_[i].silent_push(std::move(p));
+        base_t::on_queued(1);
+        try_send(i); // Rechecking for case when some write operation was finished before we pushed into the data_to_send_
     }
 };
 
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "utility.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <boost/assert.hpp>
+
+namespace dmn {
+
+// Lock free set of links that have nothing to send. Link adds itself after it got unlocked,
+// writer claims one of the links and locks it. A claim costs one scan of a word per 64 links.
+class idle_links_t {
+    DMN_PINNED(idle_links_t);
+
+    using word_t = std::uint64_t;
+    static constexpr std::size_t word_bits = 64;
+
+    std::size_t                             size_ = 0;
+    std::size_t                             words_ = 0;
+    std::unique_ptr<std::atomic<word_t>[]>  bits_;
+
+    static std::size_t count_trailing_zeros(word_t v) noexcept {
+        BOOST_ASSERT(v);
+        return static_cast<std::size_t>(__builtin_ctzll(v));
+    }
+
+    static word_t rotate_right(word_t v, std::size_t shift) noexcept {
+        return shift ? (v >> shift) | (v << (word_bits - shift)) : v;
+    }
+
+public:
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+    idle_links_t() = default;
+
+    void init(std::size_t size) {
+        BOOST_ASSERT_MSG(!size_, "Idle links are already initialized");
+        size_ = size;
+        words_ = (size + word_bits - 1) / word_bits;
+        bits_.reset(new std::atomic<word_t>[words_]);
+        for (std::size_t i = 0; i < words_; ++i) {
+            bits_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Link must be unlocked before the call
+    void release(std::size_t i) noexcept {
+        BOOST_ASSERT_MSG(i < size_, "Out of bounds");
+        bits_[i / word_bits].fetch_or(word_t{1} << (i % word_bits));
+    }
+
+    // Returns true if the link was idle and now belongs to the caller
+    bool try_claim(std::size_t i) noexcept {
+        BOOST_ASSERT_MSG(i < size_, "Out of bounds");
+        const word_t bit = word_t{1} << (i % word_bits);
+        return bits_[i / word_bits].fetch_and(~bit) & bit;
+    }
+
+    // Claims one of the first two idle links that follow `hint`, the one with the lower `score(i)`.
+    // Returns npos if there are no idle links.
+    template <class Score>
+    std::size_t claim(std::size_t hint, Score score) noexcept {
+        for (;;) {
+            std::size_t candidates[2];
+            std::size_t found = 0;
+
+            const std::size_t start_word = (hint / word_bits) % words_;
+            const std::size_t shift = hint % word_bits;
+            for (std::size_t w = 0; w < words_ && found < 2; ++w) {
+                const std::size_t word = (start_word + w) % words_;
+                word_t bits = rotate_right(bits_[word].load(), shift);
+                while (bits && found < 2) {
+                    const std::size_t bit = (count_trailing_zeros(bits) + shift) % word_bits;
+                    candidates[found++] = word * word_bits + bit;
+                    bits &= bits - 1;
+                }
+            }
+
+            if (!found) {
+                return npos;
+            }
+
+            if (found == 2 && score(candidates[1]) < score(candidates[0])) {
+                std::swap(candidates[0], candidates[1]);
+            }
+
+            for (std::size_t i = 0; i < found; ++i) {
+                if (try_claim(candidates[i])) {
+                    return candidates[i];
+                }
+            }
+            // Both were claimed by other writers, retrying
+        }
+    }
+};
+
+} // namespace dmn
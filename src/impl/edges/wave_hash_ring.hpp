@@ -0,0 +1,90 @@
+#pragma once
+
+#include "impl/packet.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <boost/assert.hpp>
+
+namespace dmn {
+
+// Consistent hashing of waves onto the hosts of a vertex. Each host owns `points_per_host` points
+// of the ring, wave goes to the owner of the first point that follows the wave hash.
+//
+// Ring depends only on the hosts from the graph, so all the writers of a vertex send parts of
+// a wave to the same host. When a host is down only its waves move to the following points.
+class wave_hash_ring_t {
+    struct point_t {
+        std::uint64_t   hash;
+        std::size_t     host;
+    };
+
+    std::vector<point_t>    points_;
+
+public:
+    static constexpr std::size_t points_per_host = 64;
+
+    // Stable across processes and builds, unlike std::hash
+    static std::uint64_t hash(const std::string& s) noexcept {
+        std::uint64_t h = 14695981039346656037ull; // FNV-1a
+        for (unsigned char c: s) {
+            h = (h ^ c) * 1099511628211ull;
+        }
+        return mix(h);
+    }
+
+    static std::uint64_t mix(std::uint64_t v) noexcept {
+        v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ull; // splitmix64 finalizer
+        v = (v ^ (v >> 27)) * 0x94d049bb133111ebull;
+        return v ^ (v >> 31);
+    }
+
+    // Hosts is a sequence of (address, port) pairs
+    template <class Hosts>
+    explicit wave_hash_ring_t(const Hosts& hosts) {
+        BOOST_ASSERT_MSG(!hosts.empty(), "Hash ring without hosts");
+        points_.reserve(hosts.size() * points_per_host);
+
+        std::size_t host = 0;
+        for (const auto& h: hosts) {
+            const std::string key = h.first + ':' + std::to_string(h.second) + '#';
+            for (std::size_t i = 0; i < points_per_host; ++i) {
+                points_.push_back(point_t{hash(key + std::to_string(i)), host});
+            }
+            ++host;
+        }
+
+        std::sort(points_.begin(), points_.end(), [](const point_t& lhs, const point_t& rhs) {
+            return lhs.hash < rhs.hash || (lhs.hash == rhs.hash && lhs.host < rhs.host);
+        });
+    }
+
+    // Returns the first host that owns the wave and for which `is_up(host)` is true.
+    // If all the hosts are down, returns the owner of the wave.
+    template <class IsUp>
+    std::size_t host_for(wave_id_t wave, IsUp is_up) const {
+        const std::uint64_t h = mix(static_cast<std::uint64_t>(wave));
+        const auto it = std::lower_bound(points_.begin(), points_.end(), h, [](const point_t& p, std::uint64_t v) {
+            return p.hash < v;
+        });
+
+        const std::size_t start = static_cast<std::size_t>(it - points_.begin());
+        const std::size_t size = points_.size();
+        for (std::size_t i = 0; i < size; ++i) {
+            const std::size_t host = points_[(start + i) % size].host;
+            if (is_up(host)) {
+                return host;
+            }
+        }
+
+        return points_[start % size].host;
+    }
+
+    std::size_t host_for(wave_id_t wave) const {
+        return host_for(wave, [](std::size_t) { return true; });
+    }
+};
+
+} // namespace dmn
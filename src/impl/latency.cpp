@@ -0,0 +1,88 @@
+#include "impl/latency.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <boost/assert.hpp>
+
+namespace dmn {
+
+latency_histogram_t::latency_histogram_t()
+    : buckets_(new std::atomic<std::uint64_t>[buckets_count])
+{
+    for (std::size_t i = 0; i < buckets_count; ++i) {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+std::uint64_t latency_histogram_t::percentile(double q) const noexcept {
+    BOOST_ASSERT_MSG(q >= 0.0 && q <= 1.0, "Percentile out of range");
+    const std::uint64_t total = count();
+    if (!total) {
+        return 0;
+    }
+
+    const auto target = (std::max<std::uint64_t>)(static_cast<std::uint64_t>(std::ceil(q * total)), 1);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < buckets_count; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            return (std::min)(bucket_upper(i), max());
+        }
+    }
+
+    return max();
+}
+
+latency_summary_t latency_histogram_t::summary() const noexcept {
+    latency_summary_t res;
+    res.count = count();
+    res.p50_ns = percentile(0.5);
+    res.p99_ns = percentile(0.99);
+    res.p999_ns = percentile(0.999);
+    res.max_ns = max();
+    return res;
+}
+
+void latency_histogram_t::merge(const latency_histogram_t& other) noexcept {
+    BOOST_ASSERT_MSG(&other != this, "Merging a histogram into itself");
+    for (std::size_t i = 0; i < buckets_count; ++i) {
+        buckets_[i].fetch_add(other.buckets_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    count_.fetch_add(other.count(), std::memory_order_relaxed);
+    sum_.fetch_add(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    const std::uint64_t other_max = other.max();
+    std::uint64_t max = max_.load(std::memory_order_relaxed);
+    while (other_max > max && !max_.compare_exchange_weak(max, other_max, std::memory_order_relaxed)) {}
+}
+
+const char* to_string(latency_stage_enum stage) noexcept {
+    switch (stage) {
+    case latency_stage_enum::NETWORK: return "network";
+    case latency_stage_enum::QUEUEING: return "queueing";
+    case latency_stage_enum::CALLBACK: return "callback";
+    case latency_stage_enum::END_TO_END: return "end_to_end";
+    case latency_stage_enum::COUNT_: break;
+    }
+
+    BOOST_ASSERT_MSG(false, "Unknown latency stage");
+    return "";
+}
+
+
+void latency_stats_t::dump(std::ostream& out, const std::string& prefix) const {
+    for (unsigned i = 0; i < static_cast<unsigned>(latency_stage_enum::COUNT_); ++i) {
+        const auto stage = static_cast<latency_stage_enum>(i);
+        const latency_summary_t s = summary(stage);
+        out << prefix << " stage=" << to_string(stage)
+            << " count=" << s.count
+            << " p50_ns=" << s.p50_ns
+            << " p99_ns=" << s.p99_ns
+            << " p999_ns=" << s.p999_ns
+            << " max_ns=" << s.max_ns
+            << '\n';
+    }
+}
+
+} // namespace dmn
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "field_tag.hpp"
+#include "utility.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace dmn {
+
+// Timestamps of a wave, carried by the packets as the `wave_timestamps_field` when latency tracking
+// is enabled. Nanoseconds of the system clock, so the network time between hosts includes the clock skew.
+struct wave_timestamps_t {
+    std::uint64_t created_ns = 0;   // Source created the wave
+    std::uint64_t sent_ns = 0;      // Previous vertex finished the callback
+    std::uint64_t accepted_ns = 0;  // This vertex received the packet
+};
+
+DMN_FIELD(wave_timestamps_field, "dmn.wave_timestamps");
+
+inline std::uint64_t timestamp_now() noexcept {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count());
+}
+
+struct latency_summary_t {
+    std::uint64_t count = 0;
+    std::uint64_t p50_ns = 0;
+    std::uint64_t p99_ns = 0;
+    std::uint64_t p999_ns = 0;
+    std::uint64_t max_ns = 0;
+};
+
+// Lock free histogram of durations with a bounded relative error (HDR histogram style). Values are
+// grouped by their highest bit, each group is split into linear buckets, so the error is below
+// 1 / 2^(sub_bucket_bits - 1) for any value.
+class latency_histogram_t {
+    DMN_PINNED(latency_histogram_t);
+
+public:
+    static constexpr unsigned sub_bucket_bits = 7;
+    static constexpr std::size_t half_sub_buckets = std::size_t{1} << (sub_bucket_bits - 1);
+    static constexpr std::size_t buckets_count = (66 - sub_bucket_bits) * half_sub_buckets;
+
+private:
+    const std::unique_ptr<std::atomic<std::uint64_t>[]> buckets_;
+    std::atomic<std::uint64_t>  count_{0};
+    std::atomic<std::uint64_t>  sum_{0};
+    std::atomic<std::uint64_t>  max_{0};
+
+public:
+    latency_histogram_t();
+
+    static std::size_t bucket_of(std::uint64_t v) noexcept {
+        if (v < 2 * half_sub_buckets) {
+            return static_cast<std::size_t>(v);
+        }
+
+        const unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(v));
+        const unsigned shift = msb - (sub_bucket_bits - 1);
+        return shift * half_sub_buckets + static_cast<std::size_t>(v >> shift);
+    }
+
+    // Highest value that goes into the bucket
+    static std::uint64_t bucket_upper(std::size_t i) noexcept {
+        if (i < 2 * half_sub_buckets) {
+            return i;
+        }
+
+        const std::size_t shift = i / half_sub_buckets - 1;
+        const std::uint64_t mantissa = i - shift * half_sub_buckets;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    void record(std::uint64_t ns) noexcept {
+        buckets_[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(ns, std::memory_order_relaxed);
+
+        std::uint64_t max = max_.load(std::memory_order_relaxed);
+        while (ns > max && !max_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+    }
+
+    // Durations measured by different clocks may be negative, those are accounted as 0
+    void record(std::uint64_t from_ns, std::uint64_t to_ns) noexcept {
+        record(to_ns > from_ns ? to_ns - from_ns : 0);
+    }
+
+    std::uint64_t count() const noexcept {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t max() const noexcept {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t mean() const noexcept {
+        const std::uint64_t c = count();
+        return c ? sum_.load(std::memory_order_relaxed) / c : 0;
+    }
+
+    // Value that is not less than `q` of the recorded values, 0 <= q <= 1.
+    // Concurrent records may be partially seen.
+    std::uint64_t percentile(double q) const noexcept;
+
+    latency_summary_t summary() const noexcept;
+
+    // Adds the values recorded by `other`, for example to aggregate the histograms of several nodes
+    void merge(const latency_histogram_t& other) noexcept;
+};
+
+enum class latency_stage_enum: unsigned {
+    NETWORK,        // From the end of the previous vertex callback till the packet is received, includes the out-edge queue
+    QUEUEING,       // From receiving the packet till the callback, includes gathering of the wave parts
+    CALLBACK,       // User callback
+    END_TO_END,     // From the wave creation by the source till the end of the sink callback
+
+    COUNT_,
+};
+
+const char* to_string(latency_stage_enum stage) noexcept;
+
+// Latency histograms of a node
+class latency_stats_t {
+    DMN_PINNED(latency_stats_t);
+
+    std::array<latency_histogram_t, static_cast<std::size_t>(latency_stage_enum::COUNT_)> stages_;
+
+public:
+    latency_stats_t() = default;
+
+    latency_histogram_t& operator[](latency_stage_enum stage) noexcept {
+        return stages_[static_cast<std::size_t>(stage)];
+    }
+
+    const latency_histogram_t& operator[](latency_stage_enum stage) const noexcept {
+        return stages_[static_cast<std::size_t>(stage)];
+    }
+
+    latency_summary_t summary(latency_stage_enum stage) const noexcept {
+        return (*this)[stage].summary();
+    }
+
+    // Accounts the network time of the received packet and stamps the time of receiving.
+    // `field` is the mutable data of the wave_timestamps_field.
+    void on_received(std::pair<unsigned char*, std::size_t> field) noexcept {
+        if (field.second != sizeof(wave_timestamps_t)) {
+            return;
+        }
+
+        wave_timestamps_t ts;
+        std::memcpy(&ts, field.first, sizeof(ts));
+        ts.accepted_ns = timestamp_now();
+        (*this)[latency_stage_enum::NETWORK].record(ts.sent_ns, ts.accepted_ns);
+        std::memcpy(field.first, &ts, sizeof(ts));
+    }
+
+    // Lines of "<prefix> stage=<stage> count=<n> p50_ns=<v> p99_ns=<v> p999_ns=<v> max_ns=<v>"
+    void dump(std::ostream& out, const std::string& prefix) const;
+};
+
+} // namespace dmn
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "utility.hpp"
+#include <boost/align/aligned_alloc.hpp>
 #include <boost/assert.hpp>
 #include <type_traits>
 #include <new>
@@ -41,7 +42,12 @@ public:
         BOOST_ASSERT_MSG(size_ == 0, "Incorrect usage of pinned_container. it must be inited only once");
         BOOST_ASSERT(size != 0);
         size_ = size;
-        data_ = new storage_t[size_];
+
+        // Elements may be over-aligned to avoid false sharing, `new` does not respect that before C++17
+        data_ = static_cast<storage_t*>(boost::alignment::aligned_alloc(alignof(storage_t), size_ * sizeof(storage_t)));
+        if (!data_) {
+            throw std::bad_alloc{};
+        }
     }
 
     ~lazy_array() noexcept {
@@ -52,7 +58,7 @@ public:
             (*this)[i].~T();
         }
 
-        delete[] data_;
+        boost::alignment::aligned_free(data_);
     }
 
     template <class Derived, class... Args>
@@ -103,6 +109,12 @@ public:
         BOOST_ASSERT_MSG(i < constructed_, "Acessing element that is not constructed");
         return *reinterpret_cast<T*>(data_ + i);
     }
+
+    std::size_t index_of(const T& v) const noexcept {
+        const auto* storage = reinterpret_cast<const storage_t*>(&v);
+        BOOST_ASSERT_MSG(storage >= data_ && storage < data_ + constructed_, "Element is not from this array");
+        return static_cast<std::size_t>(storage - data_);
+    }
 };
 
 
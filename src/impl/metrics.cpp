@@ -0,0 +1,128 @@
+#include "impl/metrics.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <boost/assert.hpp>
+
+namespace dmn {
+
+namespace {
+
+#if DMN_DEBUG
+bool is_valid_name(const std::string& name) noexcept {
+    if (name.empty() || std::isdigit(static_cast<unsigned char>(name.front()))) {
+        return false;
+    }
+
+    return std::all_of(name.cbegin(), name.cend(), [](char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == ':';
+    });
+}
+#endif
+
+void escape_label_value(std::string& out, const std::string& value) {
+    for (char c: value) {
+        switch (c) {
+        case '\\': out += "\\\\"; break;
+        case '"': out += "\\\""; break;
+        case '\n': out += "\\n"; break;
+        default: out += c;
+        }
+    }
+}
+
+std::string render_labels(const metric_labels_t& labels) {
+    if (labels.empty()) {
+        return {};
+    }
+
+    std::string res = "{";
+    for (const auto& l: labels) {
+        BOOST_ASSERT_MSG(is_valid_name(l.first), "Invalid metric label name");
+        if (res.size() > 1) {
+            res += ',';
+        }
+        res += l.first;
+        res += "=\"";
+        escape_label_value(res, l.second);
+        res += '"';
+    }
+    res += '}';
+    return res;
+}
+
+const char* type_name(metrics_registry_t::type_enum type) noexcept {
+    return type == metrics_registry_t::type_enum::COUNTER ? "counter" : "gauge";
+}
+
+} // anonymous namespace
+
+void metrics_registry_t::registration_t::reset() noexcept {
+    if (registry_) {
+        registry_->remove(id_);
+        registry_ = nullptr;
+    }
+}
+
+metrics_registry_t::registration_t metrics_registry_t::add(std::string name, std::string help, type_enum type, const metric_labels_t& labels, std::function<double()> read) {
+    BOOST_ASSERT_MSG(is_valid_name(name), "Invalid metric name");
+    BOOST_ASSERT_MSG(read, "Metric without a source");
+
+    std::lock_guard<std::mutex> lock{metrics_mutex_};
+    const std::uint64_t id = next_id_++;
+    metrics_.push_back(metric_t{id, std::move(name), std::move(help), type, render_labels(labels), std::move(read)});
+    return registration_t{*this, id};
+}
+
+void metrics_registry_t::remove(std::uint64_t id) noexcept {
+    std::lock_guard<std::mutex> lock{metrics_mutex_};
+    const auto it = std::find_if(metrics_.begin(), metrics_.end(), [id](const metric_t& m) {
+        return m.id == id;
+    });
+    BOOST_ASSERT_MSG(it != metrics_.end(), "Removing an unknown metric");
+    metrics_.erase(it);
+}
+
+std::size_t metrics_registry_t::size() const {
+    std::lock_guard<std::mutex> lock{metrics_mutex_};
+    return metrics_.size();
+}
+
+void metrics_registry_t::render(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock{metrics_mutex_};
+
+    // Samples of a metric must go right after its HELP and TYPE lines
+    std::vector<const metric_t*> sorted;
+    sorted.reserve(metrics_.size());
+    for (const auto& m: metrics_) {
+        sorted.push_back(&m);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const metric_t* lhs, const metric_t* rhs) {
+        return lhs->name < rhs->name;
+    });
+
+    const auto precision = out.precision(std::numeric_limits<double>::max_digits10);
+    const std::string* prev_name = nullptr;
+    for (const metric_t* m: sorted) {
+        if (!prev_name || *prev_name != m->name) {
+            out << "# HELP " << m->name << ' ' << m->help << '\n'
+                << "# TYPE " << m->name << ' ' << type_name(m->type) << '\n';
+            prev_name = &m->name;
+        }
+
+        out << m->name << m->labels << ' ' << m->read() << '\n';
+    }
+    out.precision(precision);
+}
+
+std::string metrics_registry_t::render() const {
+    std::ostringstream ss;
+    render(ss);
+    return ss.str();
+}
+
+} // namespace dmn
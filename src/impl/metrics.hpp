@@ -0,0 +1,145 @@
+#pragma once
+
+#include "utility.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dmn {
+
+// Counter that is cheap to increment from many threads. Each thread increments a counter on its own
+// cache line, the value is aggregated on read. Threads share the lines if there are more of them than stripes.
+class metrics_counter_t {
+    DMN_PINNED(metrics_counter_t);
+
+    static constexpr std::size_t stripes_count = 16;
+
+    struct alignas(hardware_destructive_interference_size) stripe_t {
+        std::atomic<std::uint64_t> value{0};
+    };
+    std::array<stripe_t, stripes_count> stripes_;
+
+    static std::size_t this_thread_stripe() noexcept {
+        static std::atomic<std::size_t> next_stripe{0};
+        thread_local const std::size_t stripe = next_stripe.fetch_add(1, std::memory_order_relaxed) % stripes_count;
+        return stripe;
+    }
+
+public:
+    metrics_counter_t() = default;
+
+    void add(std::uint64_t v = 1) noexcept {
+        stripes_[this_thread_stripe()].value.fetch_add(v, std::memory_order_relaxed);
+    }
+
+    std::uint64_t value() const noexcept {
+        std::uint64_t res = 0;
+        for (const auto& s: stripes_) {
+            res += s.value.load(std::memory_order_relaxed);
+        }
+        return res;
+    }
+};
+
+using metric_labels_t = std::vector<std::pair<std::string, std::string>>;
+
+// Metrics of a node. Sources are registered by the node parts, edges and links and are read only
+// when the metrics are rendered, so the hot paths pay only for the counter increments.
+class metrics_registry_t {
+    DMN_PINNED(metrics_registry_t);
+
+public:
+    enum class type_enum {
+        COUNTER,
+        GAUGE,
+    };
+
+    // Removes the metric from the registry on destruction. Must not outlive the registry.
+    class registration_t {
+        metrics_registry_t* registry_ = nullptr;
+        std::uint64_t       id_ = 0;
+
+    public:
+        registration_t() noexcept = default;
+        registration_t(metrics_registry_t& registry, std::uint64_t id) noexcept
+            : registry_(&registry)
+            , id_(id)
+        {}
+
+        registration_t(registration_t&& other) noexcept
+            : registry_(other.registry_)
+            , id_(other.id_)
+        {
+            other.registry_ = nullptr;
+        }
+
+        registration_t& operator=(registration_t&& other) noexcept {
+            reset();
+            registry_ = other.registry_;
+            id_ = other.id_;
+            other.registry_ = nullptr;
+            return *this;
+        }
+
+        void reset() noexcept;
+
+        ~registration_t() {
+            reset();
+        }
+    };
+
+    using registrations_t = std::vector<registration_t>;
+
+private:
+    struct metric_t {
+        std::uint64_t           id;
+        std::string             name;
+        std::string             help;
+        type_enum               type;
+        std::string             labels;     // Already rendered
+        std::function<double()> read;
+    };
+
+    mutable std::mutex      metrics_mutex_;
+    std::vector<metric_t>   metrics_;
+    std::uint64_t           next_id_ = 0;
+
+    void remove(std::uint64_t id) noexcept;
+
+public:
+    metrics_registry_t() = default;
+
+    // `read` is called on the thread that renders the metrics
+    registration_t add(std::string name, std::string help, type_enum type, const metric_labels_t& labels, std::function<double()> read);
+
+    registration_t add_counter(std::string name, std::string help, const metric_labels_t& labels, const metrics_counter_t& counter) {
+        return add(std::move(name), std::move(help), type_enum::COUNTER, labels, [&counter]() {
+            return static_cast<double>(counter.value());
+        });
+    }
+
+    registration_t add_gauge(std::string name, std::string help, const metric_labels_t& labels, std::function<double()> read) {
+        return add(std::move(name), std::move(help), type_enum::GAUGE, labels, std::move(read));
+    }
+
+    std::size_t size() const;
+
+    // Prometheus text exposition format, version 0.0.4
+    void render(std::ostream& out) const;
+    std::string render() const;
+};
+
+// Returns `labels` with one more label
+inline metric_labels_t with_label(metric_labels_t labels, std::string name, std::string value) {
+    labels.emplace_back(std::move(name), std::move(value));
+    return labels;
+}
+
+} // namespace dmn
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <boost/optional.hpp>
+#include "impl/buffer_pool.hpp"
+#include "utility.hpp"
+
+namespace dmn {
+
+// Lock free multiple producers single consumer queue (intrusive list with a stub
+// node by D. Vyukov). Push is a single atomic exchange, pop is wait free but may
+// return nothing while a producer is in the middle of a push.
+template <class T>
+class mpsc_queue {
+    DMN_PINNED(mpsc_queue);
+
+    struct node_t {
+        std::atomic<node_t*>    next{nullptr};
+        boost::optional<T>      value;
+
+        static void* operator new(std::size_t size) {
+            return buffer_pool_allocate(size);
+        }
+
+        static void operator delete(void* p) noexcept {
+            buffer_pool_deallocate(p);
+        }
+    };
+
+    alignas(hardware_destructive_interference_size) std::atomic<node_t*> head_;
+    alignas(hardware_destructive_interference_size) node_t* tail_;
+    node_t stub_;
+
+    void push_node(node_t* n) noexcept {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        node_t* const prev = head_.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    node_t* pop_node() noexcept {
+        node_t* tail = tail_;
+        node_t* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_) {
+            if (!next) {
+                return nullptr;
+            }
+            tail_ = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+
+        if (tail != head_.load(std::memory_order_acquire)) {
+            return nullptr; // Producer has not finished the push yet
+        }
+
+        push_node(&stub_);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+
+        return nullptr;
+    }
+
+public:
+    using value_type = T;
+
+    mpsc_queue() noexcept
+        : head_{&stub_}
+        , tail_{&stub_}
+    {}
+
+    // Any thread
+    void push(T value) {
+        auto* n = new node_t{};
+        n->value.emplace(std::move(value));
+        push_node(n);
+    }
+
+    // Consumer thread only
+    boost::optional<T> try_pop() {
+        boost::optional<T> ret;
+        node_t* n = pop_node();
+        if (n) {
+            ret = std::move(n->value);
+            delete n;
+        }
+        return ret;
+    }
+
+    // Consumer thread only
+    bool empty() const noexcept {
+        return tail_ == &stub_ ? !stub_.next.load(std::memory_order_acquire) : false;
+    }
+
+    ~mpsc_queue() {
+        while (try_pop()) {}
+    }
+};
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "impl/packet.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+namespace dmn {
+
+// Credit based flow control of stream links. Writer starts with `credits_window` packets it may send
+// without confirmation. Reader returns credits for consumed packets by CREDIT packets, unless the node
+// is overloaded. Shared memory links are bounded by the ring and do not use credits.
+constexpr std::uint32_t credits_window = 256;
+
+// Reader returns credits in chunks, to keep the control traffic low
+constexpr std::uint32_t credits_grant_threshold = credits_window / 4;
+
+struct credit_packet_t {
+    packet_header_t header;
+    std::uint32_t   packets;
+    std::uint32_t   reserved;   // Keeps the size a multiple of the header alignment
+};
+static_assert(sizeof(credit_packet_t) == sizeof(packet_header_t) + 2 * sizeof(std::uint32_t), "CREDIT packet must have no padding");
+
+inline credit_packet_t make_credit_packet(std::uint32_t packets) noexcept {
+    credit_packet_t res{};
+    res.header.packet_type = packet_types_enum::CREDIT;
+    res.header.size = sizeof(res.packets) + sizeof(res.reserved);
+    res.packets = packets;
+    return res;
+}
+
+// Returns count of granted packets from the serialized packet or 0 if it is not a CREDIT packet
+inline std::uint32_t parse_credit_packet(const unsigned char* data) noexcept {
+    credit_packet_t res;
+    std::memcpy(&res, data, sizeof(res));
+    return (res.header.packet_type == packet_types_enum::CREDIT ? res.packets : 0);
+}
+
+} // namespace dmn
@@ -0,0 +1,100 @@
+#include "impl/net/direct_link.hpp"
+
+#include <unordered_map>
+#include <boost/asio/post.hpp>
+
+#include "impl/net/stream_endpoint.hpp"
+
+namespace dmn {
+
+void direct_endpoint_t::attach(boost::asio::io_context& ios, on_packet_t on_packet) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    BOOST_ASSERT_MSG(!ios_, "Two receivers for the same host:port in one process");
+    ios_ = &ios;
+    on_packet_ = std::move(on_packet);
+    ++generation_;
+    attached_.store(true, std::memory_order_release);
+
+    // Packets left from the previous receiver
+    if (pending_.load(std::memory_order_acquire)) {
+        boost::asio::post(*ios_, [self = shared_from_this(), g = generation_]() { self->drain(g); });
+    }
+}
+
+void direct_endpoint_t::detach() noexcept {
+    std::lock_guard<std::mutex> lock{mutex_};
+    attached_.store(false, std::memory_order_release);
+    ios_ = nullptr;
+    on_packet_ = {};
+}
+
+bool direct_endpoint_t::try_push(shared_packet_t& p) {
+    if (!attached() || pending_.load(std::memory_order_relaxed) >= max_pending) {
+        return false;
+    }
+
+    queue_.push(std::move(p));
+    if (pending_.fetch_add(1, std::memory_order_acq_rel) == 0) {
+        schedule_drain();
+    }
+    return true;
+}
+
+void direct_endpoint_t::schedule_drain() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (!ios_) {
+        // Receiver is gone. Packets wait in queue for the next receiver, it will drain them in attach().
+        return;
+    }
+
+    boost::asio::post(*ios_, [self = shared_from_this(), g = generation_]() { self->drain(g); });
+}
+
+void direct_endpoint_t::drain(std::size_t generation) {
+    on_packet_t on_packet;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (generation != generation_ || !on_packet_) {
+            return;
+        }
+        on_packet = on_packet_;
+    }
+
+    std::size_t processed = 0;
+    for (; processed < max_drain_batch; ++processed) {
+        auto p = queue_.try_pop();
+        if (!p) {
+            break;  // Empty or a producer is in the middle of a push
+        }
+        on_packet(std::move(*p).to_packet_network());
+    }
+
+    if (pending_.fetch_sub(processed, std::memory_order_acq_rel) != processed) {
+        schedule_drain();
+    }
+}
+
+direct_endpoint_ptr_t get_direct_endpoint(const std::string& host, unsigned short port) {
+    static std::mutex registry_mutex;
+    static std::unordered_map<std::string, std::weak_ptr<direct_endpoint_t>> registry;
+
+    std::string key = host;
+    key += ':';
+    key += std::to_string(port);
+
+    std::lock_guard<std::mutex> lock{registry_mutex};
+    auto& weak = registry[key];
+    auto res = weak.lock();
+    if (!res) {
+        res = std::make_shared<direct_endpoint_t>();
+        weak = res;
+    }
+
+    return res;
+}
+
+bool is_direct_link_allowed(const std::string& host) noexcept {
+    return !is_unix_host(host) && !is_shm_host(host);
+}
+
+} // namespace dmn
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "impl/mpsc_queue.hpp"
+#include "impl/net/credits.hpp"
+#include "impl/net/packet_network.hpp"
+#include "impl/net/shared_packet.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/asio/io_context.hpp>
+#include <boost/optional.hpp>
+
+namespace dmn {
+
+// Receiving side of the nodes in the same process. Writers hand packets over
+// through a lock free queue, packets are processed on the io_context of the
+// receiver. No sockets and no serialization. Receivers of a fan-out share the
+// body, it is copied on the receiver's thread only if it is still shared.
+class direct_endpoint_t: public std::enable_shared_from_this<direct_endpoint_t> {
+    DMN_PINNED(direct_endpoint_t);
+
+public:
+    using on_packet_t = std::function<void(packet_network_t)>;
+
+private:
+    // Max packets processed by a single handler, to let other handlers of io_context run
+    static constexpr std::size_t max_drain_batch = 64;
+
+    // Same limit as for the packets in flight of a network link
+    static constexpr std::size_t max_pending = credits_window;
+
+    std::mutex                      mutex_;
+    boost::asio::io_context*        ios_ = nullptr;
+    on_packet_t                     on_packet_;
+
+    std::size_t                     generation_ = 0;   // Drains of the previous receivers are ignored
+
+    std::atomic<bool>               attached_{false};
+    // Count of pushed but not yet processed packets. Producer that makes it non zero schedules the drain,
+    // drain keeps rescheduling itself until it gets back to zero.
+    std::atomic<std::size_t>        pending_{0};
+    mpsc_queue<shared_packet_t>     queue_;
+
+    void schedule_drain();
+    void drain(std::size_t generation);
+
+public:
+    direct_endpoint_t() = default;
+
+    // Receiver side
+    void attach(boost::asio::io_context& ios, on_packet_t on_packet);
+    void detach() noexcept;
+
+    bool attached() const noexcept {
+        return attached_.load(std::memory_order_acquire);
+    }
+
+    // Writer side. Moves out the packet and returns true if there is an attached receiver
+    // that is not overloaded. Otherwise the writer falls back to the link with credits.
+    bool try_push(shared_packet_t& p);
+};
+
+using direct_endpoint_ptr_t = std::shared_ptr<direct_endpoint_t>;
+
+// Process local registry of receivers, keyed by host and port from the graph.
+// Endpoint is created on first request, so writers may be constructed before the receivers.
+direct_endpoint_ptr_t get_direct_endpoint(const std::string& host, unsigned short port);
+
+// Hosts with explicitly specified transport ("unix:", "shm:") are never connected directly
+bool is_direct_link_allowed(const std::string& host) noexcept;
+
+// All the in-process receivers of a single out edge. Packets are spread across attached receivers in round robin.
+class direct_edge_t {
+    std::vector<direct_endpoint_ptr_t>  endpoints_;     // By host index, nullptr for hosts that are not connected directly
+    std::size_t                         direct_hosts_ = 0;
+    std::atomic<std::size_t>            next_{0};
+
+public:
+    direct_edge_t() = default;
+
+    void add_host(const std::string& host, unsigned short port) {
+        if (is_direct_link_allowed(host)) {
+            endpoints_.push_back(get_direct_endpoint(host, port));
+            ++direct_hosts_;
+        } else {
+            endpoints_.emplace_back();
+        }
+    }
+
+    bool has_receivers() const noexcept {
+        for (const auto& e: endpoints_) {
+            if (e && e->attached()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Moves out the packet and returns true if it was handed over to an in-process receiver.
+    // If `host` is set, then only the receiver of that host is tried.
+    bool try_push(shared_packet_t& p, boost::optional<std::size_t> host = boost::none) {
+        if (!direct_hosts_) {
+            return false;
+        }
+
+        if (host) {
+            BOOST_ASSERT_MSG(*host < endpoints_.size(), "Unknown host of the direct edge");
+            const auto& e = endpoints_[*host];
+            return e && e->try_push(p);
+        }
+
+        const std::size_t size = endpoints_.size();
+        const std::size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+        for (std::size_t i = 0; i < size; ++i) {
+            const auto& e = endpoints_[(start + i) % size];
+            if (e && e->try_push(p)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+} // namespace dmn
@@ -0,0 +1,175 @@
+#include "impl/net/metrics_endpoint.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+
+namespace dmn {
+
+namespace {
+
+constexpr std::size_t max_request_size = 8 * 1024;
+
+std::string make_response(const char* status, const std::string& body) {
+    std::string res = "HTTP/1.0 ";
+    res += status;
+    res += "\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: ";
+    res += std::to_string(body.size());
+    res += "\r\nConnection: close\r\n\r\n";
+    res += body;
+    return res;
+}
+
+bool is_metrics_request(boost::asio::streambuf& request) {
+    std::string line;
+    std::istream is{&request};
+    std::getline(is, line);
+    return line.compare(0, 13, "GET /metrics ") == 0 || line.compare(0, 8, "GET / HT") == 0;
+}
+
+} // anonymous namespace
+
+struct metrics_endpoint_t::sessions_t {
+    std::mutex                              mutex;
+    const metrics_registry_t*               registry;   // nullptr after close()
+    std::vector<std::weak_ptr<session_t>>   live;
+
+    explicit sessions_t(const metrics_registry_t& r) noexcept
+        : registry(&r)
+    {}
+};
+
+struct metrics_endpoint_t::session_t: std::enable_shared_from_this<session_t> {
+    const std::shared_ptr<sessions_t>   sessions;
+    boost::asio::ip::tcp::socket        socket;
+    boost::asio::steady_timer           deadline;
+    boost::asio::streambuf              request{max_request_size};
+    std::string                         response;
+
+    session_t(boost::asio::io_context& ios, std::shared_ptr<sessions_t> s)
+        : sessions(std::move(s))
+        , socket(ios)
+        , deadline(ios)
+    {}
+
+    void close() noexcept {
+        boost::system::error_code ignore;
+        socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignore);
+        socket.close(ignore);
+    }
+
+    // Empty response if the endpoint was closed
+    std::string render_response() {
+        std::lock_guard<std::mutex> lock{sessions->mutex};
+        if (!sessions->registry) {
+            return {};
+        }
+        return (is_metrics_request(request)
+            ? make_response("200 OK", sessions->registry->render())
+            : make_response("404 Not Found", "Metrics are served at /metrics\n")
+        );
+    }
+
+    void start(std::chrono::milliseconds timeout) {
+        auto self = shared_from_this();
+
+        // Idle or slow clients are disconnected, otherwise each of them holds a session forever
+        deadline.expires_after(timeout);
+        deadline.async_wait([self](const boost::system::error_code& e) {
+            if (!e) {
+                self->close();
+            }
+        });
+
+        boost::asio::async_read_until(socket, request, "\r\n\r\n", [self](const boost::system::error_code& e, std::size_t /*bytes*/) {
+            if (e) {
+                self->deadline.cancel();
+                return; // Client went away, sent a too big request, timed out or the endpoint was closed
+            }
+
+            self->response = self->render_response();
+            if (self->response.empty()) {
+                self->deadline.cancel();
+                self->close();
+                return;
+            }
+            boost::asio::async_write(self->socket, boost::asio::buffer(self->response), [self](const boost::system::error_code& /*e*/, std::size_t /*bytes*/) {
+                self->deadline.cancel();
+                self->close();
+            });
+        });
+    }
+};
+
+metrics_endpoint_t::metrics_endpoint_t(boost::asio::io_context& ios, const metrics_registry_t& registry, std::uint16_t port, std::chrono::milliseconds session_timeout)
+    : ios_(ios)
+    , sessions_(std::make_shared<sessions_t>(registry))
+    , session_timeout_(session_timeout)
+{
+    const boost::asio::ip::tcp::endpoint ep{boost::asio::ip::address_v4::loopback(), port};
+    acceptor_.emplace(ios);
+    acceptor_->open(ep.protocol());
+    acceptor_->set_option(boost::asio::socket_base::reuse_address(true));
+    acceptor_->bind(ep);
+    acceptor_->listen();
+    port_ = acceptor_->local_endpoint().port();
+
+    start_accept();
+}
+
+void metrics_endpoint_t::start_accept() {
+    auto session = std::make_shared<session_t>(ios_, sessions_);
+    auto& socket = session->socket;
+    acceptor_->async_accept(socket, [this, session = std::move(session)](const boost::system::error_code& e) {
+        if (e == boost::asio::error::operation_aborted) {
+            return;
+        }
+
+        if (!e) {
+            {
+                std::lock_guard<std::mutex> lock{sessions_->mutex};
+                auto& live = sessions_->live;
+                live.erase(
+                    std::remove_if(live.begin(), live.end(), [](const std::weak_ptr<session_t>& s) { return s.expired(); }),
+                    live.end()
+                );
+                live.push_back(session);
+            }
+            session->start(session_timeout_);
+        }
+        start_accept();
+    });
+}
+
+// Sessions are closed directly, so close() is called only while none of their handlers run: with the
+// io_context stopped, as in single_threaded_io_detach(), or from its only thread
+void metrics_endpoint_t::close() noexcept {
+    if (!acceptor_) {
+        return;
+    }
+
+    boost::system::error_code ignore;
+    acceptor_->close(ignore);
+    acceptor_.reset();
+
+    std::vector<std::weak_ptr<session_t>> live;
+    {
+        std::lock_guard<std::mutex> lock{sessions_->mutex};
+        sessions_->registry = nullptr;
+        live.swap(sessions_->live);
+    }
+    for (const auto& s: live) {
+        if (const auto session = s.lock()) {
+            session->deadline.cancel();
+            session->close();
+        }
+    }
+}
+
+} // namespace dmn
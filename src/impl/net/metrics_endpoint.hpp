@@ -0,0 +1,50 @@
+#pragma once
+
+#include "utility.hpp"
+#include "impl/metrics.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/optional/optional.hpp>
+
+namespace dmn {
+
+// Serves the metrics of a node over HTTP on a loopback port, in the Prometheus text format.
+// Each connection gets a single response to "GET /metrics" and is closed. Connections that
+// do not get their response within the session timeout are closed without a response.
+// close() also closes the connections in progress, they never touch the registry after it.
+class metrics_endpoint_t {
+    DMN_PINNED(metrics_endpoint_t);
+
+    struct session_t;
+    struct sessions_t;
+
+    boost::asio::io_context&                            ios_;
+    const std::shared_ptr<sessions_t>                   sessions_;  // Shared with the sessions, those may outlive the endpoint
+    boost::optional<boost::asio::ip::tcp::acceptor>     acceptor_;
+    const std::chrono::milliseconds                     session_timeout_;
+    std::uint16_t                                       port_ = 0;
+
+    void start_accept();
+
+public:
+    // Port 0 picks a free port. Throws if the port can not be bound.
+    metrics_endpoint_t(boost::asio::io_context& ios, const metrics_registry_t& registry, std::uint16_t port,
+                       std::chrono::milliseconds session_timeout = std::chrono::seconds{5});
+
+    ~metrics_endpoint_t() {
+        BOOST_ASSERT_MSG(!acceptor_, "Metrics endpoint must be closed before destruction!");
+    }
+
+    // Port the endpoint listens on
+    std::uint16_t port() const noexcept {
+        return port_;
+    }
+
+    void close() noexcept;
+};
+
+} // namespace dmn
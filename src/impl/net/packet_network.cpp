@@ -16,11 +16,18 @@ packet_types_enum packet_network_t::packet_type() const noexcept {
     return header().packet_type;
 }
 
+packet_layout_enum packet_network_t::version() const noexcept {
+    return header().version;
+}
+
 std::uint32_t packet_network_t::expected_body_size() const noexcept {
     return header().size;
 }
 
 std::uint32_t packet_network_t::actual_body_size() const noexcept {
+    if (body_slice_.data) {
+        return body_slice_.size;
+    }
     return data_.size() > sizeof(header()) ? data_.size() - sizeof(header()) : 0;
 }
 
@@ -32,18 +39,45 @@ wave_id_t packet_network_t::wave_id_from_packet() const noexcept {
     return header().wave_id;
 }
 
-void packet_network_t::merge_packet(packet_network_t&& in) {    // TODO: This is suboptimal. Make zero-copy here
+void packet_network_t::set_edge_id(std::uint16_t edge_id) noexcept {
+    header().edge_id = edge_id;
+}
+
+void packet_network_t::set_packet_type(packet_types_enum type) noexcept {
+    header().packet_type = type;
+}
+
+packet_network_t packet_network_t::clone() const {
+    // Bodies from the receive buffer are copied too, the clone may be modified in place
+    packet_network_t res;
+    res.data_ = data_;
+    res.data_.insert(res.data_.end(), body_slice_.data, body_slice_.data + body_slice_.size);
+    res.segments_.reserve(segments_.size());
+    for (const auto& segment: segments_) {
+        res.segments_.push_back(segment_t{segment.storage, buffer_slice_t{}});
+        auto& storage = res.segments_.back().storage;
+        storage.insert(storage.end(), segment.slice.data, segment.slice.data + segment.slice.size);
+    }
+    return res;
+}
+
+void packet_network_t::merge_packet(packet_network_t&& in) {
     BOOST_ASSERT_MSG(header().wave_id == in.header().wave_id, "Merging packets of different waves. Error in logic");
-    BOOST_ASSERT_MSG(in.data_.cbegin() + sizeof(packet_header_t) + in.header().size == in.data_.cend(), "Packet is corrupted: data size and data received missmatch");
+    BOOST_ASSERT_MSG(header().version == in.header().version, "Merging packets of different layouts. Error in logic");
 
-    const auto data_begin = in.data_.data() + sizeof(packet_header_t);
-    data_.insert(data_.end(), data_begin, data_begin + in.header().size);
+    // Zero-copy: storages of merged packets are kept as segments and are flattened only on demand
     header().size += in.header().size;
+    if (in.header().size) {
+        segments_.push_back(segment_t{std::move(in.data_), std::move(in.body_slice_)});
+    }
+    for (auto& segment: in.segments_) {
+        segments_.push_back(std::move(segment));
+    }
 }
 
 
 packet_t packet_network_t::to_native() && noexcept {
-    return packet_t{std::move(data_)};
+    return std::move(static_cast<packet_t&>(*this));
 #ifndef BOOST_LITTLE_ENDIAN
     static_assert(false, "");
 #endif
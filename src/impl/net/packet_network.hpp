@@ -16,8 +16,8 @@ public:
     packet_network_t& operator=(packet_network_t&&) = default;
     explicit packet_network_t(packet_t&& n) noexcept;
 
-    boost::asio::const_buffers_1 header_const_buffer() noexcept {
-        return {reinterpret_cast<unsigned char*>(&header()), sizeof(packet_header_t)};
+    boost::asio::const_buffers_1 header_const_buffer() const noexcept {
+        return {reinterpret_cast<const unsigned char*>(&header()), sizeof(packet_header_t)};
     }
     boost::asio::mutable_buffers_1 header_mutable_buffer() noexcept {
         place_header();
@@ -25,6 +25,8 @@ public:
     }
 
     boost::asio::mutable_buffers_1 body_mutable_buffer() {
+        BOOST_ASSERT_MSG(!is_segmented(), "Attempt to read into a segmented packet");
+        own_body();
         data_.resize(expected_body_size() + sizeof(packet_header_t));
         return boost::asio::mutable_buffers_1{
             boost::asio::mutable_buffer(data_.data() + sizeof(packet_header_t), expected_body_size())
@@ -32,6 +34,11 @@ public:
     }
 
     boost::asio::const_buffers_1 body_const_buffer() const {
+        BOOST_ASSERT_MSG(!is_segmented(), "Attempt to send a segmented packet. Call flatten() first");
+        if (body_slice_.data) {
+            BOOST_ASSERT_MSG(body_slice_.size == expected_body_size(), "packet is bigger than the body we are trying to send");
+            return boost::asio::const_buffers_1{body_slice_.data, body_slice_.size};
+        }
         BOOST_ASSERT_MSG(data_.size() >= sizeof(packet_header_t), "Attempting to send body of a packet without header.");
         BOOST_ASSERT_MSG(data_.size() - sizeof(packet_header_t) == expected_body_size(), "packet is bigger than the body we are trying to send");
         return boost::asio::const_buffers_1{
@@ -40,21 +47,32 @@ public:
     }
 
     boost::asio::const_buffers_1 const_buffer() const noexcept {
+        BOOST_ASSERT_MSG(!is_segmented(), "Attempt to send a segmented packet. Call flatten() first");
+        BOOST_ASSERT_MSG(!body_slice_.data, "Attempt to get contiguous storage of a packet with body in the receive buffer. Call flatten() first");
         return boost::asio::const_buffers_1{
             data_.data(), data_.size()
         };
     }
 
     packet_types_enum packet_type() const noexcept;
+    packet_layout_enum version() const noexcept;
     std::uint32_t expected_body_size() const noexcept;
     std::uint32_t actual_body_size() const noexcept;
     std::uint16_t edge_id_from_packet() const noexcept;
     wave_id_t wave_id_from_packet() const noexcept;
+    void set_edge_id(std::uint16_t edge_id) noexcept;
+    void set_packet_type(packet_types_enum type) noexcept;
     void merge_packet(packet_network_t&& in);
     using packet_t::clear;
     using packet_t::empty;
+    using packet_t::is_segmented;
+    using packet_t::flatten;
+    using packet_t::get_mutable_data;
     packet_t to_native() && noexcept;
 
+    // Deep copy, including the merged segments
+    packet_network_t clone() const;
+
     const void* data_address() const noexcept {
         return data_.data();
     }
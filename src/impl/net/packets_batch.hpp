@@ -0,0 +1,116 @@
+#pragma once
+
+#include "impl/net/packet_network.hpp"
+#include "impl/net/shared_packet.hpp"
+#include "impl/net/tcp_write_proto.hpp"
+
+#include <boost/asio/buffer.hpp>
+#include <boost/container/small_vector.hpp>
+
+namespace dmn {
+
+inline std::size_t packet_bytes(const packet_network_t& p) noexcept {
+    return sizeof(packet_header_t) + boost::asio::buffer_size(p.body_const_buffer());
+}
+
+inline std::size_t packet_bytes(boost::asio::const_buffer p) noexcept {
+    return boost::asio::buffer_size(p);
+}
+
+inline std::size_t packet_bytes(const shared_packet_t& p) noexcept {
+    return sizeof(packet_header_t) + boost::asio::buffer_size(p.body_const_buffer());
+}
+
+template <class Buffers>
+void append_buffers(Buffers& bufs, const packet_network_t& p) {
+    // Body of a received packet may be in the receive buffer, apart from the header
+    bufs.push_back(*p.header_const_buffer().begin());
+    const auto body = *p.body_const_buffer().begin();
+    if (boost::asio::buffer_size(body)) {
+        bufs.push_back(body);
+    }
+}
+
+template <class Buffers>
+void append_buffers(Buffers& bufs, boost::asio::const_buffer p) {
+    bufs.push_back(p);
+}
+
+template <class Buffers>
+void append_buffers(Buffers& bufs, const shared_packet_t& p) {
+    bufs.push_back(boost::asio::const_buffer{static_cast<const void*>(&p.header), sizeof(packet_header_t)});
+    const auto body = p.body_const_buffer();
+    if (boost::asio::buffer_size(body)) {
+        bufs.push_back(body);
+    }
+}
+
+struct write_batch_limits_t {
+    std::size_t max_packets = 64;
+    std::size_t max_bytes = 256 * 1024;     // First packet is always taken, even if it is bigger
+};
+
+// Packets that are sent by a single scatter/gather write
+template <class Packet>
+class packets_batch_t {
+    boost::container::small_vector<Packet, 4>                       packets_;
+    boost::container::small_vector<boost::asio::const_buffer, 8>    buffers_;
+    std::size_t                                                     bytes_ = 0;
+
+public:
+    bool empty() const noexcept {
+        return packets_.empty();
+    }
+
+    std::size_t size() const noexcept {
+        return packets_.size();
+    }
+
+    std::size_t bytes() const noexcept {
+        return bytes_;
+    }
+
+    void push_back(Packet p) {
+        bytes_ += packet_bytes(p);
+        packets_.push_back(std::move(p));
+    }
+
+    // Buffers may point into the packets_, so they are built only after all the packets were added
+    const_buffers_view_t buffers() {
+        buffers_.clear();
+        for (const auto& p: packets_) {
+            append_buffers(buffers_, p);
+        }
+
+        return {buffers_.data(), buffers_.data() + buffers_.size()};
+    }
+
+    template <class F>
+    void for_each(F f) const {
+        for (const auto& p: packets_) {
+            f(p);
+        }
+    }
+
+    // Calls `f` for each packet that was not completely written, starting from the last one, and clears the batch
+    template <class F>
+    void extract_unsent_reversed(std::size_t bytes_written, F f) {
+        auto it = packets_.begin();
+        for (; it != packets_.end() && packet_bytes(*it) <= bytes_written; ++it) {
+            bytes_written -= packet_bytes(*it);
+        }
+
+        for (auto rit = packets_.rbegin(); rit.base() != it; ++rit) {
+            f(std::move(*rit));
+        }
+        clear();
+    }
+
+    void clear() noexcept {
+        packets_.clear();
+        buffers_.clear();
+        bytes_ = 0;
+    }
+};
+
+} // namespace dmn
@@ -0,0 +1,223 @@
+#pragma once
+
+#include "impl/net/packet_network.hpp"
+#include "impl/shared_buffer.hpp"
+
+#include <cstring>
+#include <boost/asio/buffer.hpp>
+#include <boost/assert.hpp>
+#include <boost/container/small_vector.hpp>
+
+namespace dmn {
+
+using received_packets_t = boost::container::small_vector<packet_network_t, 8>;
+
+// Receive buffer of a link. Data is read by `read_some` into a big buffer and all the complete
+// packets are parsed out of it at once. Bodies of the parsed packets stay in the buffer and
+// reference it, so the reader continues with a new buffer if the old one is still referenced.
+// Packets that do not fit into the buffer are read directly into their own storage.
+class packets_reader_t {
+    // Header of the versions 1 (LINEAR) and 2 (INDEXED) with a 32 bit {16 bit host, 16 bit sequence}
+    // wave id. Bodies are the same, so such packets are upgraded to the current header on receive.
+    struct legacy_header_t {
+        std::uint16_t       version;
+        packet_types_enum   packet_type;
+        std::uint16_t       edge_id;
+        std::uint16_t       padding;
+        std::uint32_t       wave_id;
+        std::uint32_t       size;
+    };
+    static_assert(sizeof(legacy_header_t) == 16, "Legacy packet header must have no padding");
+    static_assert(sizeof(legacy_header_t) <= sizeof(packet_header_t), "Version must be readable before the header size is known");
+
+    enum legacy_versions_enum: std::uint16_t { legacy_linear = 1, legacy_indexed = 2 };
+
+    boost::intrusive_ptr<shared_buffer_t> buffer_;
+    std::size_t         begin_ = 0;     // first not parsed byte
+    std::size_t         end_ = 0;       // first not filled byte
+
+    packet_storage_t    pending_;       // storage of a packet that does not fit into the buffer
+    std::size_t         pending_filled_ = 0;
+    bool                pending_legacy_ = false;
+
+    bool                malformed_ = false;
+
+    // Returns 0 for headers of unknown versions and for packets other than DATA, that are never sent to the readers
+    static std::size_t header_size(const unsigned char* header) noexcept {
+        legacy_header_t h;
+        std::memcpy(&h, header, sizeof(h));
+        if (h.packet_type != packet_types_enum::DATA) {
+            return 0;
+        }
+        if (is_supported_version(static_cast<packet_layout_enum>(h.version))) {
+            return sizeof(packet_header_t);
+        }
+        return (h.version == legacy_linear || h.version == legacy_indexed ? sizeof(legacy_header_t) : 0);
+    }
+
+    static std::size_t full_packet_size(const unsigned char* header, std::size_t header_size) noexcept {
+        if (header_size == sizeof(legacy_header_t)) {
+            legacy_header_t h;
+            std::memcpy(&h, header, sizeof(h));
+            return header_size + h.size;
+        }
+
+        packet_header_t h;
+        std::memcpy(&h, header, sizeof(h));
+        return header_size + h.size;
+    }
+
+    static packet_network_t upgrade_legacy(const unsigned char* data) {
+        legacy_header_t legacy;
+        std::memcpy(&legacy, data, sizeof(legacy));
+
+        packet_header_t h;
+        h.version = (legacy.version == legacy_linear ? packet_layout_enum::LINEAR : packet_layout_enum::INDEXED);
+        h.packet_type = legacy.packet_type;
+        h.edge_id = legacy.edge_id;
+        h.size = legacy.size;
+        h.wave_id = make_wave_id(static_cast<std::uint16_t>(legacy.wave_id >> 16), 0, legacy.wave_id & 0xFFFFu);
+
+        packet_storage_t storage(sizeof(h) + legacy.size);
+        std::memcpy(storage.data(), &h, sizeof(h));
+        std::memcpy(storage.data() + sizeof(h), data + sizeof(legacy), legacy.size);
+        return packet_network_t{packet_t{std::move(storage)}};
+    }
+
+    template <class Container>
+    void parse(Container& out) {
+        while (end_ - begin_ >= sizeof(legacy_header_t)) {
+            const std::size_t header_bytes = header_size(buffer_->data() + begin_);
+            if (!header_bytes) {
+                malformed_ = true;
+                return;
+            }
+            if (end_ - begin_ < header_bytes) {
+                break;
+            }
+
+            const std::size_t total = full_packet_size(buffer_->data() + begin_, header_bytes);
+            const bool legacy = (header_bytes == sizeof(legacy_header_t));
+
+            if (total > buffer_->size()) {
+                // Big packet: copying what we have and reading the rest directly into the packet
+                pending_.resize(total);
+                pending_filled_ = end_ - begin_;
+                pending_legacy_ = legacy;
+                std::memcpy(pending_.data(), buffer_->data() + begin_, pending_filled_);
+                begin_ = end_;
+                compact();
+                return;
+            }
+
+            if (end_ - begin_ < total) {
+                break;
+            }
+
+            if (legacy) {
+                out.push_back(upgrade_legacy(buffer_->data() + begin_));
+                begin_ += total;
+                continue;
+            }
+
+            // Only the header is copied, so that it stays aligned
+            unsigned char* const header = buffer_->data() + begin_;
+            packet_storage_t header_storage(header, header + sizeof(packet_header_t));
+            if (total == sizeof(packet_header_t)) {
+                out.push_back(packet_network_t{packet_t{std::move(header_storage)}});
+            } else {
+                out.push_back(packet_network_t{packet_t{
+                    std::move(header_storage),
+                    buffer_slice_t{buffer_, header + sizeof(packet_header_t), total - sizeof(packet_header_t)}
+                }});
+            }
+            begin_ += total;
+        }
+
+        if (begin_ == end_ && buffer_->unique()) {
+            begin_ = end_ = 0;
+            return;
+        }
+
+        std::size_t required = sizeof(packet_header_t);
+        if (end_ - begin_ >= sizeof(legacy_header_t)) {
+            const std::size_t header_bytes = header_size(buffer_->data() + begin_);
+            if (end_ - begin_ >= header_bytes) {
+                required = full_packet_size(buffer_->data() + begin_, header_bytes);
+            }
+        }
+        if (begin_ + required > buffer_->size() || buffer_->size() - end_ < min_read_size) {
+            // Not enough space for the tail of the packet or for a big read
+            compact();
+        }
+    }
+
+    // Moves the not parsed bytes to the beginning of the buffer. Buffer that is referenced
+    // by the received packets is never overwritten, a new one is taken instead.
+    void compact() {
+        const std::size_t tail = end_ - begin_;
+        if (buffer_->unique()) {
+            std::memmove(buffer_->data(), buffer_->data() + begin_, tail);
+        } else {
+            auto fresh = shared_buffer_t::make(buffer_size);
+            std::memcpy(fresh->data(), buffer_->data() + begin_, tail);
+            buffer_ = std::move(fresh);
+        }
+        begin_ = 0;
+        end_ = tail;
+    }
+
+public:
+    // Pool allocation of a buffer, including the shared_buffer_t header
+    enum buffer_size_enum: std::size_t { buffer_size = 64 * 1024, min_read_size = 4 * 1024 };
+
+    // Buffer for the next read_some operation
+    boost::asio::mutable_buffers_1 prepare() {
+        if (!pending_.empty()) {
+            return boost::asio::mutable_buffers_1{pending_.data() + pending_filled_, pending_.size() - pending_filled_};
+        }
+
+        if (!buffer_) {
+            buffer_ = shared_buffer_t::make(buffer_size);
+        }
+        return boost::asio::mutable_buffers_1{buffer_->data() + end_, buffer_->size() - end_};
+    }
+
+    // Accounts `bytes` read into the prepare() buffer and moves all the complete packets into `out`.
+    // Returns false if the stream is malformed or comes from an incompatible writer, such link must be dropped.
+    template <class Container>
+    bool commit(std::size_t bytes, Container& out) {
+        if (malformed_) {
+            return false;
+        }
+
+        if (!pending_.empty()) {
+            pending_filled_ += bytes;
+            BOOST_ASSERT_MSG(pending_filled_ <= pending_.size(), "Read more than requested");
+            if (pending_filled_ == pending_.size()) {
+                if (pending_legacy_) {
+                    out.push_back(upgrade_legacy(pending_.data()));
+                } else {
+                    out.push_back(packet_network_t{packet_t{std::move(pending_)}});
+                }
+                pending_.clear();
+                pending_filled_ = 0;
+            }
+            return true;
+        }
+
+        end_ += bytes;
+        BOOST_ASSERT_MSG(end_ <= buffer_->size(), "Read more than requested");
+        parse(out);
+        return !malformed_;
+    }
+
+    void clear() noexcept {
+        buffer_.reset();
+        pending_.clear();
+        begin_ = end_ = pending_filled_ = 0;
+        pending_legacy_ = malformed_ = false;
+    }
+};
+
+} // namespace dmn
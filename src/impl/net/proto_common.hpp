@@ -1,6 +1,8 @@
 #pragma once
 
 #include <boost/asio/ip/tcp.hpp>
+#include <sys/socket.h>
+
 namespace dmn {
 
     template <class Socket>
@@ -40,9 +42,15 @@ namespace dmn {
         BOOST_ASSERT_MSG(!ignore, "Failed to set receive_buffer_size for socket");
     }
 
+    // TCP specific options are not applied to AF_UNIX sockets
     template <class Socket>
     void set_socket_options(Socket& s) {
         BOOST_ASSERT_MSG(s.is_open(), "Attempt to set socket options on a closed socket");
+        boost::system::error_code ec;
+        const auto local_ep = s.local_endpoint(ec);
+        if (!ec && local_ep.protocol().family() == AF_UNIX) {
+            return;
+        }
 
         boost::asio::ip::tcp::no_delay option(true);
         boost::system::error_code ignore;
@@ -52,5 +60,13 @@ namespace dmn {
         set_ping_keepalives(s);
     }
 
+    // Wakes up the peer of a shared memory link. Failure to write means that
+    // peer was not yet woken up by a previous byte or the link is broken. In
+    // both cases it will notice on its own.
+    template <class Socket>
+    void send_doorbell(Socket& s) noexcept {
+        const char wake_up = 0;
+        ::send(s.native_handle(), &wake_up, 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
 
 } // namespace dmn
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "impl/buffer_pool.hpp"
+#include "impl/net/packet_network.hpp"
+#include "utility.hpp"
+
+#include <atomic>
+#include <boost/asio/buffer.hpp>
+#include <boost/intrusive_ptr.hpp>
+
+namespace dmn {
+
+// Body of a packet that is sent to multiple receivers, not modified while shared. Each packet
+// in flight holds a reference, so completion of a send is just an atomic decrement.
+class shared_body_t {
+    DMN_PINNED(shared_body_t);
+
+    mutable std::atomic<std::size_t>    refs_{0};
+    packet_network_t                    packet_;    // Moved out only by the last reference holder
+
+    friend struct shared_packet_t;
+
+public:
+    explicit shared_body_t(packet_network_t p) noexcept
+        : packet_(std::move(p))
+    {}
+
+    boost::asio::const_buffer body_const_buffer() const noexcept {
+        return *packet_.body_const_buffer().begin();
+    }
+
+    static void* operator new(std::size_t size) {
+        return buffer_pool_allocate(size);
+    }
+
+    static void operator delete(void* p) noexcept {
+        buffer_pool_deallocate(p);
+    }
+
+    friend void intrusive_ptr_add_ref(const shared_body_t* p) noexcept {
+        p->refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    friend void intrusive_ptr_release(const shared_body_t* p) noexcept {
+        if (p->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete p;
+        }
+    }
+};
+
+using shared_body_ptr_t = boost::intrusive_ptr<const shared_body_t>;
+
+struct shared_packet_t {
+    packet_header_t     header;
+    shared_body_ptr_t   body;   // Empty for packets without body
+
+    boost::asio::const_buffer body_const_buffer() const noexcept {
+        return body ? body->body_const_buffer() : boost::asio::const_buffer{};
+    }
+
+    // Packet for a receiver that owns and modifies it. The last holder of the body takes
+    // its storage, others get a copy.
+    packet_network_t to_packet_network() && {
+        if (!body) {
+            packet_t res;
+            res.place_header();
+            res.header() = header;
+            return packet_network_t{std::move(res)};
+        }
+
+        packet_network_t res = (body->refs_.load(std::memory_order_acquire) == 1
+            ? std::move(const_cast<shared_body_t&>(*body).packet_)
+            : body->packet_.clone()
+        );
+        body.reset();
+        res.set_edge_id(header.edge_id);
+        return res;
+    }
+};
+
+inline shared_body_ptr_t make_shared_body(packet_network_t p) {
+    BOOST_ASSERT_MSG(!p.empty(), "Attempt to share an empty packet (even without header!)");
+    if (p.expected_body_size() == 0) {
+        return {}; // Do nothing
+    }
+
+    return shared_body_ptr_t{new shared_body_t{std::move(p)}};
+}
+
+} // namespace dmn
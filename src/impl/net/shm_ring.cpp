@@ -0,0 +1,194 @@
+#include "impl/net/shm_ring.hpp"
+
+#include <boost/assert.hpp>
+#include <boost/system/system_error.hpp>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace dmn {
+
+struct shm_ring_t::header_t {
+    // Positions grow monotonically, position in data is `pos & (capacity - 1)`
+    alignas(hardware_destructive_interference_size) std::atomic<std::uint64_t> head;
+    alignas(hardware_destructive_interference_size) std::atomic<std::uint64_t> tail;
+
+    alignas(hardware_destructive_interference_size) std::atomic<std::uint32_t> reader_waiting;
+    alignas(hardware_destructive_interference_size) std::atomic<std::uint32_t> writer_waiting;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Ring positions are shared between processes and must be lock free");
+
+namespace {
+
+[[noreturn]] void throw_errno(const char* what) {
+    throw boost::system::system_error(errno, boost::system::system_category(), what);
+}
+
+constexpr std::size_t data_offset = 4 * hardware_destructive_interference_size;
+
+} // anonymous namespace
+
+shm_ring_t::shm_ring_t(int fd, std::size_t capacity, bool init)
+    : capacity_{capacity}
+    , fd_{fd}
+{
+    static_assert(sizeof(header_t) <= data_offset, "Ring header does not fit into the reserved space");
+    BOOST_ASSERT_MSG(capacity && !(capacity & (capacity - 1)), "Ring capacity must be a power of 2");
+
+    void* p = ::mmap(nullptr, data_offset + capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        const int err = errno;
+        ::close(fd);
+        fd_ = -1;
+        errno = err;
+        throw_errno("Failed to map shared memory ring");
+    }
+
+    data_ = as_bytes_ptr(p) + data_offset;
+    header_ = init ? new (p) header_t{} : static_cast<header_t*>(p);
+}
+
+shm_ring_t::shm_ring_t(shm_ring_t&& r) noexcept
+    : header_{r.header_}
+    , data_{r.data_}
+    , capacity_{r.capacity_}
+    , fd_{r.fd_}
+{
+    r.header_ = nullptr;
+    r.data_ = nullptr;
+    r.capacity_ = 0;
+    r.fd_ = -1;
+}
+
+shm_ring_t& shm_ring_t::operator=(shm_ring_t&& r) noexcept {
+    if (this != &r) {
+        reset();
+        std::swap(header_, r.header_);
+        std::swap(data_, r.data_);
+        std::swap(capacity_, r.capacity_);
+        std::swap(fd_, r.fd_);
+    }
+    return *this;
+}
+
+shm_ring_t::~shm_ring_t() {
+    reset();
+}
+
+void shm_ring_t::reset() noexcept {
+    if (header_) {
+        ::munmap(header_, data_offset + capacity_);
+        header_ = nullptr;
+        data_ = nullptr;
+        capacity_ = 0;
+    }
+
+    if (fd_ != -1) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+shm_ring_t shm_ring_t::create(std::size_t capacity) {
+    const int fd = static_cast<int>(::syscall(SYS_memfd_create, "dmn_ring", 0));
+    if (fd == -1) {
+        throw_errno("Failed to create memfd for a shared memory ring");
+    }
+
+    if (::ftruncate(fd, static_cast<off_t>(data_offset + capacity)) == -1) {
+        const int err = errno;
+        ::close(fd);
+        errno = err;
+        throw_errno("Failed to resize shared memory ring");
+    }
+
+    return shm_ring_t{fd, capacity, true};
+}
+
+shm_ring_t shm_ring_t::attach(int fd) {
+    struct stat st;
+    if (::fstat(fd, &st) == -1) {
+        const int err = errno;
+        ::close(fd);
+        errno = err;
+        throw_errno("Failed to get shared memory ring size");
+    }
+
+    const auto size = static_cast<std::size_t>(st.st_size);
+    if (size <= data_offset) {
+        ::close(fd);
+        throw boost::system::system_error(EINVAL, boost::system::system_category(), "Shared memory ring is too small");
+    }
+
+    return shm_ring_t{fd, size - data_offset, false};
+}
+
+std::size_t shm_ring_t::write_some(boost::asio::const_buffer data) noexcept {
+    const std::uint64_t head = header_->head.load(std::memory_order_relaxed);
+    const std::uint64_t tail = header_->tail.load(std::memory_order_acquire);
+
+    const std::size_t size = (std::min)(data.size(), capacity_ - static_cast<std::size_t>(head - tail));
+    const std::size_t pos = static_cast<std::size_t>(head & (capacity_ - 1));
+    const std::size_t first = (std::min)(size, capacity_ - pos);
+
+    if (size) {
+        const auto* src = as_bytes_ptr(data.data());
+        std::memcpy(data_ + pos, src, first);
+        std::memcpy(data_, src + first, size - first);
+    }
+
+    header_->head.store(head + size, std::memory_order_release);
+    return size;
+}
+
+std::size_t shm_ring_t::read_some(boost::asio::mutable_buffer data) noexcept {
+    const std::uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+    const std::uint64_t head = header_->head.load(std::memory_order_acquire);
+
+    const std::size_t size = (std::min)(data.size(), static_cast<std::size_t>(head - tail));
+    const std::size_t pos = static_cast<std::size_t>(tail & (capacity_ - 1));
+    const std::size_t first = (std::min)(size, capacity_ - pos);
+
+    if (size) {
+        auto* dst = as_bytes_ptr(data.data());
+        std::memcpy(dst, data_ + pos, first);
+        std::memcpy(dst + first, data_, size - first);
+    }
+
+    header_->tail.store(tail + size, std::memory_order_release);
+    return size;
+}
+
+bool shm_ring_t::empty() const noexcept {
+    return header_->head.load(std::memory_order_acquire) == header_->tail.load(std::memory_order_relaxed);
+}
+
+// Flags are set and checked with sequential consistency: either the sleeping
+// side sees new positions on recheck, or the other side sees the flag.
+void shm_ring_t::mark_reader_waiting() noexcept {
+    header_->reader_waiting.store(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void shm_ring_t::mark_writer_waiting() noexcept {
+    header_->writer_waiting.store(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+bool shm_ring_t::exchange_reader_waiting() noexcept {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return header_->reader_waiting.load(std::memory_order_relaxed)
+        && header_->reader_waiting.exchange(0, std::memory_order_seq_cst);
+}
+
+bool shm_ring_t::exchange_writer_waiting() noexcept {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return header_->writer_waiting.load(std::memory_order_relaxed)
+        && header_->writer_waiting.exchange(0, std::memory_order_seq_cst);
+}
+
+} // namespace dmn
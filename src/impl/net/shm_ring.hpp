@@ -0,0 +1,67 @@
+#pragma once
+
+#include "utility.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <boost/asio/buffer.hpp>
+
+namespace dmn {
+
+// Single producer single consumer byte ring in a memory mapped memfd. Writer
+// creates the ring and passes its descriptor to the reader process, after that
+// bytes are exchanged without syscalls. Wake ups are up to the user: reader and
+// writer raise *_waiting flags before sleeping and the other side must wake
+// them up if exchange_*_waiting() returned true.
+class shm_ring_t {
+    struct header_t;
+
+    header_t*   header_ = nullptr;
+    bytes_ptr_t data_ = nullptr;
+    std::size_t capacity_ = 0;
+    int         fd_ = -1;
+
+    shm_ring_t(int fd, std::size_t capacity, bool init);
+
+public:
+    static constexpr std::size_t default_capacity = 4 * 1024 * 1024;
+
+    shm_ring_t() noexcept = default;
+    shm_ring_t(shm_ring_t&& r) noexcept;
+    shm_ring_t& operator=(shm_ring_t&& r) noexcept;
+    ~shm_ring_t();
+
+    // Throws boost::system::system_error on failure
+    static shm_ring_t create(std::size_t capacity = default_capacity);
+
+    // Takes ownership of the descriptor
+    static shm_ring_t attach(int fd);
+
+    explicit operator bool() const noexcept {
+        return !!header_;
+    }
+
+    int native_handle() const noexcept {
+        return fd_;
+    }
+
+    // Writer side. Returns count of bytes copied into the ring.
+    std::size_t write_some(boost::asio::const_buffer data) noexcept;
+
+    // Reader side. Returns count of bytes copied from the ring.
+    std::size_t read_some(boost::asio::mutable_buffer data) noexcept;
+
+    void mark_reader_waiting() noexcept;
+    void mark_writer_waiting() noexcept;
+
+    // Returns true if the peer was waiting and must be woken up
+    bool exchange_reader_waiting() noexcept;
+    bool exchange_writer_waiting() noexcept;
+
+    // Reader side. True if there's nothing to read.
+    bool empty() const noexcept;
+
+    void reset() noexcept;
+};
+
+} // namespace dmn
@@ -55,6 +55,11 @@ public:
 
 private:
     void* allocate_multiple(const std::size_t blocks_required, std::size_t size) {
+        if (BOOST_UNLIKELY(blocks_required > SlabsCount)) {
+            BOOST_ASSERT_MSG(false, "Slab allocator slabs are too small for the requested size");
+            return ::operator new(size);
+        }
+
         // Complexity in worst case: O(storages_count_)
         for (std::size_t i = 0; i <= SlabsCount - blocks_required; ++i) {
             if (!!in_use_[i]) {
@@ -97,5 +102,8 @@ private:
 
 using slab_allocator_t = slab_allocator_basic_t<64u, 4u>;
 
+// Vectored writes keep up to 16 buffers inside the asio operation
+using write_slab_allocator_t = slab_allocator_basic_t<64u, 12u>;
+
 } // namespace dmn
 
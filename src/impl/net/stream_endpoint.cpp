@@ -0,0 +1,53 @@
+#include "impl/net/stream_endpoint.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+
+#include <sys/socket.h>
+
+namespace dmn {
+
+bool is_unix_host(const std::string& host) noexcept {
+    return host.compare(0, sizeof(unix_host_prefix) - 1, unix_host_prefix) == 0;
+}
+
+bool is_shm_host(const std::string& host) noexcept {
+    return host.compare(0, sizeof(shm_host_prefix) - 1, shm_host_prefix) == 0;
+}
+
+stream_endpoint_t make_stream_endpoint(const std::string& host, unsigned short port) {
+    if (is_unix_host(host)) {
+        return boost::asio::local::stream_protocol::endpoint{host.substr(sizeof(unix_host_prefix) - 1)};
+    }
+
+    if (is_shm_host(host)) {
+        return boost::asio::local::stream_protocol::endpoint{host.substr(sizeof(shm_host_prefix) - 1)};
+    }
+
+    return boost::asio::ip::tcp::endpoint{boost::asio::ip::address::from_string(host), port};
+}
+
+link_endpoint_t make_link_endpoint(const std::string& host, unsigned short port) {
+    if (is_unix_host(host) || is_shm_host(host)) {
+        return {make_stream_endpoint(host, port), is_shm_host(host)};
+    }
+
+    const auto address = boost::asio::ip::address::from_string(host);
+    if (!address.is_loopback()) {
+        return stream_endpoint_t{boost::asio::ip::tcp::endpoint{address, port}};
+    }
+
+    // Leading zero makes the socket abstract: no file is created and nothing to clean up on crash.
+    std::string name{'\0'};
+    name += "dmn:";
+    name += host;
+    name += ':';
+    name += std::to_string(port);
+    return stream_endpoint_t{boost::asio::local::stream_protocol::endpoint{name}};
+}
+
+bool is_unix_endpoint(const stream_endpoint_t& ep) noexcept {
+    return ep.protocol().family() == AF_UNIX;
+}
+
+} // namespace dmn
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <boost/asio/generic/stream_protocol.hpp>
+#include <string>
+
+namespace dmn {
+
+// Endpoint that holds either TCP or AF_UNIX address. Sockets and acceptors of
+// the links are protocol agnostic and work with any of those.
+using stream_endpoint_t = boost::asio::generic::stream_protocol::endpoint;
+using stream_socket_t = boost::asio::generic::stream_protocol::socket;
+
+// Prefix of the hosts that must be reached via AF_UNIX socket: "unix:/run/dmn/b.sock"
+constexpr char unix_host_prefix[] = "unix:";
+
+// Prefix of the hosts that must be reached via shared memory ring. AF_UNIX
+// socket at the path is used for connection establishment and wake ups: "shm:/run/dmn/b.sock"
+constexpr char shm_host_prefix[] = "shm:";
+
+bool is_unix_host(const std::string& host) noexcept;
+bool is_shm_host(const std::string& host) noexcept;
+
+// Address of the remote side of a link
+struct link_endpoint_t {
+    stream_endpoint_t address;
+    bool shared_memory = false;
+
+    link_endpoint_t(stream_endpoint_t a, bool shm = false)
+        : address(std::move(a))
+        , shared_memory(shm)
+    {}
+};
+
+// "unix:/path" and "shm:/path" hosts become AF_UNIX endpoints, all the other hosts are TCP addresses.
+stream_endpoint_t make_stream_endpoint(const std::string& host, unsigned short port);
+
+// Same as make_stream_endpoint, but loopback TCP hosts are turned into abstract
+// AF_UNIX endpoints that are unique for each host:port pair. Used for links
+// between nodes, so co-located vertices bypass the TCP stack.
+link_endpoint_t make_link_endpoint(const std::string& host, unsigned short port);
+
+bool is_unix_endpoint(const stream_endpoint_t& ep) noexcept;
+
+} // namespace dmn
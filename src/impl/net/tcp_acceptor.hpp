@@ -2,12 +2,17 @@
 
 #include "utility.hpp"
 #include "impl/saturation_timer.hpp"
+#include "impl/net/stream_endpoint.hpp"
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/make_unique.hpp>
 #include <boost/optional/optional.hpp>
 #include <thread>
 
+#include <sys/un.h>
+#include <unistd.h>
+
 namespace dmn {
 
 class tcp_acceptor {
@@ -15,8 +20,8 @@ class tcp_acceptor {
 
 private:
     struct internals {
-        boost::asio::ip::tcp::acceptor  acceptor_;
-        boost::asio::ip::tcp::socket    new_socket_;
+        boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol> acceptor_;
+        stream_socket_t                 new_socket_;
 
         explicit internals(boost::asio::io_context& ios)
             : acceptor_{ios}
@@ -25,7 +30,7 @@ private:
     };
 
     boost::optional<internals>  data_;
-    const boost::asio::ip::tcp::endpoint endpoint_;
+    const stream_endpoint_t endpoint_;
     saturation_timer_t instability_;
 
     void try_open() {
@@ -39,7 +44,11 @@ private:
             return;
         }
 
-        data_->acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+        if (is_unix_endpoint(endpoint_)) {
+            remove_stale_socket_file();
+        } else {
+            data_->acceptor_.set_option(boost::asio::socket_base::reuse_address(true));
+        }
         data_->acceptor_.bind(endpoint_, er);
         if (er) {
             data_->acceptor_.close();
@@ -48,18 +57,30 @@ private:
         data_->acceptor_.listen();
     }
 
+    // Socket file of a crashed process prevents bind(). Abstract sockets have no files.
+    void remove_stale_socket_file() const noexcept {
+        const auto* addr = reinterpret_cast<const sockaddr_un*>(endpoint_.data());
+        if (addr->sun_path[0] != '\0') {
+            ::unlink(addr->sun_path);
+        }
+    }
+
 public:
-    tcp_acceptor(boost::asio::io_context& ios, const char* host, unsigned short port)
+    tcp_acceptor(boost::asio::io_context& ios, const stream_endpoint_t& endpoint)
         : data_{ios}
-        , endpoint_{boost::asio::ip::address::from_string(host), port}
+        , endpoint_{endpoint}
     {
         try_open();
     }
+
+    tcp_acceptor(boost::asio::io_context& ios, const char* host, unsigned short port)
+        : tcp_acceptor(ios, make_stream_endpoint(host, port))
+    {}
     ~tcp_acceptor() {
         BOOST_ASSERT_MSG(!data_, "Acceptor must be closed before destruction!");
     }
 
-    boost::asio::ip::tcp::socket&& extract_socket() noexcept {
+    stream_socket_t&& extract_socket() noexcept {
         BOOST_ASSERT_MSG(data_, "Acceptor is not initialized!");
         BOOST_ASSERT_MSG(data_->acceptor_.is_open(), "Acceptor is not opened!");
         return std::move(data_->new_socket_);
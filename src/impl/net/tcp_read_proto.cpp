@@ -6,14 +6,30 @@
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/read.hpp>
 #include <boost/asio/bind_executor.hpp>
+#include <boost/asio/post.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <sys/socket.h>
+
+#if DMN_IO_URING
+#include <linux/io_uring.h>
+#endif
 
 namespace dmn {
 
-tcp_read_proto_t::tcp_read_proto_t(boost::asio::ip::tcp::socket socket, on_error_t on_error, on_operation_finished_t on_operation_finished)
+tcp_read_proto_t::tcp_read_proto_t(stream_socket_t socket, on_error_t on_error, on_operation_finished_t on_operation_finished)
     : socket_(std::move(socket))
     , on_error_(std::move(on_error))
     , on_operation_finished_(std::move(on_operation_finished))
+    , credits_(std::make_shared<credits_t>())
 {
+    credits_->socket = &*socket_;
+
+    boost::system::error_code ec;
+    handshake_done_ = !is_unix_endpoint(socket_->local_endpoint(ec));
     set_socket_options(*socket_);
     //set_socket_read_buffer(*socket_);
 }
@@ -23,7 +39,300 @@ tcp_read_proto_t::~tcp_read_proto_t()  {
 }
 
 
+template <class F>
+void tcp_read_proto_t::async_handshake(F f) {
+    auto on_ready = [this, f = std::move(f)](const boost::system::error_code& e) mutable {
+        if (e) {
+            process_error(e);
+            return;
+        }
+
+        boost::system::error_code ec;
+        if (!receive_handshake(ec)) {
+            if (ec) {
+                process_error(ec);
+            } else {
+                async_handshake(std::move(f));
+            }
+            return;
+        }
+
+        handshake_done_ = true;
+        f();
+    };
+
+    socket_->async_wait(
+        boost::asio::socket_base::wait_read,
+        make_slab_alloc_handler(slab_, std::move(on_ready))
+    );
+}
+
+bool tcp_read_proto_t::receive_handshake(boost::system::error_code& ec) noexcept {
+    char marker;
+    iovec iov{&marker, 1};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    const auto res = ::recvmsg(socket_->native_handle(), &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (res == 0) {
+        ec = boost::asio::error::eof;
+        return false;
+    } else if (res < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            ec.assign(errno, boost::system::system_category());
+        }
+        return false;
+    }
+
+    const cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        int fd;
+        std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+        try {
+            ring_ = shm_ring_t::attach(fd);
+        } catch (const boost::system::system_error& e) {
+            ec = e.code();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void tcp_read_proto_t::async_ring_read(boost::asio::mutable_buffer data, bool exact) {
+    // Never completing the operation inside the call, as the callback may start a new read
+    auto on_post = [this, data, exact]() {
+        if (!socket_ || !ring_) {
+            process_error(boost::asio::error::operation_aborted);
+            return;
+        }
+        ring_read(data, 0, exact);
+    };
+
+    boost::asio::post(
+        socket_->get_executor(),
+        make_slab_alloc_handler(slab_, std::move(on_post))
+    );
+}
+
+// Reads from the ring and sleeps on the socket if ring is empty
+void tcp_read_proto_t::ring_read(boost::asio::mutable_buffer data, std::size_t bytes_read, bool exact) {
+    bool waiting = false;
+    for (;;) {
+        const std::size_t n = ring_.read_some(data + bytes_read);
+        bytes_read += n;
+        if (n && ring_.exchange_writer_waiting()) {
+            send_doorbell(*socket_);
+        }
+
+        if (bytes_read == data.size() || (bytes_read && !exact)) {
+            last_bytes_read_ = bytes_read;
+            on_operation_finished_(*this);
+            return;
+        }
+
+        if (!n && waiting) {
+            break;
+        }
+
+        if (!waiting) {
+            ring_.mark_reader_waiting();
+            waiting = true;
+        }
+    }
+
+    auto on_wake_up = [this, data, bytes_read, exact](const boost::system::error_code& e, std::size_t /*bytes_read*/) {
+        // Writer may write and close the link right away. Reading the rest before reporting the error.
+        if (e && (!ring_ || ring_.empty())) {
+            process_error(e);
+            return;
+        }
+
+        ring_read(data, bytes_read, exact);
+    };
+
+    socket_->async_read_some(
+        boost::asio::buffer(doorbell_),
+        make_slab_alloc_handler(slab_, std::move(on_wake_up))
+    );
+}
+
+#if DMN_IO_URING
+
+struct tcp_read_proto_t::uring_recv_op: uring_op_t {
+    tcp_read_proto_t&           this_;
+    uring_service_t&            service_;
+    const int                   fd_;
+
+    std::mutex                  mutex_;
+    std::vector<unsigned char>  received_;     // Data that arrived while no read was pending
+    std::size_t                 received_offset_ = 0;
+    boost::system::error_code   error_;
+
+    bool                        read_pending_ = false;
+    boost::asio::mutable_buffer data_;
+    std::size_t                 bytes_read_ = 0;
+    bool                        exact_ = false;
+
+    uring_recv_op(tcp_read_proto_t& proto, uring_service_t& service, int fd)
+        : uring_op_t(&on_complete, &on_destroy)
+        , this_(proto)
+        , service_(service)
+        , fd_(fd)
+    {}
+
+    void arm() {
+        service_.submit_multishot_recv(fd_, *this);
+    }
+
+    std::size_t copy_to_read(const unsigned char* p, std::size_t size) noexcept {
+        const std::size_t n = (std::min)(size, data_.size() - bytes_read_);
+        if (n) {
+            std::memcpy(as_bytes_ptr(data_.data()) + bytes_read_, p, n);
+            bytes_read_ += n;
+        }
+        return n;
+    }
+
+    void copy_received_to_read() noexcept {
+        received_offset_ += copy_to_read(received_.data() + received_offset_, received_.size() - received_offset_);
+        if (received_offset_ == received_.size()) {
+            received_.clear();
+            received_offset_ = 0;
+        }
+    }
+
+    // Completes the pending read if it has enough data or if there'll be no more data
+    void try_finish(std::unique_lock<std::mutex>& lock) {
+        if (!read_pending_) {
+            return;
+        }
+
+        if (bytes_read_ == data_.size() || (bytes_read_ && !exact_)) {
+            read_pending_ = false;
+            const std::size_t bytes_read = bytes_read_;
+            lock.unlock();
+
+            this_.last_bytes_read_ = bytes_read;
+            this_.on_operation_finished_(this_);
+        } else if (error_ && received_.empty()) {
+            read_pending_ = false;
+            const auto e = error_;
+            lock.unlock();
+
+            this_.process_error(e);
+        }
+    }
+
+    static void on_complete(uring_op_t& op, int res, unsigned flags) {
+        auto& self = static_cast<uring_recv_op&>(op);
+        std::unique_lock<std::mutex> lock{self.mutex_};
+        if (res > 0) {
+            const unsigned buffer_id = flags >> IORING_CQE_BUFFER_SHIFT;
+            const unsigned char* p = self.service_.recv_buffer(buffer_id);
+            const std::size_t size = static_cast<std::size_t>(res);
+
+            // Buffers are shared by all the links of the io_context, so they are returned right away
+            std::size_t copied = 0;
+            if (self.read_pending_ && self.received_.empty()) {
+                copied = self.copy_to_read(p, size);
+            }
+            self.received_.insert(self.received_.end(), p + copied, p + size);
+            self.service_.recycle_recv_buffer(buffer_id);
+        } else if (res == 0) {
+            self.error_ = boost::asio::error::eof;
+        } else if (res == -ECANCELED) {
+            self.error_ = boost::asio::error::operation_aborted;
+        } else if (res != -ENOBUFS) {
+            self.error_.assign(-res, boost::system::system_category());
+        }
+
+        // Kernel stops the multishot receive on errors and when it runs out of buffers
+        if (!(flags & IORING_CQE_F_MORE) && !self.error_) {
+            self.arm();
+        }
+
+        self.try_finish(lock);
+    }
+
+    static void on_destroy(uring_op_t& op) noexcept {
+        delete &static_cast<uring_recv_op&>(op);
+    }
+};
+
+bool tcp_read_proto_t::start_uring() {
+    if (uring_checked_) {
+        return !!uring_recv_;
+    }
+
+    uring_checked_ = true;
+    if (ring_) {
+        return false;
+    }
+
+    uring_service_t* service = find_uring_service(*socket_);
+    if (!service) {
+        return false;
+    }
+
+    uring_recv_ = new uring_recv_op{*this, *service, socket_->native_handle()};
+    uring_recv_->arm();
+    return true;
+}
+
+void tcp_read_proto_t::uring_read(boost::asio::mutable_buffer data, bool exact) {
+    {
+        std::lock_guard<std::mutex> lock{uring_recv_->mutex_};
+        BOOST_ASSERT_MSG(!uring_recv_->read_pending_, "Multiple reads at the same time");
+        uring_recv_->read_pending_ = true;
+        uring_recv_->data_ = data;
+        uring_recv_->bytes_read_ = 0;
+        uring_recv_->exact_ = exact;
+    }
+
+    // Never completing the operation inside the call, as the callback may start a new read
+    boost::asio::post(
+        socket_->get_executor(),
+        make_slab_alloc_handler(slab_, [this]() { uring_drain(); })
+    );
+}
+
+void tcp_read_proto_t::uring_drain() {
+    if (!uring_recv_) {
+        process_error(boost::asio::error::operation_aborted);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock{uring_recv_->mutex_};
+    uring_recv_->copy_received_to_read();
+    uring_recv_->try_finish(lock);
+}
+
+#endif // DMN_IO_URING
+
 void tcp_read_proto_t::async_read(boost::asio::mutable_buffers_1 data) {
+    if (!handshake_done_) {
+        async_handshake([this, data]() { async_read(data); });
+        return;
+    }
+
+    if (ring_) {
+        async_ring_read(*data.begin(), true);
+        return;
+    }
+
+#if DMN_IO_URING
+    if (start_uring()) {
+        uring_read(*data.begin(), true);
+        return;
+    }
+#endif
+
     // shutdown_gracefully could happen between on_operation_finished_ and async_read.
     // Allow ASIO deal with that, instead of calling 'BOOST_ASSERT(socket_->is_open());' here.
 
@@ -34,6 +343,7 @@ void tcp_read_proto_t::async_read(boost::asio::mutable_buffers_1 data) {
         }
 
         BOOST_ASSERT_MSG(bytes_read == boost::asio::buffer_size(data), "Wrong bytes read");
+        last_bytes_read_ = bytes_read;
         on_operation_finished_(*this);
     };
 
@@ -44,11 +354,108 @@ void tcp_read_proto_t::async_read(boost::asio::mutable_buffers_1 data) {
     );
 }
 
+void tcp_read_proto_t::async_read_some(boost::asio::mutable_buffers_1 data) {
+    if (!handshake_done_) {
+        async_handshake([this, data]() { async_read_some(data); });
+        return;
+    }
+
+    if (ring_) {
+        async_ring_read(*data.begin(), false);
+        return;
+    }
+
+#if DMN_IO_URING
+    if (start_uring()) {
+        uring_read(*data.begin(), false);
+        return;
+    }
+#endif
+
+    auto on_read = [this](const boost::system::error_code& e, std::size_t bytes_read) {
+        if (e) {
+            process_error(e);
+            return;
+        }
+
+        last_bytes_read_ = bytes_read;
+        on_operation_finished_(*this);
+    };
+
+    socket_->async_read_some(
+        data,
+        make_slab_alloc_handler(slab_, std::move(on_read))
+    );
+}
+
+void tcp_read_proto_t::packets_consumed(std::size_t packets) noexcept {
+    std::lock_guard<std::mutex> lock{credits_->mutex};
+    credits_->ungranted += static_cast<std::uint32_t>(packets);
+}
+
+void tcp_read_proto_t::grant_credits(bool force) noexcept {
+    std::lock_guard<std::mutex> lock{credits_->mutex};
+    auto& c = *credits_;
+    if (!c.socket || ring_ || !c.ungranted || (!force && c.ungranted < credits_grant_threshold)) {
+        return;
+    }
+
+    const credit_packet_t credit = make_credit_packet(c.ungranted);
+    c.ungranted = 0;
+    const auto* data = reinterpret_cast<const unsigned char*>(&credit);
+    c.out.insert(c.out.end(), data, data + sizeof(credit));
+
+    flush_credits(credits_);
+}
+
+// Must be called under the credits mutex
+void tcp_read_proto_t::flush_credits(const std::shared_ptr<credits_t>& credits) {
+    auto& c = *credits;
+    if (c.flushing) {
+        return; // Handler of the wait sends everything
+    }
+
+    // Writer constantly reads the control packets, so the socket buffer in this direction is almost always empty
+    const auto sent = ::send(c.socket->native_handle(), c.out.data(), c.out.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent > 0) {
+        c.out.erase(c.out.begin(), c.out.begin() + sent);
+    } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        c.out.clear();  // Link is broken, reads will notice that
+        return;
+    }
+
+    if (c.out.empty()) {
+        return;
+    }
+
+    // Writer may be out of credits and waiting exactly for these packets, so the rest can not wait for the next grant
+    c.flushing = true;
+    c.socket->async_wait(stream_socket_t::wait_write, [credits](const boost::system::error_code& e) {
+        std::lock_guard<std::mutex> lock{credits->mutex};
+        credits->flushing = false;
+        if (e || !credits->socket) {
+            return; // Link is broken or closed
+        }
+
+        flush_credits(credits);
+    });
+}
+
 void tcp_read_proto_t::close() noexcept {
+    std::lock_guard<std::mutex> lock{credits_->mutex};
+    credits_->socket = nullptr;
+#if DMN_IO_URING
+    if (uring_recv_) {
+        uring_recv_->service_.orphan_op(*uring_recv_);
+        uring_recv_ = nullptr;
+    }
+#endif
+
     boost::system::error_code ignore;
     socket_->shutdown(boost::asio::socket_base::shutdown_both, ignore);
     socket_->close(ignore);
     socket_.reset();
+    ring_.reset();
 }
 
 } // namespace dmn
@@ -1,18 +1,27 @@
 #pragma once
 
+#include "impl/net/credits.hpp"
 #include "impl/net/slab_allocator.hpp"
+#include "impl/net/shm_ring.hpp"
+#include "impl/net/stream_endpoint.hpp"
+#include "impl/net/uring_service.hpp"
 
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/optional/optional.hpp>
 
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 namespace dmn {
 
 class tcp_read_proto_t {
     DMN_PINNED(tcp_read_proto_t);
 
 private:
-    boost::optional<boost::asio::ip::tcp::socket> socket_;
+    boost::optional<stream_socket_t> socket_;
     using on_error_t = std::function<void(tcp_read_proto_t&, const boost::system::error_code&)>;
     const on_error_t on_error_;
 
@@ -20,19 +29,72 @@ private:
     const on_operation_finished_t on_operation_finished_;
 
     std::size_t                    helper_id_ = std::numeric_limits<std::size_t>::max();
+    std::size_t                    last_bytes_read_ = 0;
 
     slab_allocator_t slab_;
 
+    // AF_UNIX links start with a handshake that may bring a shared memory ring.
+    // Socket of a ring link is used only for wake ups.
+    bool                    handshake_done_;
+    shm_ring_t              ring_;
+    std::array<char, 16>    doorbell_;
+
+    template <class F>
+    void async_handshake(F f);
+    bool receive_handshake(boost::system::error_code& ec) noexcept;
+
+    void async_ring_read(boost::asio::mutable_buffer data, bool exact);
+    void ring_read(boost::asio::mutable_buffer data, std::size_t bytes_read, bool exact);
+
+#if DMN_IO_URING
+    // Data is received by a multishot recv into the registered buffers, if that backend was selected
+    struct uring_recv_op;
+    uring_recv_op*          uring_recv_ = nullptr;
+    bool                    uring_checked_ = false;
+
+    bool start_uring();
+    void uring_read(boost::asio::mutable_buffer data, bool exact);
+    void uring_drain();
+#endif
+
+    // Credits for the consumed packets that were not yet returned to the writer. Shared with the handlers
+    // that wait for the socket to accept the rest of the CREDIT packets, those may outlive the link.
+    struct credits_t {
+        std::mutex                  mutex;
+        stream_socket_t*            socket = nullptr;   // nullptr after close()
+        std::uint32_t               ungranted = 0;
+        std::vector<unsigned char>  out;                // CREDIT packets not yet accepted by the socket
+        bool                        flushing = false;   // Waiting for the socket to become writable
+    };
+    const std::shared_ptr<credits_t> credits_;
+
+    static void flush_credits(const std::shared_ptr<credits_t>& credits);
+
     void process_error(const boost::system::error_code& e) {
         on_error_(*this, e);
     }
 
 protected:
-    tcp_read_proto_t(boost::asio::ip::tcp::socket socket, on_error_t on_error, on_operation_finished_t on_operation_finished);
+    tcp_read_proto_t(stream_socket_t socket, on_error_t on_error, on_operation_finished_t on_operation_finished);
     ~tcp_read_proto_t();
 
 public:
     void async_read(boost::asio::mutable_buffers_1 data);
+
+    // Reads at least one byte. Count of bytes read is available via last_bytes_read()
+    void async_read_some(boost::asio::mutable_buffers_1 data);
+
+    std::size_t last_bytes_read() const noexcept {
+        return last_bytes_read_;
+    }
+
+    // Thread safe. Accounts packets that were processed by the node.
+    void packets_consumed(std::size_t packets) noexcept;
+
+    // Thread safe. Returns credits for the consumed packets to the writer. If `force` is false, then
+    // credits are returned only if enough of them were accumulated.
+    void grant_credits(bool force) noexcept;
+
     void close() noexcept;
 
     void set_helper_id(std::size_t id) noexcept {
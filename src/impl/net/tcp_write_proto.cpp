@@ -4,9 +4,16 @@
 #include "impl/net/wrap_handler.hpp"
 
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/asio/write.hpp>
 #include <boost/make_unique.hpp>
 
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <vector>
+#include <sys/socket.h>
+
 namespace dmn {
 
 #define ASSERT_GUARD(g) \
@@ -14,10 +21,21 @@ namespace dmn {
     BOOST_ASSERT_MSG(g.mutex() == this, "Sending with foreign netlink guard");  \
     /**/
 
+struct tcp_write_proto_t::control_reader_t {
+    std::mutex              mutex;
+    tcp_write_proto_t*      proto;              // nullptr after close()
+    std::uint64_t           generation = 0;     // Of the socket that is read now
+    std::array<unsigned char, 16 * sizeof(credit_packet_t)> buf;
+    std::size_t             filled = 0;
+
+    explicit control_reader_t(tcp_write_proto_t& p) noexcept
+        : proto(&p)
+    {}
+};
+
 
 tcp_write_proto_t::tcp_write_proto_t(
-    const char* addr,
-    unsigned short port,
+    const link_endpoint_t& remote_ep,
     boost::asio::io_service& ios,
     on_send_error_t on_send_error,
     on_operation_finished_t on_operation_finished,
@@ -28,8 +46,28 @@ tcp_write_proto_t::tcp_write_proto_t(
     , on_send_error_(std::move(on_send_error))
     , on_reconnect_error_(std::move(on_reconnect_error))
     , on_operation_finished_(std::move(on_operation_finished))
-    , remote_ep_{boost::asio::ip::address::from_string(addr), port}
+    , remote_ep_{remote_ep}
     , helper_id_(helper_id)
+    , control_(std::make_shared<control_reader_t>(*this))
+{}
+
+tcp_write_proto_t::tcp_write_proto_t(
+    const char* addr,
+    unsigned short port,
+    boost::asio::io_service& ios,
+    on_send_error_t on_send_error,
+    on_operation_finished_t on_operation_finished,
+    on_reconnect_error_t on_reconnect_error,
+    std::size_t helper_id
+)
+    : tcp_write_proto_t(
+        make_stream_endpoint(addr, port),
+        ios,
+        std::move(on_send_error),
+        std::move(on_operation_finished),
+        std::move(on_reconnect_error),
+        helper_id
+    )
 {}
 
 tcp_write_proto_t::~tcp_write_proto_t() {
@@ -38,9 +76,25 @@ tcp_write_proto_t::~tcp_write_proto_t() {
 
 void tcp_write_proto_t::async_reconnect(tcp_write_proto_t::guard_t g) {
     ASSERT_GUARD(g);
-    auto on_connect = [guard = std::move(g), this](const boost::system::error_code& e) mutable {
-        if (e) {
 
+    // Connection is made on a new socket, so that the pending control read of the previous one is cancelled
+    boost::system::error_code ignore;
+    socket_->close(ignore);
+
+    auto on_connect = [guard = std::move(g), this](boost::system::error_code e) mutable {
+        if (!e && is_unix_endpoint(remote_ep_.address)) {
+            send_handshake(e);
+            if (e) {
+                boost::system::error_code ignore;
+                socket_->close(ignore);
+            }
+        }
+
+        if (e) {
+            connect_failures_.fetch_add(1, std::memory_order_relaxed);
+            if (on_connect_failed_) {
+                on_connect_failed_(guard);
+            }
             ++instability_;
             if (!instability_.is_max()) {
                 auto timer_ptr = boost::make_unique<boost::asio::steady_timer>(socket_->get_io_context());
@@ -61,17 +115,120 @@ void tcp_write_proto_t::async_reconnect(tcp_write_proto_t::guard_t g) {
             return;
         }
 
+        connects_.fetch_add(1, std::memory_order_relaxed);
         dmn::set_socket_options(*socket_);
-        dmn::set_writing_ack_timeout(*socket_);
+        if (!is_unix_endpoint(remote_ep_.address)) {
+            dmn::set_writing_ack_timeout(*socket_);
+        }
+#if DMN_IO_URING
+        start_uring();
+#endif
+        reset_credits();
         on_operation_finished_(std::move(guard));
     };
 
     socket_->async_connect(
-        remote_ep_,
+        remote_ep_.address,
         make_slab_alloc_handler(slab_, std::move(on_connect))
     );
 }
 
+// Each new connection has a new reader on the other side, that expects the initial window to be used
+void tcp_write_proto_t::reset_credits() noexcept {
+    if (remote_ep_.shared_memory) {
+        // Socket is used for the ring wake ups, ring itself limits the data in flight
+        credits_.store(unlimited_credits, std::memory_order_release);
+        return;
+    }
+
+    credits_.store(credits_window, std::memory_order_release);
+
+    std::uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock{control_->mutex};
+        generation = ++control_->generation;
+        control_->filled = 0;
+    }
+    async_read_control(generation);
+}
+
+// Reads CREDIT packets sent by the reader in the opposite direction. Called either by the connect handler
+// or by the read handler of the same generation, under the mutex.
+void tcp_write_proto_t::async_read_control(std::uint64_t generation) {
+    auto on_read = [control = control_, generation](const boost::system::error_code& e, std::size_t bytes_read) {
+        std::lock_guard<std::mutex> lock{control->mutex};
+        if (!control->proto || control->generation != generation) {
+            return; // Link is closed or reconnected, the new socket has its own read
+        }
+
+        if (e) {
+            // Writes will notice the broken link and reconnect
+            return;
+        }
+
+        control->filled += bytes_read;
+        std::int64_t granted = 0;
+        std::size_t offset = 0;
+        for (; control->filled - offset >= sizeof(credit_packet_t); offset += sizeof(credit_packet_t)) {
+            granted += parse_credit_packet(control->buf.data() + offset);
+        }
+        std::memmove(control->buf.data(), control->buf.data() + offset, control->filled - offset);
+        control->filled -= offset;
+
+        auto& proto = *control->proto;
+        if (granted) {
+            proto.credits_.fetch_add(granted, std::memory_order_acq_rel);
+            if (proto.on_credits_) {
+                proto.on_credits_(proto);
+            }
+        }
+
+        proto.async_read_control(generation);
+    };
+
+    socket_->async_read_some(
+        boost::asio::buffer(control_->buf.data() + control_->filled, control_->buf.size() - control_->filled),
+        std::move(on_read)  // Not using slab_, as control reads run concurrently with writes and may outlive the link
+    );
+}
+
+// First byte of each AF_UNIX link. Carries the descriptor of a shared memory ring, if one is used.
+void tcp_write_proto_t::send_handshake(boost::system::error_code& ec) noexcept {
+    ring_.reset();
+    if (remote_ep_.shared_memory) {
+        try {
+            ring_ = shm_ring_t::create();
+        } catch (const boost::system::system_error& e) {
+            ec = e.code();
+            return;
+        }
+    }
+
+    char marker = 0;
+    iovec iov{&marker, 1};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    if (ring_) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        const int fd = ring_.native_handle();
+        std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+    }
+
+    if (::sendmsg(socket_->native_handle(), &msg, MSG_NOSIGNAL) != 1) {
+        ec.assign(errno, boost::system::system_category());
+        ring_.reset();
+    }
+}
+
 struct tcp_write_proto_t::on_write {
     DMN_USE_SLAB(on_write)
 
@@ -86,6 +243,7 @@ struct tcp_write_proto_t::on_write {
     {}
 
     void operator()(const boost::system::error_code e, std::size_t bytes_written) {
+        this_.last_bytes_written_ = bytes_written;
         if (e) {
             ++this_.instability_;
             this_.on_send_error_(e, std::move(guard_), {});
@@ -98,10 +256,231 @@ struct tcp_write_proto_t::on_write {
     }
 };
 
+namespace {
+
+// Copies bytes of the buffer sequence starting from `offset` into the ring. Returns count of copied bytes.
+template <class Buffers>
+std::size_t write_to_ring(shm_ring_t& ring, const Buffers& buffers, std::size_t offset) noexcept {
+    std::size_t copied = 0;
+    for (auto it = boost::asio::buffer_sequence_begin(buffers); it != boost::asio::buffer_sequence_end(buffers); ++it) {
+        boost::asio::const_buffer b = *it;
+        if (offset >= b.size()) {
+            offset -= b.size();
+            continue;
+        }
+
+        b += offset;
+        offset = 0;
+        const std::size_t written = ring.write_some(b);
+        copied += written;
+        if (written != b.size()) {
+            break;
+        }
+    }
+
+    return copied;
+}
+
+} // anonymous namespace
+
+template <class Buffers>
+struct tcp_write_proto_t::on_ring_write {
+    DMN_USE_SLAB(on_ring_write)
+
+    tcp_write_proto_t&          this_;
+    tcp_write_proto_t::guard_t  guard_;
+    Buffers                     buffers_;
+    std::size_t                 buf_size_;
+    std::size_t                 bytes_written_ = 0;
+
+    on_ring_write(tcp_write_proto_t::guard_t guard, Buffers buffers)
+        : this_{*guard.mutex()}
+        , guard_{std::move(guard)}
+        , buffers_{buffers}
+        , buf_size_{boost::asio::buffer_size(buffers)}
+    {}
+
+    // Copies as much as possible into the ring and sleeps on the socket if ring is full
+    void operator()() {
+        if (!this_.socket_ || !this_.ring_) {
+            (*this)(boost::asio::error::operation_aborted, 0);
+            return;
+        }
+
+        bool waiting = false;
+        for (;;) {
+            const std::size_t copied = write_to_ring(this_.ring_, buffers_, bytes_written_);
+            bytes_written_ += copied;
+            if (copied && this_.ring_.exchange_reader_waiting()) {
+                send_doorbell(*this_.socket_);
+            }
+
+            if (bytes_written_ == buf_size_) {
+                this_.last_bytes_written_ = bytes_written_;
+                --this_.instability_;
+                this_.on_operation_finished_(std::move(guard_));
+                return;
+            }
+
+            if (!copied && waiting) {
+                break;
+            }
+
+            if (!waiting) {
+                this_.ring_.mark_writer_waiting();
+                waiting = true;
+            }
+        }
+
+        auto& socket = *this_.socket_;
+        auto& doorbell = this_.doorbell_;
+        socket.async_read_some(boost::asio::buffer(doorbell), std::move(*this));
+    }
+
+    // Reader freed some space in the ring or the link is broken
+    void operator()(const boost::system::error_code e, std::size_t /*bytes_read*/) {
+        if (e) {
+            this_.last_bytes_written_ = bytes_written_;
+            ++this_.instability_;
+            this_.on_send_error_(e, std::move(guard_), {});
+            return;
+        }
+
+        (*this)();
+    }
+};
+
+#if DMN_IO_URING
+
+struct tcp_write_proto_t::uring_send_op: uring_op_t {
+    tcp_write_proto_t&  this_;
+    uring_service_t&    service_;
+    guard_t             guard_;
+    std::vector<iovec>  iov_;
+    std::size_t         iov_first_ = 0;
+    msghdr              msg_{};
+    std::size_t         buf_size_ = 0;
+    std::size_t         bytes_written_ = 0;
+
+    uring_send_op(tcp_write_proto_t& proto, uring_service_t& service)
+        : uring_op_t(&on_complete, &on_destroy)
+        , this_(proto)
+        , service_(service)
+    {}
+
+    template <class Buffers>
+    void start(guard_t g, const Buffers& buffers) {
+        guard_ = std::move(g);
+        iov_.clear();
+        for (auto it = boost::asio::buffer_sequence_begin(buffers); it != boost::asio::buffer_sequence_end(buffers); ++it) {
+            const boost::asio::const_buffer b = *it;
+            if (b.size()) {
+                iov_.push_back(iovec{const_cast<void*>(b.data()), b.size()});
+            }
+        }
+        iov_first_ = 0;
+        buf_size_ = boost::asio::buffer_size(buffers);
+        bytes_written_ = 0;
+
+        submit();
+    }
+
+    void submit() {
+        msg_ = msghdr{};
+        msg_.msg_iov = iov_.data() + iov_first_;
+        msg_.msg_iovlen = (std::min)(iov_.size() - iov_first_, static_cast<std::size_t>(IOV_MAX));
+        service_.submit_sendmsg(this_.socket_->native_handle(), &msg_, *this);
+    }
+
+    void consume(std::size_t bytes) noexcept {
+        while (bytes) {
+            iovec& v = iov_[iov_first_];
+            if (bytes < v.iov_len) {
+                v.iov_base = as_bytes_ptr(v.iov_base) + bytes;
+                v.iov_len -= bytes;
+                return;
+            }
+
+            bytes -= v.iov_len;
+            ++iov_first_;
+        }
+    }
+
+    static void on_complete(uring_op_t& op, int res, unsigned /*flags*/) {
+        auto& self = static_cast<uring_send_op&>(op);
+        auto& proto = self.this_;
+        if (res > 0) {
+            self.bytes_written_ += static_cast<std::size_t>(res);
+            if (self.bytes_written_ < self.buf_size_) {
+                self.consume(static_cast<std::size_t>(res));
+                self.submit();
+                return;
+            }
+        }
+
+        proto.last_bytes_written_ = self.bytes_written_;
+        if (res < 0 || self.bytes_written_ != self.buf_size_) {
+            boost::system::error_code e = boost::asio::error::broken_pipe;
+            if (res == -ECANCELED) {
+                e = boost::asio::error::operation_aborted;
+            } else if (res < 0) {
+                e.assign(-res, boost::system::system_category());
+            }
+
+            ++proto.instability_;
+            proto.on_send_error_(e, std::move(self.guard_), {});
+            return;
+        }
+
+        --proto.instability_;
+        proto.on_operation_finished_(std::move(self.guard_));
+    }
+
+    static void on_destroy(uring_op_t& op) noexcept {
+        delete &static_cast<uring_send_op&>(op);
+    }
+};
+
+void tcp_write_proto_t::start_uring() noexcept {
+    if (uring_send_ || ring_) {
+        return;
+    }
+
+    uring_service_t* service = find_uring_service(*socket_);
+    if (service) {
+        uring_send_ = new uring_send_op{*this, *service};
+    }
+}
+
+template <class Buffers>
+bool tcp_write_proto_t::try_uring_send(guard_t& g, const Buffers& buf) {
+    if (!uring_send_) {
+        return false;
+    }
+
+    // Completion is never called inside the submission, so the callback may start a new send
+    uring_send_->start(std::move(g), buf);
+    return true;
+}
+
+#endif // DMN_IO_URING
+
 void tcp_write_proto_t::async_send(guard_t g, std::array<boost::asio::const_buffer, 2> buf) {
     ASSERT_GUARD(g);
     BOOST_ASSERT(socket_->is_open());
 
+#if DMN_IO_URING
+    if (try_uring_send(g, buf)) {
+        return;
+    }
+#endif
+
+    if (ring_) {
+        // Never completing the operation inside the call, as the callback may start a new send
+        boost::asio::post(socket_->get_executor(), on_ring_write<std::array<boost::asio::const_buffer, 2>>{std::move(g), buf});
+        return;
+    }
+
     /*
 
     auto on_write = [guard = std::move(g), buf, this](const boost::system::error_code& e, std::size_t bytes_written) mutable {
@@ -125,11 +504,49 @@ void tcp_write_proto_t::async_send(guard_t g, std::array<boost::asio::const_buff
     );
 }
 
+void tcp_write_proto_t::async_send(guard_t g, const_buffers_view_t buf) {
+    ASSERT_GUARD(g);
+    BOOST_ASSERT(socket_->is_open());
+
+    if (ring_) {
+        boost::asio::post(socket_->get_executor(), on_ring_write<const_buffers_view_t>{std::move(g), buf});
+        return;
+    }
+
+#if DMN_IO_URING
+    if (try_uring_send(g, buf)) {
+        return;
+    }
+#endif
+
+    boost::asio::async_write(
+        *socket_,
+        buf,
+        on_write{std::move(g), boost::asio::buffer_size(buf)}
+    );
+}
+
 void tcp_write_proto_t::close() noexcept {
+#if DMN_IO_URING
+    if (uring_send_) {
+        // Operation in flight owns the guard of this link, that is going to be destroyed
+        uring_send_->guard_.release();
+        uring_send_->service_.orphan_op(*uring_send_);
+        uring_send_ = nullptr;
+    }
+#endif
+
+    {
+        // Control read handlers that run after this point do not touch the link
+        std::lock_guard<std::mutex> lock{control_->mutex};
+        control_->proto = nullptr;
+    }
+
     boost::system::error_code ignore;
     socket_->shutdown(boost::asio::socket_base::shutdown_both, ignore);
     socket_->close(ignore);
     socket_.reset();
+    ring_.reset();
 }
 
 tcp_write_proto_t::guard_t tcp_write_proto_t::try_lock() noexcept {
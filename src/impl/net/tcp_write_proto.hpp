@@ -1,9 +1,16 @@
 #pragma once
 
+#include "impl/net/credits.hpp"
 #include "impl/net/slab_allocator.hpp"
+#include "impl/net/shm_ring.hpp"
+#include "impl/net/stream_endpoint.hpp"
+#include "impl/net/uring_service.hpp"
 
 #include <array>
 #include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <mutex>                        // unique_lock
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/io_service.hpp>
@@ -12,6 +19,23 @@
 
 namespace dmn {
 
+// ConstBufferSequence that references buffers stored elsewhere. Cheap to copy into asio operations.
+struct const_buffers_view_t {
+    using value_type = boost::asio::const_buffer;
+    using const_iterator = const boost::asio::const_buffer*;
+
+    const_iterator begin_;
+    const_iterator end_;
+
+    const_iterator begin() const noexcept {
+        return begin_;
+    }
+
+    const_iterator end() const noexcept {
+        return end_;
+    }
+};
+
 class tcp_write_proto_t {
     DMN_PINNED(tcp_write_proto_t);
 public:
@@ -20,7 +44,7 @@ public:
     using guard_t = std::unique_lock<tcp_write_proto_t>;
 
 private:
-    boost::optional<boost::asio::ip::tcp::socket> socket_;
+    boost::optional<stream_socket_t> socket_;
     using on_send_error_t = std::function<void(boost::system::error_code, guard_t, send_error_tag)>;
     const on_send_error_t on_send_error_;
 
@@ -30,17 +54,66 @@ private:
     using on_operation_finished_t = std::function<void(guard_t )>;
     const on_operation_finished_t on_operation_finished_;
 
-    const boost::asio::ip::tcp::endpoint remote_ep_;
+    const link_endpoint_t                remote_ep_;
     const std::size_t                    helper_id_;
     std::atomic<int> write_lock_ {0};
+    std::size_t      last_bytes_written_ = 0;
 
     saturation_timer_t instability_;
 
-    slab_allocator_t slab_;
+    std::atomic<std::uint64_t>  connects_{0};
+    std::atomic<std::uint64_t>  connect_failures_{0};
+
+    write_slab_allocator_t slab_;
+
+    // Data goes through the ring if it was requested by the link endpoint,
+    // socket is used only for wake ups.
+    shm_ring_t              ring_;
+    std::array<char, 16>    doorbell_;
+
+    // Packets that may be sent till the reader grants more. Links without flow control have unlimited credits.
+    std::atomic<std::int64_t>   credits_{0};
+    std::function<void(tcp_write_proto_t&)> on_credits_;
+
+    std::function<void(const guard_t&)> on_connect_failed_;
+
+    // CREDIT packets are read concurrently with the writes. Each connected socket gets its own read,
+    // handlers of the previous sockets and of the closed link find a different generation and do nothing.
+    struct control_reader_t;
+    const std::shared_ptr<control_reader_t> control_;
+
+    static constexpr std::int64_t unlimited_credits = std::numeric_limits<std::int64_t>::max() / 2;
+
+    void reset_credits() noexcept;
+    void async_read_control(std::uint64_t generation);
 
     struct on_write;
 
+    template <class Buffers>
+    struct on_ring_write;
+
+    void send_handshake(boost::system::error_code& ec) noexcept;
+
+#if DMN_IO_URING
+    // Sends are submitted as sendmsg to the io_uring, if that backend was selected at connect
+    struct uring_send_op;
+    uring_send_op*          uring_send_ = nullptr;
+
+    void start_uring() noexcept;
+    template <class Buffers>
+    bool try_uring_send(guard_t& g, const Buffers& buf);
+#endif
+
 protected:
+    tcp_write_proto_t(
+        const link_endpoint_t& remote_ep,
+        boost::asio::io_service& ios,
+        on_send_error_t on_send_error,
+        on_operation_finished_t on_operation_finished,
+        on_reconnect_error_t on_reconnect_error,
+        std::size_t helper_id = 0
+    );
+
     tcp_write_proto_t(
         const char* addr,
         unsigned short port,
@@ -61,11 +134,49 @@ public:
 
     void async_send(guard_t g, std::array<boost::asio::const_buffer, 2> data);
 
+    // Buffers must be alive till the operation finishes
+    void async_send(guard_t g, const_buffers_view_t data);
+
     void async_send(guard_t g, boost::asio::const_buffers_1 data) {
         const std::array<boost::asio::const_buffer, 2> buf{*data.begin(), boost::asio::const_buffer{}};
         async_send(std::move(g), buf);
     }
 
+    // Called when the reader grants more credits. Must be set before connecting.
+    void set_on_credits(std::function<void(tcp_write_proto_t&)> on_credits) {
+        on_credits_ = std::move(on_credits);
+    }
+
+    // Called with the link locked on each failed connect attempt, including the ones that are
+    // retried after a timeout. Must be set before connecting.
+    void set_on_connect_failed(std::function<void(const guard_t&)> on_connect_failed) {
+        on_connect_failed_ = std::move(on_connect_failed);
+    }
+
+    // Count of packets that may be sent right now
+    std::size_t available_credits() const noexcept {
+        const std::int64_t credits = credits_.load(std::memory_order_acquire);
+        return credits > 0 ? static_cast<std::size_t>(credits) : 0;
+    }
+
+    void consume_credits(std::size_t packets) noexcept {
+        credits_.fetch_sub(static_cast<std::int64_t>(packets), std::memory_order_acq_rel);
+    }
+
+    // Successful connects, including the first one
+    std::uint64_t connects() const noexcept {
+        return connects_.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t connect_failures() const noexcept {
+        return connect_failures_.load(std::memory_order_relaxed);
+    }
+
+    // Bytes written by the last send operation, including the failed one
+    std::size_t last_bytes_written() const noexcept {
+        return last_bytes_written_;
+    }
+
     // Closes the socket
     void close() noexcept;
 
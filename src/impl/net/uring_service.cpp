@@ -0,0 +1,472 @@
+#include "impl/net/uring_service.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if DMN_IO_URING
+#include <boost/asio/post.hpp>
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+#endif
+
+namespace dmn {
+
+namespace {
+
+net_backend_enum backend_from_env() noexcept {
+    const char* backend = std::getenv("DMN_NET_BACKEND");
+    if (backend && !std::strcmp(backend, "io_uring")) {
+        return net_backend_enum::IO_URING;
+    }
+
+    return net_backend_enum::EPOLL;
+}
+
+std::atomic<net_backend_enum>& backend_storage() noexcept {
+    static std::atomic<net_backend_enum> backend{backend_from_env()};
+    return backend;
+}
+
+} // anonymous namespace
+
+void set_net_backend(net_backend_enum backend) noexcept {
+    backend_storage().store(backend, std::memory_order_relaxed);
+}
+
+net_backend_enum net_backend() noexcept {
+#if DMN_IO_URING
+    return backend_storage().load(std::memory_order_relaxed);
+#else
+    return net_backend_enum::EPOLL;
+#endif
+}
+
+#if DMN_IO_URING
+
+boost::asio::io_context::id uring_service_t::id;
+
+namespace {
+
+constexpr unsigned submission_entries = 1024;
+constexpr unsigned completion_entries = 8 * submission_entries;
+constexpr unsigned max_reap_batch = 64;
+constexpr std::uint16_t recv_buffers_group = 0;
+
+template <class T>
+T load_acquire(const T* p) noexcept {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+template <class T>
+void store_release(T* p, T v) noexcept {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+int uring_setup(unsigned entries, io_uring_params* p) noexcept {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) noexcept {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) noexcept {
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+// Multishot receive appeared in Linux 6.0
+bool kernel_supports_multishot_recv() noexcept {
+    utsname u;
+    if (::uname(&u) != 0) {
+        return false;
+    }
+
+    unsigned major = 0, minor = 0;
+    if (std::sscanf(u.release, "%u.%u", &major, &minor) != 2) {
+        return false;
+    }
+    return major >= 6;
+}
+
+struct completion_t {
+    uring_op_t* op;
+    int         res;
+    unsigned    flags;
+};
+
+} // anonymous namespace
+
+struct uring_service_t::ring_t {
+    void*           rings = MAP_FAILED;
+    std::size_t     rings_size = 0;
+    io_uring_sqe*   sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    std::size_t     sqes_size = 0;
+
+    unsigned*       sq_head;
+    unsigned*       sq_tail;
+    unsigned*       sq_array;
+    unsigned        sq_mask;
+    unsigned        sq_entries;
+
+    unsigned*       cq_head;
+    unsigned*       cq_tail;
+    io_uring_cqe*   cqes;
+    unsigned        cq_mask;
+
+    io_uring_buf_ring*  buf_ring = static_cast<io_uring_buf_ring*>(MAP_FAILED);
+    std::size_t         buf_ring_size = 0;
+    std::uint16_t       buf_tail = 0;
+
+    std::size_t     in_flight = 0;  // All the submitted ops without final completion
+
+    ~ring_t() {
+        if (buf_ring != MAP_FAILED) {
+            ::munmap(buf_ring, buf_ring_size);
+        }
+        if (sqes != MAP_FAILED) {
+            ::munmap(sqes, sqes_size);
+        }
+        if (rings != MAP_FAILED) {
+            ::munmap(rings, rings_size);
+        }
+    }
+};
+
+uring_service_t::uring_service_t(boost::asio::io_context& ios)
+    : boost::asio::io_context::service(ios)
+    , ios_(ios)
+    , event_(ios)
+{
+    open();
+}
+
+uring_service_t::~uring_service_t() {
+    close();
+}
+
+void uring_service_t::open() {
+    if (!kernel_supports_multishot_recv()) {
+        return;
+    }
+
+    io_uring_params p{};
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = completion_entries;
+    const int fd = uring_setup(submission_entries, &p);
+    if (fd < 0) {
+        return;
+    }
+    ring_fd_ = fd;
+
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP)) {
+        close();
+        return;
+    }
+
+    ring_ = std::make_unique<ring_t>();
+    auto& r = *ring_;
+    r.rings_size = (std::max)(
+        p.sq_off.array + p.sq_entries * sizeof(unsigned),
+        p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe)
+    );
+    r.rings = ::mmap(nullptr, r.rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    r.sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+    r.sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, r.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (r.rings == MAP_FAILED || r.sqes == MAP_FAILED) {
+        close();
+        return;
+    }
+
+    auto* base = as_bytes_ptr(r.rings);
+    r.sq_head = reinterpret_cast<unsigned*>(base + p.sq_off.head);
+    r.sq_tail = reinterpret_cast<unsigned*>(base + p.sq_off.tail);
+    r.sq_array = reinterpret_cast<unsigned*>(base + p.sq_off.array);
+    r.sq_mask = *reinterpret_cast<unsigned*>(base + p.sq_off.ring_mask);
+    r.sq_entries = p.sq_entries;
+    r.cq_head = reinterpret_cast<unsigned*>(base + p.cq_off.head);
+    r.cq_tail = reinterpret_cast<unsigned*>(base + p.cq_off.tail);
+    r.cqes = reinterpret_cast<io_uring_cqe*>(base + p.cq_off.cqes);
+    r.cq_mask = *reinterpret_cast<unsigned*>(base + p.cq_off.ring_mask);
+
+    // Registered buffers for the multishot receive. Kernel picks them and reports buffer id in completion.
+    r.buf_ring_size = recv_buffers_count * sizeof(io_uring_buf);
+    r.buf_ring = static_cast<io_uring_buf_ring*>(::mmap(nullptr, r.buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (r.buf_ring == MAP_FAILED) {
+        close();
+        return;
+    }
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<std::uint64_t>(r.buf_ring);
+    reg.ring_entries = recv_buffers_count;
+    reg.bgid = recv_buffers_group;
+    if (uring_register(fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        close();
+        return;
+    }
+
+    recv_buffers_.resize(static_cast<std::size_t>(recv_buffers_count) * recv_buffer_size);
+    for (unsigned i = 0; i < recv_buffers_count; ++i) {
+        recycle_recv_buffer(i);
+    }
+
+    const int efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd == -1 || uring_register(fd, IORING_REGISTER_EVENTFD, &efd, 1) != 0) {
+        if (efd != -1) {
+            ::close(efd);
+        }
+        close();
+        return;
+    }
+    event_.assign(efd);
+
+    wait_completions();
+}
+
+void uring_service_t::shutdown() {
+    close();
+}
+
+void uring_service_t::close() noexcept {
+    boost::system::error_code ignore;
+    event_.close(ignore);
+
+    if (ring_fd_ == -1) {
+        return;
+    }
+
+    // Kernel must not touch receive buffers and messages of orphaned ops after they are freed
+    if (ring_ && ring_->sqes != MAP_FAILED) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (ring_->in_flight) {
+            io_uring_sqe* sqe = get_sqe(nullptr);
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+            flush();
+        }
+
+        for (int attempts = 0; ring_->in_flight && attempts < 1000; ++attempts) {
+            uring_enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS);
+            unsigned head = *ring_->cq_head;
+            const unsigned tail = load_acquire(ring_->cq_tail);
+            for (; head != tail; ++head) {
+                const io_uring_cqe& cqe = ring_->cqes[head & ring_->cq_mask];
+                auto* op = reinterpret_cast<uring_op_t*>(cqe.user_data);
+                if (op && !(cqe.flags & IORING_CQE_F_MORE)) {
+                    --op->in_flight;
+                    --ring_->in_flight;
+                }
+            }
+            store_release(ring_->cq_head, head);
+        }
+    }
+
+    ::close(ring_fd_);
+    ring_fd_ = -1;
+    ring_.reset();
+
+    for (auto* op: orphans_) {
+        op->destroy(*op);
+    }
+    orphans_.clear();
+}
+
+io_uring_sqe* uring_service_t::get_sqe(uring_op_t* op) {
+    auto& r = *ring_;
+    unsigned tail = *r.sq_tail;
+    if (tail - load_acquire(r.sq_head) >= r.sq_entries) {
+        flush();
+    }
+
+    const unsigned index = tail & r.sq_mask;
+    io_uring_sqe* sqe = r.sqes + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = reinterpret_cast<std::uint64_t>(op);
+    r.sq_array[index] = index;
+    store_release(r.sq_tail, tail + 1);
+
+    ++unsubmitted_;
+    if (op) {
+        ++op->in_flight;
+        ++r.in_flight;
+    }
+    return sqe;
+}
+
+void uring_service_t::schedule_flush() {
+    if (flush_posted_) {
+        return;
+    }
+
+    flush_posted_ = true;
+    boost::asio::post(ios_, [this]() {
+        std::lock_guard<std::mutex> lock{mutex_};
+        flush_posted_ = false;
+        flush();
+    });
+}
+
+// Single io_uring_enter for all the operations submitted since the last flush
+void uring_service_t::flush() noexcept {
+    while (unsubmitted_) {
+        const int res = uring_enter(ring_fd_, unsubmitted_, 0, 0);
+        if (res > 0) {
+            unsubmitted_ -= static_cast<unsigned>(res);
+        } else if (res < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            BOOST_ASSERT_MSG(false, "io_uring_enter failed");
+            return;
+        }
+    }
+}
+
+void uring_service_t::submit_sendmsg(int fd, const msghdr* msg, uring_op_t& op) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    io_uring_sqe* sqe = get_sqe(&op);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    schedule_flush();
+}
+
+void uring_service_t::submit_multishot_recv(int fd, uring_op_t& op) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    io_uring_sqe* sqe = get_sqe(&op);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = recv_buffers_group;
+    schedule_flush();
+}
+
+void uring_service_t::orphan_op(uring_op_t& op) noexcept {
+    bool destroy_now = false;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        op.orphaned.store(true, std::memory_order_release);
+        if (!op.in_flight || ring_fd_ == -1) {
+            destroy_now = true;
+        } else {
+            orphans_.push_back(&op);
+            io_uring_sqe* sqe = get_sqe(nullptr);
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = reinterpret_cast<std::uint64_t>(&op);
+            schedule_flush();
+        }
+    }
+
+    if (destroy_now) {
+        op.destroy(op);
+    }
+}
+
+void uring_service_t::recycle_recv_buffer(unsigned buffer_id) noexcept {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto& r = *ring_;
+    // Not using io_uring_buf_ring::bufs, as its C++ definition may be shifted by an empty struct.
+    // Tail of the ring overlaps with the `resv` of the first buffer.
+    auto* bufs = reinterpret_cast<io_uring_buf*>(r.buf_ring);
+    io_uring_buf& b = bufs[r.buf_tail & (recv_buffers_count - 1)];
+    b.addr = reinterpret_cast<std::uint64_t>(recv_buffers_.data() + static_cast<std::size_t>(buffer_id) * recv_buffer_size);
+    b.len = recv_buffer_size;
+    b.bid = static_cast<std::uint16_t>(buffer_id);
+    ++r.buf_tail;
+    store_release(&bufs[0].resv, r.buf_tail);
+}
+
+void uring_service_t::wait_completions() {
+    event_.async_wait(boost::asio::posix::descriptor_base::wait_read, [this](const boost::system::error_code& e) {
+        if (!e) {
+            // Other threads may reap the next completions while this one processes the batch
+            wait_completions();
+            reap_completions();
+        }
+    });
+}
+
+void uring_service_t::reap_completions() {
+    completion_t batch[max_reap_batch];
+    std::size_t count = 0;
+    bool more = false;
+    {
+        std::lock_guard<std::mutex> lock{reap_mutex_};
+        std::uint64_t ignore;
+        while (::read(event_.native_handle(), &ignore, sizeof(ignore)) > 0) {}
+
+        auto& r = *ring_;
+        unsigned head = *r.cq_head;
+        const unsigned tail = load_acquire(r.cq_tail);
+        for (; head != tail && count < max_reap_batch; ++head) {
+            const io_uring_cqe& cqe = r.cqes[head & r.cq_mask];
+            batch[count++] = completion_t{reinterpret_cast<uring_op_t*>(cqe.user_data), cqe.res, cqe.flags};
+        }
+        store_release(r.cq_head, head);
+        more = (head != tail);
+    }
+
+    // Eventfd is already drained, so the rest of the completions are reaped without waiting for it
+    if (more) {
+        boost::asio::post(ios_, [this]() { reap_completions(); });
+    }
+
+    for (std::size_t i = 0; i < count; ++i) {
+        const completion_t& c = batch[i];
+        if (!c.op) {
+            continue;   // Cancellation request
+        }
+
+        // Op that is being completed counts as in flight, so a concurrent orphan_op() or
+        // the final completion reaped by another thread does not destroy it under complete()
+        bool orphaned;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            orphaned = c.op->orphaned.load(std::memory_order_acquire);
+            ++c.op->in_flight;
+        }
+
+        if (orphaned) {
+            if (c.flags & IORING_CQE_F_BUFFER) {
+                recycle_recv_buffer(c.flags >> IORING_CQE_BUFFER_SHIFT);
+            }
+        } else {
+            c.op->complete(*c.op, c.res, c.flags);
+        }
+
+        bool destroy = false;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            --c.op->in_flight;
+            if (!(c.flags & IORING_CQE_F_MORE)) {
+                --c.op->in_flight;
+                --ring_->in_flight;
+            }
+            if (c.op->orphaned.load(std::memory_order_acquire) && !c.op->in_flight) {
+                const auto it = std::find(orphans_.begin(), orphans_.end(), c.op);
+                if (it != orphans_.end()) {
+                    orphans_.erase(it);
+                }
+                destroy = true;
+            }
+        }
+
+        if (destroy) {
+            c.op->destroy(*c.op);
+        }
+    }
+}
+
+#endif // DMN_IO_URING
+
+} // namespace dmn
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "utility.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+struct msghdr;
+struct io_uring_sqe;
+
+namespace dmn {
+
+enum class net_backend_enum {
+    EPOLL,
+    IO_URING,
+};
+
+// Backend for the links that are connected or accepted after the call. Default value is taken
+// from the DMN_NET_BACKEND environment variable ("epoll" or "io_uring"). IO_URING silently
+// falls back to EPOLL if it was not compiled in (DMN_IO_URING) or is not supported by the kernel.
+void set_net_backend(net_backend_enum backend) noexcept;
+net_backend_enum net_backend() noexcept;
+
+#if DMN_IO_URING
+
+// Operation in flight. Completion is called on one of the io_context threads. Operation
+// must outlive its last completion, so protos give up ownership on close via orphan_op().
+struct uring_op_t {
+    using complete_t = void(*)(uring_op_t& op, int res, unsigned flags);
+    using destroy_t = void(*)(uring_op_t& op) noexcept;
+
+    const complete_t    complete;
+    const destroy_t     destroy;
+    std::atomic<bool>   orphaned{false};
+    std::size_t         in_flight = 0;  // Submissions and running completions. Guarded by the service mutex
+
+    uring_op_t(complete_t c, destroy_t d) noexcept
+        : complete(c)
+        , destroy(d)
+    {}
+};
+
+// One io_uring per io_context. Submissions made during a handler are flushed by a single
+// io_uring_enter, completions are signalled through an eventfd watched by the io_context.
+class uring_service_t final: public boost::asio::io_context::service {
+public:
+    static boost::asio::io_context::id id;
+
+    static constexpr unsigned recv_buffer_size = 16 * 1024;
+    static constexpr unsigned recv_buffers_count = 256;
+
+    explicit uring_service_t(boost::asio::io_context& ios);
+    ~uring_service_t();
+
+    // False if the kernel does not support required io_uring features
+    bool is_open() const noexcept {
+        return ring_fd_ != -1;
+    }
+
+    // Thread safe. `msg` must be alive till the completion.
+    void submit_sendmsg(int fd, const msghdr* msg, uring_op_t& op);
+
+    // Thread safe. Completes multiple times, each time with a provided buffer.
+    void submit_multishot_recv(int fd, uring_op_t& op);
+
+    // Thread safe. Op is destroyed after its last completion.
+    void orphan_op(uring_op_t& op) noexcept;
+
+    const unsigned char* recv_buffer(unsigned buffer_id) const noexcept {
+        return recv_buffers_.data() + static_cast<std::size_t>(buffer_id) * recv_buffer_size;
+    }
+
+    // Thread safe. Returns buffer to the kernel.
+    void recycle_recv_buffer(unsigned buffer_id) noexcept;
+
+private:
+    struct ring_t;
+
+    boost::asio::io_context&    ios_;
+    std::mutex                  mutex_;
+    int                         ring_fd_ = -1;
+    std::unique_ptr<ring_t>     ring_;
+    unsigned                    unsubmitted_ = 0;
+    bool                        flush_posted_ = false;
+
+    std::vector<unsigned char>  recv_buffers_;
+    std::vector<uring_op_t*>    orphans_;
+
+    std::mutex                                  reap_mutex_;
+    boost::asio::posix::stream_descriptor       event_;
+
+    void shutdown() override;
+    void close() noexcept;
+
+    void open();
+    io_uring_sqe* get_sqe(uring_op_t* op);
+    void schedule_flush();
+    void flush() noexcept;
+    void wait_completions();
+    void reap_completions();
+};
+
+// Service of the io_context that runs `io_object`, or nullptr if the io_uring backend is not selected or not supported
+template <class IoObject>
+uring_service_t* find_uring_service(IoObject& io_object) {
+    if (net_backend() != net_backend_enum::IO_URING) {
+        return nullptr;
+    }
+
+    auto& ios = static_cast<boost::asio::io_context&>(io_object.get_executor().context());
+    auto& service = boost::asio::use_service<uring_service_t>(ios);
+    return service.is_open() ? &service : nullptr;
+}
+
+#endif // DMN_IO_URING
+
+} // namespace dmn
@@ -7,65 +7,280 @@
 #include "impl/edges/edge_in.hpp"
 #include "impl/net/tcp_read_proto.hpp"
 
+#include <boost/align/aligned_allocator.hpp>
 #include <boost/make_unique.hpp>
 #include <boost/optional.hpp>
 #include <boost/container/small_vector.hpp>
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace dmn {
 
 
+// Edges that brought parts of a wave. Fixed size bitset, so that the cost of a part does not depend
+// on the count of edges. Up to 128 edges are stored without dynamic allocations.
+class received_edges_t {
+    using word_t = std::uint64_t;
+    static constexpr std::size_t word_bits = 64;
+
+    boost::container::small_vector<word_t, 2>   bits_;
+    std::size_t                                 count_ = 0;
+
+public:
+    explicit received_edges_t(std::size_t edges_count)
+        : bits_((edges_count + word_bits - 1) / word_bits, 0)
+    {}
+
+    // Returns false if the edge was already received
+    bool set(std::size_t edge_id) noexcept {
+        BOOST_ASSERT_MSG(edge_id / word_bits < bits_.size(), "Edge id is out of range");
+        word_t& word = bits_[edge_id / word_bits];
+        const word_t bit = word_t{1} << (edge_id % word_bits);
+        if (word & bit) {
+            return false;
+        }
+
+        word |= bit;
+        ++count_;
+        return true;
+    }
+
+    // Same as the popcount of the bitset, updated on each set()
+    std::size_t count() const noexcept {
+        return count_;
+    }
+};
+
+struct partial_waves_stats_t {
+    std::uint64_t partial_bytes = 0;    // Held by the waves that are not gathered yet
+    std::uint64_t expired_waves = 0;    // By timeout
+    std::uint64_t expired_bytes = 0;
+    std::uint64_t evicted_waves = 0;    // By the memory limit
+    std::uint64_t evicted_bytes = 0;
+};
+
+// Gathers parts of each wave from all the in-edges. Waves are spread over independently locked
+// shards, so that parts of different waves are combined in parallel.
+//
+// Partial waves expire after a timeout. Each shard has a timer wheel with a slot per tick,
+// wave id and deadline are put into the slot of the deadline. Wheel entries of a wave are
+// matched by the deadline too, so the stale entries never touch a newer wave with the same id.
+// If the parts take more than the memory limit, the oldest partial waves of the shard are
+// evicted. Parts of expired and evicted waves are passed to `on_expired`.
+//
+// Timeout is the only way out for the waves that lost a part, including the waves split between
+// the hosts while the writers disagree on the failed links (see edge_out_exact_t::link_up_).
 class packets_gatherer_t {
     DMN_PINNED(packets_gatherer_t);
 
-    std::mutex  packets_mutex_;
-    using received_edge_ids_t = boost::container::small_vector<std::size_t, 16>;
-    std::unordered_map<wave_id_t, std::pair<received_edge_ids_t, packet_network_t> > packets_gatherer_;
+public:
+    using on_expired_t = std::function<void(packet_network_t)>;
+
+    // Waves expire with this precision relative to the timeout
+    static constexpr std::uint64_t ticks_per_timeout = 8;
+
+private:
+    static constexpr std::size_t wheel_slots = ticks_per_timeout + 2;
+
+    struct wave_parts_t {
+        received_edges_t    edges;
+        packet_network_t    packet;
+        std::uint64_t       deadline;   // In ticks
+        std::size_t         bytes;
+    };
+
+    struct wheel_entry_t {
+        wave_id_t       wave_id;
+        std::uint64_t   deadline;   // Of the wave that put the entry
+    };
+
+    struct alignas(hardware_destructive_interference_size) shard_t {
+        std::mutex                                          mutex;
+        std::unordered_map<wave_id_t, wave_parts_t>         waves;
+        std::array<std::deque<wheel_entry_t>, wheel_slots>  wheel;  // Slot of a tick, may contain entries of already gathered waves
+    };
+
+    static constexpr std::size_t shards_count_log2 = 6;
+    static constexpr std::size_t shards_count = std::size_t{1} << shards_count_log2;
+
+    // Aligned allocator keeps the shards on their own cache lines, `new` does not respect that before C++17
+    std::vector<shard_t, boost::alignment::aligned_allocator<shard_t>>   shards_;
+    const std::size_t                   edges_count_;
+    const std::size_t                   max_bytes_;
+    const on_expired_t                  on_expired_;
+
+    std::atomic<std::uint64_t>  tick_{0};
+    std::atomic<std::size_t>    partial_bytes_{0};
+    std::atomic<std::uint64_t>  expired_waves_{0};
+    std::atomic<std::uint64_t>  expired_bytes_{0};
+    std::atomic<std::uint64_t>  evicted_waves_{0};
+    std::atomic<std::uint64_t>  evicted_bytes_{0};
+
+    using expired_t = boost::container::small_vector<packet_network_t, 4>;
+
+    // Fibonacci hashing, consecutive waves of a source go to different shards
+    shard_t& shard_for(wave_id_t wave_id) noexcept {
+        const std::uint64_t h = static_cast<std::uint64_t>(wave_id) * 0x9E3779B97F4A7C15ull;
+        return shards_[static_cast<std::size_t>(h >> (64 - shards_count_log2))];
+    }
+
+    static std::size_t bytes_of(const packet_network_t& p) noexcept {
+        return sizeof(packet_header_t) + p.expected_body_size();
+    }
+
+    // Evicts the oldest partial waves of the shard, except the `current` one, till the memory limit is met
+    void evict_oldest(shard_t& shard, wave_id_t current, expired_t& evicted) {
+        const std::uint64_t tick = tick_.load(std::memory_order_relaxed);
+        for (std::size_t i = 1; i <= wheel_slots && partial_bytes_.load(std::memory_order_relaxed) > max_bytes_; ++i) {
+            auto& slot = shard.wheel[(tick + i) % wheel_slots];
+            boost::optional<wheel_entry_t> current_entry;
+            while (!slot.empty() && partial_bytes_.load(std::memory_order_relaxed) > max_bytes_) {
+                const wheel_entry_t entry = slot.front();
+                slot.pop_front();
+                if (entry.wave_id == current) {
+                    current_entry = entry;
+                    continue;
+                }
 
-    const std::size_t edges_count_;
+                const auto it = shard.waves.find(entry.wave_id);
+                if (it == shard.waves.end() || it->second.deadline != entry.deadline) {
+                    continue;   // Gathered, the newer wave with the same id has its own entry
+                }
+
+                partial_bytes_.fetch_sub(it->second.bytes, std::memory_order_relaxed);
+                evicted_waves_.fetch_add(1, std::memory_order_relaxed);
+                evicted_bytes_.fetch_add(it->second.bytes, std::memory_order_relaxed);
+                evicted.push_back(std::move(it->second.packet));
+                shard.waves.erase(it);
+            }
+
+            if (current_entry) {
+                slot.push_front(*current_entry);
+            }
+        }
+    }
+
+    void report_expired(expired_t& expired) {
+        for (auto& p: expired) {
+            on_expired_(std::move(p));
+        }
+    }
 
 public:
-    explicit packets_gatherer_t(std::size_t edge_count)
-        : edges_count_(edge_count)
-    {}
+    packets_gatherer_t(std::size_t edge_count, std::size_t max_bytes, on_expired_t on_expired)
+        : shards_(shards_count)
+        , edges_count_(edge_count)
+        , max_bytes_(max_bytes)
+        , on_expired_(std::move(on_expired))
+    {
+        BOOST_ASSERT_MSG(on_expired_, "Expired waves handler is not set");
+    }
 
+    // Thread safe. Returns the combined packet once all the parts of the wave were received.
+    // Parts with unknown edge ids are ignored.
     boost::optional<packet_network_t> combine_packets(packet_network_t p) {
         boost::optional<packet_network_t> result;
+        expired_t evicted;
         const auto wave_id = p.wave_id_from_packet();
         const auto edge_id = p.edge_id_from_packet();
-
-        std::lock_guard<std::mutex> l(packets_mutex_);
-        const auto it = packets_gatherer_.find(wave_id);
-        if (it == packets_gatherer_.cend()) {
-            auto packet_it = packets_gatherer_.emplace(
-                wave_id,
-                std::pair<received_edge_ids_t, packet_network_t>{{}, std::move(p)}
-            ).first;
-            packet_it->second.first.push_back(edge_id); // TODO: `second.first.` looks awfull. Refactor!
+        const std::size_t bytes = bytes_of(p);
+        if (edge_id >= edges_count_) {
+            // Readers drop links with such packets, so this is a foreign packet from a misconfigured writer
             return result;
         }
 
-        auto& edge_counter = it->second.first;
-        auto ins_it = std::lower_bound(edge_counter.begin(), edge_counter.end(), edge_id);
-        if (ins_it != edge_counter.end() && *ins_it == edge_id) {
-            // Duplicate packet.
-            // TODO: Write to log
-            return result;
-        }
+        auto& shard = shard_for(wave_id);
+        {
+            std::lock_guard<std::mutex> l(shard.mutex);
+            const auto it = shard.waves.find(wave_id);
+            if (it == shard.waves.cend()) {
+                const std::uint64_t deadline = tick_.load(std::memory_order_relaxed) + ticks_per_timeout + 1;
+                auto& parts = shard.waves.emplace(
+                    wave_id,
+                    wave_parts_t{received_edges_t{edges_count_}, std::move(p), deadline, bytes}
+                ).first->second;
+                parts.edges.set(edge_id);
+                shard.wheel[deadline % wheel_slots].push_back(wheel_entry_t{wave_id, deadline});
+            } else {
+                auto& parts = it->second;
+                if (!parts.edges.set(edge_id)) {
+                    // Duplicate packet.
+                    // TODO: Write to log
+                    return result;
+                }
 
-        it->second.second.merge_packet(std::move(p));
-        edge_counter.insert(ins_it, edge_id);
-        if (edge_counter.size() == edges_count_) {
-            result.emplace(std::move(it->second.second));
-            packets_gatherer_.erase(it);
-            return result;
+                parts.packet.merge_packet(std::move(p));
+                if (parts.edges.count() == edges_count_) {
+                    partial_bytes_.fetch_sub(parts.bytes, std::memory_order_relaxed);
+                    result.emplace(std::move(parts.packet));
+                    shard.waves.erase(it);
+                    return result;
+                }
+                parts.bytes += bytes;
+            }
+
+            if (partial_bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes > max_bytes_) {
+                evict_oldest(shard, wave_id, evicted);
+            }
         }
 
+        report_expired(evicted);
         return result;
     }
 
-    // TODO: drop partial packets after timeout
+    // Thread safe. Advances the timer wheels by one tick and expires waves that reached their deadline.
+    // Must be called each `timeout / ticks_per_timeout`.
+    void expire_tick() {
+        const std::uint64_t tick = tick_.fetch_add(1, std::memory_order_relaxed) + 1;
+        for (std::size_t i = 0; i < shards_count; ++i) {
+            auto& shard = shards_[i];
+            expired_t expired;
+            {
+                std::lock_guard<std::mutex> l(shard.mutex);
+                auto& slot = shard.wheel[tick % wheel_slots];
+                auto kept = slot.begin();
+                for (const wheel_entry_t& entry: slot) {
+                    if (entry.deadline > tick) {
+                        // Put for the next turn of the wheel by a part that has seen the next tick
+                        *kept++ = entry;
+                        continue;
+                    }
+
+                    const auto it = shard.waves.find(entry.wave_id);
+                    if (it == shard.waves.end() || it->second.deadline != entry.deadline) {
+                        continue;   // Gathered, the newer wave with the same id has its own entry
+                    }
+
+                    partial_bytes_.fetch_sub(it->second.bytes, std::memory_order_relaxed);
+                    expired_waves_.fetch_add(1, std::memory_order_relaxed);
+                    expired_bytes_.fetch_add(it->second.bytes, std::memory_order_relaxed);
+                    expired.push_back(std::move(it->second.packet));
+                    shard.waves.erase(it);
+                }
+                slot.erase(kept, slot.end());
+            }
+
+            report_expired(expired);
+        }
+    }
+
+    partial_waves_stats_t stats() const noexcept {
+        partial_waves_stats_t res;
+        res.partial_bytes = partial_bytes_.load(std::memory_order_relaxed);
+        res.expired_waves = expired_waves_.load(std::memory_order_relaxed);
+        res.expired_bytes = expired_bytes_.load(std::memory_order_relaxed);
+        res.evicted_waves = evicted_waves_.load(std::memory_order_relaxed);
+        res.evicted_bytes = evicted_bytes_.load(std::memory_order_relaxed);
+        return res;
+    }
 };
 
 }
@@ -5,25 +5,45 @@
 #include "impl/packet.hpp"
 #include "impl/work_counter.hpp"
 
+#include <chrono>
 #include <boost/asio/io_service.hpp>
 
 namespace dmn {
 
 class node_impl_read_0: public virtual node_base_t {
-    std::atomic<std::uint16_t> subwave_id_{0};
+    // {epoch, sequence} of the next wave. Overflow of the sequence increments the epoch.
+    std::atomic<std::uint64_t> next_wave_{initial_epoch() << 32};
+
+    // Restarted source must not reuse ids of the waves that may still be gathered by the receivers
+    static std::uint64_t initial_epoch() noexcept {
+        const auto now = std::chrono::system_clock::now().time_since_epoch();
+        return static_cast<std::uint16_t>(std::chrono::duration_cast<std::chrono::seconds>(now).count());
+    }
 
     wave_id_t new_wave() noexcept {
-        constexpr std::uint32_t shift = (sizeof(wave_id_t) - sizeof(host_id_)) * CHAR_BIT;
-        const std::uint32_t subwave = subwave_id_.fetch_add(1, std::memory_order_relaxed);
-        const std::uint32_t res = (host_id_ << shift) | subwave;
-        return static_cast<wave_id_t>(res);
+        const std::uint64_t next = next_wave_.fetch_add(1, std::memory_order_relaxed);
+        return make_wave_id(host_id_, static_cast<std::uint16_t>(next >> 32), static_cast<std::uint32_t>(next));
     }
 
+    // Set when the source is throttled by the overloaded write part
+    std::atomic<bool> paused_{false};
+
     void start() {
         ios().post([this]() {
+            if (is_write_overloaded()) {
+                paused_.store(true, std::memory_order_release);
+
+                // Write part could unload right before the pause was set
+                if (is_write_overloaded() || !paused_.exchange(false, std::memory_order_acq_rel)) {
+                    return;
+                }
+            }
+
             packet_t p{};
             p.place_header();
             p.header().wave_id = new_wave();
+            on_wave_created(p);
+            DMN_TRACE_INSTANT(tracer(), "created", p.header().wave_id);
 
             on_packet_accept(std::move(p));
             start();
@@ -34,6 +54,12 @@ public:
         start(); // TODO: mutithreaded run
     }
 
+    void on_write_unloaded() final {
+        if (paused_.exchange(false, std::memory_order_acq_rel)) {
+            start();
+        }
+    }
+
     void single_threaded_io_detach_read() noexcept {}
 
     ~node_impl_read_0() noexcept override = default;
@@ -2,8 +2,10 @@
 
 #include "node_base.hpp"
 
+#include "impl/net/direct_link.hpp"
 #include "impl/net/netlink.hpp"
 #include "impl/net/packet_network.hpp"
+#include "impl/net/packets_reader.hpp"
 #include "impl/edges/edge_in.hpp"
 #include "impl/net/tcp_acceptor.hpp"
 #include "impl/net/tcp_read_proto.hpp"
@@ -19,10 +21,20 @@ namespace dmn {
 class node_impl_read_1: public virtual node_base_t {
     tcp_acceptor acceptor_;
 
-    using edge_t = edge_in_t<packet_network_t>;
+    using edge_t = edge_in_t<packets_reader_t>;
     using link_t = edge_t::link_t;
     edge_t edge_;
 
+    // Writers from the same process hand over packets through it
+    direct_endpoint_ptr_t direct_;
+
+    void accept(packet_network_t p) {
+        edge_.on_received(1, sizeof(packet_header_t) + p.expected_body_size());
+        on_packet_received(p);
+        DMN_TRACE_INSTANT(tracer(), "received", p.wave_id_from_packet());
+        on_packet_accept(std::move(p).to_native());
+    }
+
     void on_error(link_t& link, const boost::system::error_code& e) {
         edge_.remove_link(link);
         // TODO: log issue
@@ -41,19 +53,28 @@ class node_impl_read_1: public virtual node_base_t {
         );
 
         auto& link = edge_.add_link(std::move(link_ptr));
-        link.async_read(link.packet.header_mutable_buffer());
+        link.async_read_some(link.packet.prepare());
     }
 
     void on_operation_finished(link_t& link) {
-        BOOST_ASSERT_MSG(link.packet.packet_type() == packet_types_enum::DATA, "Packet types other than DATA are not supported");
-        if (link.packet.expected_body_size() != link.packet.actual_body_size()) {
-            link.async_read(link.packet.body_mutable_buffer());
+        received_packets_t packets;
+        if (!link.packet.commit(link.last_bytes_read(), packets)) {
+            // Garbage or a writer of an incompatible build, nothing received over the link could be trusted
+            on_error(link, boost::asio::error::invalid_argument);
             return;
         }
-        auto p = std::move(link.packet);
 
-        link.async_read(link.packet.header_mutable_buffer());
-        on_packet_accept(std::move(p).to_native());
+        // Credits are accounted before the read is re-posted: after that an error on another thread may destroy the link.
+        // Writer gets no credits while the data is stuck in this node.
+        link.packets_consumed(packets.size());
+        if (!is_write_overloaded()) {
+            link.grant_credits(false);
+        }
+        link.async_read_some(link.packet.prepare());
+
+        for (auto& p: packets) {
+            accept(std::move(p));
+        }
     }
 
     void start_accept() {
@@ -64,12 +85,31 @@ class node_impl_read_1: public virtual node_base_t {
 
 public:
     node_impl_read_1()
-        : acceptor_(ios(), config[this_node_descriptor].hosts[host_id_].first.c_str(), config[this_node_descriptor].hosts[host_id_].second)
+        : acceptor_(ios(), make_link_endpoint(config[this_node_descriptor].hosts[host_id_].first, config[this_node_descriptor].hosts[host_id_].second).address)
     {
+        edge_.register_metrics(metrics(), with_label(metric_labels(), "edge", "0"));
+
+        const auto& host = config[this_node_descriptor].hosts[host_id_];
+        if (is_direct_link_allowed(host.first)) {
+            direct_ = get_direct_endpoint(host.first, host.second);
+            direct_->attach(ios(), [this](packet_network_t p) {
+                accept(std::move(p));
+            });
+        }
+
         start_accept();
     }
 
+    void on_write_unloaded() final {
+        edge_.for_each_link([](link_t& link) {
+            link.grant_credits(true);
+        });
+    }
+
     void single_threaded_io_detach_read() noexcept {
+        if (direct_) {
+            direct_->detach();
+        }
         acceptor_.close();
         edge_.close_links();
     }
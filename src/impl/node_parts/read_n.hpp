@@ -2,9 +2,12 @@
 
 #include "node_base.hpp"
 
+#include "impl/net/direct_link.hpp"
 #include "impl/net/netlink.hpp"
 #include "impl/net/packet_network.hpp"
+#include "impl/net/packets_reader.hpp"
 #include "impl/edges/edge_in.hpp"
+#include "impl/net/interval_timer.hpp"
 #include "impl/net/tcp_acceptor.hpp"
 #include "impl/net/tcp_read_proto.hpp"
 #include "impl/node_parts/packets_gatherer.hpp"
@@ -14,20 +17,29 @@
 #include <boost/asio/ip/tcp.hpp>
 
 
+#include <algorithm>
 #include <mutex>
+#include <string>
 
 namespace dmn {
 
 class node_impl_read_n: public virtual node_base_t {
     tcp_acceptor  acceptor_;
 
-    using edge_t = edge_in_t<packet_network_t>;
+    using edge_t = edge_in_t<packets_reader_t>;
     using link_t = edge_t::link_t;
 
     const std::size_t               edges_count_;
     const std::unique_ptr<edge_t[]> edges_;
 
-    packets_gatherer_t packs_;
+    const partial_waves_limits_t    partial_waves_limits_;
+    packets_gatherer_t              packs_;
+    interval_timer                  expiry_timer_;
+
+    metrics_registry_t::registrations_t partial_waves_metrics_;
+
+    // Writers from the same process hand over packets through it
+    direct_endpoint_ptr_t direct_;
 
     class unknown_links_t {
         std::mutex              unknown_links_mutex_;
@@ -52,6 +64,14 @@ class node_impl_read_n: public virtual node_base_t {
             return res;
         }
 
+        template <class F>
+        void for_each(F f) {
+            std::lock_guard<std::mutex> lock{unknown_links_mutex_};
+            for (auto& l : unknown_links_) {
+                f(*l);
+            }
+        }
+
         void add(link_ptr_t l) {
             std::lock_guard<std::mutex> lock{unknown_links_mutex_};
             unknown_links_.push_back(std::move(l));
@@ -66,6 +86,48 @@ class node_impl_read_n: public virtual node_base_t {
     } unknown_links_;
 
 
+    void on_wave_expired(packet_network_t p) {
+        switch (partial_waves_limits_.policy) {
+        case partial_waves_policy_enum::DROP:
+            break;
+        case partial_waves_policy_enum::EMIT_PARTIAL:
+            p.set_packet_type(packet_types_enum::PARTIAL_DATA);
+            on_packet_accept(std::move(p).to_native());
+            break;
+        case partial_waves_policy_enum::CALLBACK:
+            partial_waves_limits_.on_expired(std::move(p).to_native());
+            break;
+        }
+    }
+
+    void gather(packet_network_t p) {
+        edges_[p.edge_id_from_packet()].on_received(1, sizeof(packet_header_t) + p.expected_body_size());
+        on_packet_received(p);
+        DMN_TRACE_INSTANT(tracer(), "received", p.wave_id_from_packet());
+        auto res = packs_.combine_packets(std::move(p));
+        if (res) {
+            DMN_TRACE_INSTANT(tracer(), "gathered", res->wave_id_from_packet());
+            on_packet_accept(std::move(*res).to_native());
+        }
+    }
+
+    void register_partial_waves_metrics() {
+        auto& r = partial_waves_metrics_;
+        r.push_back(metrics().add_gauge("dmn_partial_waves_bytes", "Bytes held by the waves that did not get all of their parts", metric_labels(), [this]() {
+            return static_cast<double>(packs_.stats().partial_bytes);
+        }));
+        r.push_back(metrics().add(
+            "dmn_partial_waves_expired_total", "Partial waves expired by timeout",
+            metrics_registry_t::type_enum::COUNTER, metric_labels(),
+            [this]() { return static_cast<double>(packs_.stats().expired_waves); }
+        ));
+        r.push_back(metrics().add(
+            "dmn_partial_waves_evicted_total", "Partial waves evicted by the memory limit",
+            metrics_registry_t::type_enum::COUNTER, metric_labels(),
+            [this]() { return static_cast<double>(packs_.stats().evicted_waves); }
+        ));
+    }
+
     template <class F>
     void for_each_edge(F f) {
         for (std::size_t i = 0; i < edges_count_; ++i) {
@@ -106,28 +168,38 @@ class node_impl_read_n: public virtual node_base_t {
         auto* link = link_ptr.get();    // Releasing link ownership to reclaim it in `on_operation_finished` or delete it in `on_error`
         unknown_links_.add(std::move(link_ptr));
 
-        link->async_read(link->packet.header_mutable_buffer());
+        link->async_read_some(link->packet.prepare());
     }
 
     void on_operation_finished(link_t& link) {
-        BOOST_ASSERT_MSG(link.packet.packet_type() == packet_types_enum::DATA, "Packet types other than DATA are not supported");
-        if (!link.is_helper_id_set()) {
-            std::unique_ptr<link_t> link_ptr = unknown_links_.extract(link);; // Taking ownership
+        received_packets_t packets;
+        const bool valid = link.packet.commit(link.last_bytes_read(), packets)
+            && std::all_of(packets.cbegin(), packets.cend(), [this](const packet_network_t& p) {
+                return p.edge_id_from_packet() < edges_count_;
+            });
+        if (!valid) {
+            // Garbage or a writer of an incompatible build, nothing received over the link could be trusted
+            on_error(link, boost::asio::error::invalid_argument);
+            return;
+        }
+
+        if (!link.is_helper_id_set() && !packets.empty()) {
+            std::unique_ptr<link_t> link_ptr = unknown_links_.extract(link); // Taking ownership
 
-            link.set_helper_id(link.packet.edge_id_from_packet());
+            link.set_helper_id(packets.front().edge_id_from_packet());
             edges_[link.get_helper_id()].add_link(std::move(link_ptr));
         }
 
-        if (link.packet.expected_body_size() != link.packet.actual_body_size()) {
-            link.async_read(link.packet.body_mutable_buffer());
-            return;
+        // Credits are accounted before the read is re-posted: after that an error on another thread may destroy the link.
+        // Writer gets no credits while the data is stuck in this node.
+        link.packets_consumed(packets.size());
+        if (!is_write_overloaded()) {
+            link.grant_credits(false);
         }
-        auto p = std::move(link.packet);
-        link.async_read(link.packet.header_mutable_buffer());
+        link.async_read_some(link.packet.prepare());
 
-        auto res = packs_.combine_packets(std::move(p));
-        if (res) {
-            on_packet_accept(std::move(*res).to_native());
+        for (auto& p: packets) {
+            gather(std::move(p));
         }
     }
 
@@ -139,15 +211,52 @@ class node_impl_read_n: public virtual node_base_t {
 
 public:
     node_impl_read_n()
-        : acceptor_(ios(), config[this_node_descriptor].hosts[host_id_].first.c_str(), config[this_node_descriptor].hosts[host_id_].second)
+        : acceptor_(ios(), make_link_endpoint(config[this_node_descriptor].hosts[host_id_].first, config[this_node_descriptor].hosts[host_id_].second).address)
         , edges_count_(count_in_edges())
         , edges_(boost::make_unique<edge_t[]>(edges_count_))
-        , packs_(edges_count_)
+        , partial_waves_limits_(partial_waves_limits())
+        , packs_(edges_count_, partial_waves_limits_.max_bytes, [this](packet_network_t p) { on_wave_expired(std::move(p)); })
+        , expiry_timer_(
+            ios(),
+            (std::max<std::chrono::milliseconds>)(partial_waves_limits_.timeout / packets_gatherer_t::ticks_per_timeout, std::chrono::milliseconds{1}),
+            [this]() { packs_.expire_tick(); }
+        )
     {
+        for (std::size_t i = 0; i < edges_count_; ++i) {
+            edges_[i].register_metrics(metrics(), with_label(metric_labels(), "edge", std::to_string(i)));
+        }
+        register_partial_waves_metrics();
+
+        const auto& host = config[this_node_descriptor].hosts[host_id_];
+        if (is_direct_link_allowed(host.first)) {
+            direct_ = get_direct_endpoint(host.first, host.second);
+            direct_->attach(ios(), [this](packet_network_t p) {
+                gather(std::move(p));
+            });
+        }
+
         start_accept();
     }
 
+    void on_write_unloaded() final {
+        const auto grant = [](link_t& link) {
+            link.grant_credits(true);
+        };
+        unknown_links_.for_each(grant);
+        for_each_edge([&grant](auto& e) {
+            e.for_each_link(grant);
+        });
+    }
+
+    partial_waves_stats_t partial_waves_stats() const noexcept {
+        return packs_.stats();
+    }
+
     void single_threaded_io_detach_read() noexcept {
+        expiry_timer_.close();
+        if (direct_) {
+            direct_->detach();
+        }
         acceptor_.close();
         unknown_links_.close();
         for_each_edge([](auto& e){
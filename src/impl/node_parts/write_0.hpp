@@ -13,6 +13,10 @@ public:
         call_callback(std::move(packet));
     }
 
+    bool is_write_overloaded() const noexcept final {
+        return false;
+    }
+
     void single_threaded_io_detach_write() noexcept {}
 };
 
@@ -5,17 +5,32 @@
 #include "impl/silent_mt_queue.hpp"
 #include "impl/work_counter.hpp"
 
+#include "impl/net/direct_link.hpp"
 #include "impl/net/netlink.hpp"
 #include "impl/net/packet_network.hpp"
+#include "impl/net/shared_packet.hpp"
+#include "impl/net/stream_endpoint.hpp"
 
 #include "impl/edges/edge_out.hpp"
 
+#include <boost/make_unique.hpp>
+
 namespace dmn {
 
 class node_impl_write_1: public virtual node_base_t {
-    using edge_t = edge_out_round_robin_t<packet_network_t>;
+    using edge_t = edge_out_t<packet_network_t>;
     using link_t = edge_t::link_t;
-    edge_t                          edge_;
+    const std::unique_ptr<edge_t>   edge_;
+    direct_edge_t                   direct_;
+
+    std::unique_ptr<edge_t> make_edge() {
+        if (is_wave_affine_receiver(0)) {
+            const vertex_t& out_vertex = config[target(*boost::out_edges(this_node_descriptor, config).first, config)];
+            return boost::make_unique<edge_out_exact_t<packet_network_t>>(edge_id_for_receiver(), out_vertex.hosts);
+        }
+
+        return boost::make_unique<edge_out_balanced_t<packet_network_t>>(edge_id_for_receiver());
+    }
 
     void reconnect(const boost::system::error_code& e, tcp_write_proto_t::guard_t guard) {
         BOOST_ASSERT_MSG(guard, "Empty guard in error handler");
@@ -27,17 +42,17 @@ class node_impl_write_1: public virtual node_base_t {
     }
 
     void on_send_error(const boost::system::error_code& e, tcp_write_proto_t::guard_t guard) {
-        edge_.reschedule_packet_from_link(guard);
+        edge_->reschedule_packet_from_link(guard);
         reconnect(e, std::move(guard));
     }
 
     void on_operation_finished(tcp_write_proto_t::guard_t guard) {
-        edge_.try_steal_work(std::move(guard));
+        edge_->try_steal_work(std::move(guard));
     }
 
 public:
     node_impl_write_1()
-        : edge_(edge_id_for_receiver())
+        : edge_(make_edge())
     {
         const auto edges_out = boost::out_edges(
             this_node_descriptor,
@@ -48,31 +63,53 @@ public:
         const vertex_t& out_vertex = config[target(*edges_out.first, config)];
 
         const auto hosts_count = out_vertex.hosts.size();
-        edge_.preinit_links(hosts_count);
+        edge_->preinit_links(hosts_count);
         for (std::size_t i = 0; i < hosts_count; ++ i) {
-            edge_.inplace_construct_link(
+            direct_.add_host(out_vertex.hosts[i].first, out_vertex.hosts[i].second);
+            edge_->inplace_construct_link(
                 i,
-                out_vertex.hosts[i].first.c_str(),
-                out_vertex.hosts[i].second,
+                make_link_endpoint(out_vertex.hosts[i].first, out_vertex.hosts[i].second),
                 ios(),
                 [this](const auto& e, auto guard, tcp_write_proto_t::send_error_tag) { on_send_error(e, std::move(guard)); },
                 [this](auto guard) { on_operation_finished(std::move(guard)); },
                 [this](const auto& e, auto guard, tcp_write_proto_t::reconnect_error_tag) { reconnect(e, std::move(guard)); }
             );
         }
-        edge_.connect_links();
+        edge_->set_on_unloaded([this]() { on_write_unloaded(); });
+        edge_->register_metrics(metrics(), with_label(with_label(metric_labels(), "edge", "0"), "to", out_vertex.node_id));
+#if DMN_TRACING
+        edge_->set_tracer(tracer());
+#endif
+        edge_->connect_links();
+    }
+
+    bool is_write_overloaded() const noexcept final {
+        return edge_->overloaded();
     }
 
     void on_packet_accept(packet_t packet) final {
         packet_t data = call_callback(std::move(packet));
         const auto wave_id = data.header().wave_id;
-        data.header().edge_id = edge_.edge_id_for_receiver();
+        data.header().edge_id = edge_->edge_id_for_receiver();
+
+        const packet_header_t header = data.header();
+        packet_network_t p{std::move(data)};
+        if (direct_.has_receivers()) {
+            shared_packet_t direct{header, make_shared_body(std::move(p))};
+            if (direct_.try_push(direct, edge_->preferred_link(wave_id))) {
+                edge_->on_sent_directly();
+                DMN_TRACE_INSTANT(tracer(), "sent_directly", wave_id);
+                return;
+            }
+            p = std::move(direct).to_packet_network();  // The only holder, gets the storage back
+        }
 
-        edge_.push(wave_id, packet_network_t{std::move(data)});
+        DMN_TRACE_INSTANT(tracer(), "queued", wave_id);
+        edge_->push(wave_id, std::move(p));
     }
 
     void single_threaded_io_detach_write() noexcept {
-        edge_.close_links();
+        edge_->close_links();
     }
 };
 
@@ -6,99 +6,41 @@
 #include "impl/work_counter.hpp"
 
 #include "impl/edges/edge_out.hpp"
+#include "impl/net/direct_link.hpp"
 #include "impl/net/netlink.hpp"
 #include "impl/net/packet_network.hpp"
+#include "impl/net/shared_packet.hpp"
+#include "impl/net/stream_endpoint.hpp"
 
-#include <vector>
+#include <algorithm>
+#include <boost/container/small_vector.hpp>
 #include <boost/make_unique.hpp>
 
 namespace dmn {
 
-class counted_packets_storage {
-    struct counted_packet {
-        packet_network_t packet;
-        std::size_t      count;
-    };
-
-    struct addr_comparator {
-        inline bool operator()(const counted_packet& lhs, const counted_packet& rhs) const noexcept {
-            return lhs.packet.data_address() < rhs.packet.data_address();
-        }
-        inline bool operator()(const counted_packet& lhs, const packet_network_t& rhs) const noexcept {
-            return lhs.packet.data_address() < rhs.data_address();
-        }
-        inline bool operator()(const packet_network_t& lhs, const counted_packet& rhs) const noexcept {
-            return lhs.data_address() < rhs.packet.data_address();
-        }
-        inline bool operator()(const counted_packet& lhs, boost::asio::const_buffer rhs) const noexcept {
-            return boost::asio::buffer_cast<const void*>(lhs.packet.body_const_buffer()) < boost::asio::buffer_cast<const void*>(rhs);
-        }
-        inline bool operator()(boost::asio::const_buffer lhs, const counted_packet& rhs) const noexcept {
-            return boost::asio::buffer_cast<const void*>(lhs) < boost::asio::buffer_cast<const void*>(rhs.packet.body_const_buffer());
-        }
-    };
-
-    std::mutex                                          packets_mutex_;
-    std::vector<counted_packet>                         packets_;
-    std::size_t                                         pending_packets_{0};
-    const std::size_t                                   counter_init_;
-
-public:
-    explicit counted_packets_storage(std::size_t counter_init)
-        : counter_init_(counter_init)
-    {}
-
-    boost::asio::const_buffers_1 add_packet(packet_network_t p) {
-        BOOST_ASSERT_MSG(!p.empty(), "Attempt to add an empty packet (even without header!)");
-        if (p.expected_body_size() == 0) {
-            return boost::asio::const_buffers_1{nullptr, 0}; // Do nothing
-        }
-
-        std::lock_guard<std::mutex> l(packets_mutex_);
-        auto it = std::lower_bound(packets_.begin(), packets_.end(), p, addr_comparator{});
-        it = packets_.insert(it, {std::move(p), counter_init_});
-        pending_packets_ += counter_init_;
-        return it->packet.body_const_buffer();
-    }
-
-    void send_success(boost::asio::const_buffer buf) {
-        if (boost::asio::buffer_size(buf) == 0) {
-            return;
-        }
-
-        std::lock_guard<std::mutex> l(packets_mutex_);
-        const auto it = std::equal_range(packets_.begin(), packets_.end(), buf, addr_comparator{});
-        BOOST_ASSERT_MSG(it.second != it.first, "No packet found after successful send");
-        BOOST_ASSERT_MSG(it.second - it.first == 1, "Found more that one matching buffer after successful send");
-        counted_packet& v = *it.first;
-        const auto val = --v.count;
-        --pending_packets_;
-        if (val == 0) {
-            packets_.erase(it.first);
-        }
-    }
-
-    std::size_t pending_packets() noexcept {
-        std::lock_guard<std::mutex> l(packets_mutex_);
-        return pending_packets_;
-    }
-};
-
 class node_impl_write_n: public virtual node_base_t {
 
-    using edge_t = edge_out_round_robin_t<std::pair<packet_header_t, boost::asio::const_buffer>>;
+    using edge_t = edge_out_t<shared_packet_t>;
     using link_t = edge_t::link_t;
 
-    const std::size_t               edges_count_;
-    lazy_array<edge_t>              edges_;
+    static constexpr std::size_t edge_storage_size = (std::max)(
+        sizeof(edge_out_balanced_t<shared_packet_t>),
+        sizeof(edge_out_exact_t<shared_packet_t>)
+    );
+
+    const std::size_t                           edges_count_;
+    lazy_array<edge_t, edge_storage_size>       edges_;
 
-    counted_packets_storage         packets_;
+    // In-process receivers of each out edge
+    const std::unique_ptr<direct_edge_t[]>  direct_;
+    bool                                    has_direct_ = false;
 
     void reconnect(const boost::system::error_code& e, tcp_write_proto_t::guard_t guard) {
         BOOST_ASSERT_MSG(guard, "Empty guard in error handler");
         auto& link = edge_t::link_from_guard(guard);
         // TODO: async log issue
 
+        edges_[link.helper_id()].on_link_error(guard);
         link.async_reconnect(std::move(guard)); // TODO: dealy?
     }
 
@@ -110,7 +52,7 @@ class node_impl_write_n: public virtual node_base_t {
 
     void on_operation_finished(tcp_write_proto_t::guard_t guard) {
         auto& link = edge_t::link_from_guard(guard);
-        packets_.send_success(link.packet.second);
+        link.packet.clear();
         const auto id = link.helper_id();
         edges_[id].try_steal_work(std::move(guard));
     }
@@ -118,7 +60,7 @@ class node_impl_write_n: public virtual node_base_t {
 public:
     node_impl_write_n()
         : edges_count_(count_out_edges())
-        , packets_(edges_count_)
+        , direct_(boost::make_unique<direct_edge_t[]>(edges_count_))
     {
         edges_.init(edges_count_);
 
@@ -131,14 +73,19 @@ public:
             const vertex_t& out_vertex = config[boost::target(*edges_it, config)];
 
             const auto hosts_count = out_vertex.hosts.size();
-            edges_.inplace_construct(i, edge_id_for_receiver(i));
+            if (is_wave_affine_receiver(i)) {
+                edges_.inplace_construct_derived<edge_out_exact_t<shared_packet_t>>(i, edge_id_for_receiver(i), out_vertex.hosts);
+            } else {
+                edges_.inplace_construct_derived<edge_out_balanced_t<shared_packet_t>>(i, edge_id_for_receiver(i));
+            }
             edges_[i].preinit_links(hosts_count);
             for (std::size_t j = 0; j < hosts_count; ++j) {
                 const auto& host = out_vertex.hosts[j];
+                direct_[i].add_host(host.first, host.second);
+                has_direct_ = has_direct_ || is_direct_link_allowed(host.first);
                 edges_[i].inplace_construct_link(
                     j,
-                    host.first.c_str(),
-                    host.second,
+                    make_link_endpoint(host.first, host.second),
                     ios(),
                     [this](const auto& e, auto guard, tcp_write_proto_t::send_error_tag) { on_send_error(e, std::move(guard)); },
                     [this](auto guard) { on_operation_finished(std::move(guard)); },
@@ -146,24 +93,63 @@ public:
                     i
                 );
             }
+            edges_[i].set_on_unloaded([this]() { on_write_unloaded(); });
+            edges_[i].register_metrics(metrics(), with_label(with_label(metric_labels(), "edge", std::to_string(i)), "to", out_vertex.node_id));
+#if DMN_TRACING
+            edges_[i].set_tracer(tracer());
+#endif
             edges_[i].connect_links();
         }
     }
 
+    bool is_write_overloaded() const noexcept final {
+        for (const auto& edge: edges_) {
+            if (edge.overloaded()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     void on_packet_accept(packet_t packet) final {
 
         BOOST_ASSERT_MSG(!packet.empty(), "Attempt to send an empty packet, even without a header");
 
         auto response_packet = call_callback(std::move(packet));
         const packet_header_t header = response_packet.header();
-        packet_network_t data{ std::move(response_packet) };
-        const auto body = packets_.add_packet(std::move(data));
+        const shared_body_ptr_t body = make_shared_body(packet_network_t{ std::move(response_packet) });
+
+        // In-process receivers share the body with the links, no serialization
+        boost::container::small_vector<bool, 16> sent_directly;
+        if (has_direct_) {
+            sent_directly.resize(edges_count_, false);
+            for (std::size_t i = 0; i < edges_count_; ++i) {
+                if (!direct_[i].has_receivers()) {
+                    continue;
+                }
+
+                auto header_cpy = header;
+                header_cpy.edge_id = edges_[i].edge_id_for_receiver();
+                shared_packet_t p{header_cpy, body};
+                sent_directly[i] = direct_[i].try_push(p, edges_[i].preferred_link(header.wave_id));
+                if (sent_directly[i]) {
+                    edges_[i].on_sent_directly();
+                    DMN_TRACE_INSTANT(tracer(), "sent_directly", header.wave_id);
+                }
+            }
+        }
 
-        for (auto& edge: edges_) {
+        for (std::size_t i = 0; i < edges_count_; ++i) {
+            if (has_direct_ && sent_directly[i]) {
+                continue;
+            }
+
+            auto& edge = edges_[i];
             auto header_cpy = header;
             header_cpy.edge_id = edge.edge_id_for_receiver(); // TODO: big/little endian
 
-            edge.push(header.wave_id, {header_cpy, body});
+            DMN_TRACE_INSTANT(tracer(), "queued", header.wave_id);
+            edge.push(header.wave_id, shared_packet_t{header_cpy, body});
         }
     }
 
@@ -7,6 +7,148 @@
 
 namespace dmn {
 
+namespace {
+
+struct section_header_t {
+    std::uint32_t slots_count;      // power of 2
+    std::uint32_t fields_count;
+    std::uint32_t records_size;
+};
+
+struct directory_slot_t {
+    std::uint32_t type_hash;        // field_id_t for interned records
+    std::uint32_t record_offset;    // from the beginning of section records, `interned_flag` bit marks field_id_t records
+};
+
+constexpr std::uint32_t empty_slot_offset = 0xFFFFFFFFu;
+constexpr std::uint32_t interned_flag = 0x80000000u;
+constexpr std::uint32_t initial_slots_count = 4;
+
+// Sections and records are not aligned, so all the reads and writes go through memcpy
+template <class T>
+T load(const unsigned char* p) noexcept {
+    T v; // intentionally unintialized
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+template <class T>
+void store(unsigned char* p, const T& v) noexcept {
+    std::memcpy(p, &v, sizeof(v));
+}
+
+std::size_t directory_size(std::uint32_t slots_count) noexcept {
+    return sizeof(section_header_t) + slots_count * sizeof(directory_slot_t);
+}
+
+void clear_slots(unsigned char* slots, std::uint32_t slots_count) noexcept {
+    for (std::uint32_t i = 0; i < slots_count; ++i) {
+        store(slots + i * sizeof(directory_slot_t), directory_slot_t{0, empty_slot_offset});
+    }
+}
+
+// Linear probing. Directory must have at least one free slot.
+void directory_insert(unsigned char* slots, std::uint32_t slots_count, directory_slot_t v) noexcept {
+    const std::uint32_t mask = slots_count - 1;
+    for (std::uint32_t i = v.type_hash & mask;; i = (i + 1) & mask) {
+        unsigned char* const slot = slots + i * sizeof(directory_slot_t);
+        if (load<directory_slot_t>(slot).record_offset == empty_slot_offset) {
+            store(slot, v);
+            return;
+        }
+    }
+}
+
+void grow_directory(packet_storage_t& data, std::size_t section_pos) {
+    auto section = load<section_header_t>(data.data() + section_pos);
+    std::vector<directory_slot_t> old_slots;
+    old_slots.reserve(section.fields_count);
+    for (std::uint32_t i = 0; i < section.slots_count; ++i) {
+        const auto slot = load<directory_slot_t>(data.data() + section_pos + sizeof(section_header_t) + i * sizeof(directory_slot_t));
+        if (slot.record_offset != empty_slot_offset) {
+            old_slots.push_back(slot);
+        }
+    }
+
+    const std::uint32_t new_slots_count = section.slots_count * 2;
+    data.insert(
+        data.begin() + section_pos + directory_size(section.slots_count),
+        (new_slots_count - section.slots_count) * sizeof(directory_slot_t),
+        0
+    );
+    section.slots_count = new_slots_count;
+    store(data.data() + section_pos, section);
+
+    unsigned char* const slots = data.data() + section_pos + sizeof(section_header_t);
+    clear_slots(slots, new_slots_count);
+    for (const auto& slot: old_slots) {
+        directory_insert(slots, new_slots_count, slot);
+    }
+}
+
+// Searches all the sections of the INDEXED packet body for a record for which `match(slot, record)` returns true.
+template <class Match>
+std::pair<const unsigned char*, std::size_t> find_indexed(const unsigned char* section, const unsigned char* const data_end, std::uint32_t hash, Match match) noexcept {
+    while (section != data_end) {
+        const auto s = load<section_header_t>(section);
+        const unsigned char* const slots = section + sizeof(section_header_t);
+        const unsigned char* const records = section + directory_size(s.slots_count);
+        BOOST_ASSERT_MSG(records + s.records_size <= data_end, "Data overflow after getting section's directory");
+
+        const std::uint32_t mask = s.slots_count - 1;
+        for (std::uint32_t i = hash & mask;; i = (i + 1) & mask) {
+            const auto slot = load<directory_slot_t>(slots + i * sizeof(directory_slot_t));
+            if (slot.record_offset == empty_slot_offset) {
+                break;
+            }
+
+            const unsigned char* record = records + (slot.record_offset & ~interned_flag);
+            if (slot.type_hash != hash || !match(slot, record)) {
+                continue;
+            }
+
+            if (!(slot.record_offset & interned_flag)) {
+                record += sizeof(std::uint32_t) + load<std::uint32_t>(record);
+            }
+            const auto data_len = load<std::uint32_t>(record);
+            record += sizeof(std::uint32_t);
+            BOOST_ASSERT_MSG(record + data_len <= data_end, "Data overflow after getting message");
+            return {record, data_len};
+        }
+
+        section = records + s.records_size;
+    }
+
+    return { nullptr, 0u };
+}
+
+std::pair<const unsigned char*, std::size_t> get_data_linear(const unsigned char* data, const unsigned char* const data_end, const char* type, std::uint32_t type_len) noexcept {
+    while (data != data_end) {
+        std::uint32_t current_type_len; // intentionally unintialized
+        std::memcpy(&current_type_len, data, sizeof(std::uint32_t));
+        data += sizeof(std::uint32_t);
+        BOOST_ASSERT_MSG(data < data_end, "Data overflow after getting size of message's type");
+
+        const bool found = (current_type_len == type_len && !std::memcmp(data, type, type_len));
+        data += current_type_len;
+        BOOST_ASSERT_MSG(data < data_end, "Data overflow after getting message's type");
+
+        std::uint32_t current_data_len; // intentionally unintialized
+        std::memcpy(&current_data_len, data, sizeof(std::uint32_t));
+        data += sizeof(std::uint32_t);
+        BOOST_ASSERT_MSG(data <= data_end, "Data overflow after getting message");
+
+        if (found) {
+            return {data, current_data_len};
+        }
+        data += current_data_len;
+    }
+
+    return { nullptr, 0u };
+}
+
+} // anonymous namespace
+
 void packet_t::place_header() {
     if (!data_.empty()) {
         return;
@@ -20,6 +162,28 @@ void packet_t::place_header() {
 void packet_t::add_data(const unsigned char* data, std::uint32_t size, const char* type) {
     place_header();
     BOOST_ASSERT_MSG(type, "Empty message type. This must be handled in stream_t!");
+
+    const std::uint32_t type_len = std::strlen(type);
+    if (header().version == packet_layout_enum::LINEAR) {
+        flatten();  // Records are appended to the end of the body
+        add_data_linear(data, size, type, type_len);
+    } else {
+        own_body();
+        add_data_indexed(data, size, type, type_len);
+    }
+    update_size();
+}
+
+void packet_t::update_size() noexcept {
+    std::size_t size = data_.size() - sizeof(packet_header_t) + body_slice_.size;
+    for (const auto& segment: segments_) {
+        const auto body = body_range(segment.storage, segment.slice);
+        size += body.second - body.first;
+    }
+    header().size = static_cast<std::uint32_t>(size);
+}
+
+void packet_t::add_data_linear(const unsigned char* data, std::uint32_t size, const char* type, std::uint32_t type_len) {
     constexpr auto range = [](const std::uint32_t& v) noexcept {
         return std::make_pair(
             reinterpret_cast<const unsigned char*>(&v),
@@ -27,7 +191,6 @@ void packet_t::add_data(const unsigned char* data, std::uint32_t size, const cha
         );
     };
 
-    const std::uint32_t type_len = std::strlen(type);
     data_.reserve(
         (
             data_.size()
@@ -39,7 +202,107 @@ void packet_t::add_data(const unsigned char* data, std::uint32_t size, const cha
     data_.insert(data_.end(), type, type + type_len);
     data_.insert(data_.end(), range(size).first, range(size).second);
     data_.insert(data_.end(), data, data + size);
-    header().size = data_.size() - sizeof(header());
+}
+
+void packet_t::add_data(const unsigned char* data, std::uint32_t size, field_id_t id) {
+    place_header();
+    BOOST_ASSERT_MSG(header().version == packet_layout_enum::INDEXED, "Interned field types are supported only by INDEXED packets");
+
+    own_body();
+    unsigned char* record = insert_indexed_record(static_cast<std::uint32_t>(id), true, sizeof(std::uint32_t) + size);
+    store(record, size);
+    std::memcpy(record + sizeof(std::uint32_t), data, size);
+    update_size();
+}
+
+void packet_t::add_data_indexed(const unsigned char* data, std::uint32_t size, const char* type, std::uint32_t type_len) {
+    unsigned char* record = insert_indexed_record(
+        field_hash(type, type_len),
+        false,
+        sizeof(std::uint32_t) + type_len + sizeof(std::uint32_t) + size
+    );
+
+    store(record, type_len);
+    record += sizeof(std::uint32_t);
+    std::memcpy(record, type, type_len);
+    record += type_len;
+    store(record, size);
+    record += sizeof(std::uint32_t);
+    std::memcpy(record, data, size);
+}
+
+unsigned char* packet_t::insert_indexed_record(std::uint32_t type_hash, bool interned, std::size_t record_size) {
+    // Always adding to the first section, sections are independent. Bodies of the merged packets
+    // stay in their segments, so only the data after the first section of `data_` (if any) is moved.
+    constexpr std::size_t section_pos = sizeof(packet_header_t);
+    if (data_.size() == section_pos) {
+        data_.resize(section_pos + directory_size(initial_slots_count));
+        store(data_.data() + section_pos, section_header_t{initial_slots_count, 0, 0});
+        clear_slots(data_.data() + section_pos + sizeof(section_header_t), initial_slots_count);
+    }
+
+    auto section = load<section_header_t>(data_.data() + section_pos);
+    if ((section.fields_count + 1) * 2 > section.slots_count) { // Keeping load factor below 0.5
+        grow_directory(data_, section_pos);
+        section = load<section_header_t>(data_.data() + section_pos);
+    }
+    BOOST_ASSERT_MSG(section.records_size + record_size < interned_flag, "Packet section is too big");
+
+    const std::size_t record_pos = section_pos + directory_size(section.slots_count) + section.records_size;
+    data_.insert(data_.begin() + record_pos, record_size, 0);
+
+    directory_insert(
+        data_.data() + section_pos + sizeof(section_header_t),
+        section.slots_count,
+        directory_slot_t{type_hash, section.records_size | (interned ? interned_flag : 0u)}
+    );
+    ++section.fields_count;
+    section.records_size += record_size;
+    store(data_.data() + section_pos, section);
+
+    return data_.data() + record_pos;
+}
+
+void packet_t::own_body() {
+    if (!body_slice_.data) {
+        return;
+    }
+
+    data_.insert(data_.end(), body_slice_.data, body_slice_.data + body_slice_.size);
+    body_slice_ = buffer_slice_t{};
+}
+
+void packet_t::flatten() {
+    if (segments_.empty() && !body_slice_.data) {
+        return;
+    }
+
+    std::size_t total_size = data_.size() + body_slice_.size;
+    for (const auto& segment: segments_) {
+        const auto body = body_range(segment.storage, segment.slice);
+        total_size += body.second - body.first;
+    }
+
+    data_.reserve(total_size);
+    own_body();
+    for (const auto& segment: segments_) {
+        const auto body = body_range(segment.storage, segment.slice);
+        data_.insert(data_.end(), body.first, body.second);
+    }
+    segments_.clear();
+    BOOST_ASSERT_MSG(data_.size() - sizeof(packet_header_t) == header().size, "Flattened packet size missmatch");
+}
+
+template <class Find>
+std::pair<const unsigned char*, std::size_t> packet_t::find_in_bodies(Find find) const noexcept {
+    const auto body = body_range(data_, body_slice_);
+    auto res = find(body.first, body.second);
+    for (auto it = segments_.cbegin(); !res.first && it != segments_.cend(); ++it) {
+        const auto segment_body = body_range(it->storage, it->slice);
+        res = find(segment_body.first, segment_body.second);
+    }
+
+    return res;
 }
 
 std::pair<const unsigned char*, std::size_t> packet_t::get_data(const char* type) const noexcept {
@@ -49,32 +312,35 @@ std::pair<const unsigned char*, std::size_t> packet_t::get_data(const char* type
     }
 
     const std::uint32_t type_len = std::strlen(type);
-    const unsigned char* data = data_.data() + sizeof(header());
-    const unsigned char* const data_end = data_.data() + data_.size();
-
-    while (data != data_end) {
-        std::uint32_t current_type_len; // intentionally unintialized
-        std::memcpy(&current_type_len, data, sizeof(std::uint32_t));
-        data += sizeof(std::uint32_t);
-        BOOST_ASSERT_MSG(data < data_end, "Data overflow after getting size of message's type");
-
-        const bool found = (current_type_len == type_len && !std::memcmp(data, type, type_len));
-        data += current_type_len;
-        BOOST_ASSERT_MSG(data < data_end, "Data overflow after getting message's type");
+    if (header().version == packet_layout_enum::LINEAR) {
+        return find_in_bodies([type, type_len](const unsigned char* body, const unsigned char* body_end) {
+            return get_data_linear(body, body_end, type, type_len);
+        });
+    }
 
-        std::uint32_t current_data_len; // intentionally unintialized
-        std::memcpy(&current_data_len, data, sizeof(std::uint32_t));
-        data += sizeof(std::uint32_t);
-        BOOST_ASSERT_MSG(data <= data_end, "Data overflow after getting message");
+    BOOST_ASSERT_MSG(header().version == packet_layout_enum::INDEXED, "Unknown packet version");
+    const std::uint32_t hash = field_hash(type, type_len);
+    return find_in_bodies([hash, type, type_len](const unsigned char* body, const unsigned char* body_end) {
+        return find_indexed(body, body_end, hash, [type, type_len](directory_slot_t slot, const unsigned char* record) {
+            if (slot.record_offset & interned_flag) {
+                return false;
+            }
+            return load<std::uint32_t>(record) == type_len && !std::memcmp(record + sizeof(std::uint32_t), type, type_len);
+        });
+    });
+}
 
-        if (found) {
-            return {data, current_data_len};
-        }
-        data += current_data_len;
+std::pair<const unsigned char*, std::size_t> packet_t::get_data(field_id_t id) const noexcept {
+    if (data_.empty() || header().version != packet_layout_enum::INDEXED) {
+        return { nullptr, 0u };
     }
 
-    return { nullptr, 0u };
+    const std::uint32_t hash = static_cast<std::uint32_t>(id);
+    return find_in_bodies([hash](const unsigned char* body, const unsigned char* body_end) {
+        return find_indexed(body, body_end, hash, [](directory_slot_t slot, const unsigned char* /*record*/) {
+            return !!(slot.record_offset & interned_flag);
+        });
+    });
 }
 
-
 } // namespace dmn
@@ -4,34 +4,111 @@
 #include <cstring>
 #include <vector>
 #include <boost/assert.hpp>
+#include "field_tag.hpp"
+#include "impl/buffer_pool.hpp"
+#include "impl/shared_buffer.hpp"
 
 namespace dmn {
 
 enum class packet_types_enum: std::uint16_t {
     DATA,
     SHUTDOWN_GRACEFULLY,
+
+    // Sent by the reader back to the writer over the same link. Body is an uint32 count
+    // of packets the writer is allowed to send in addition to the already granted ones.
+    CREDIT,
+
+    // DATA of a wave that expired before all of its parts were gathered. Never sent over links.
+    PARTIAL_DATA,
+};
+
+// Wave id is {16 bit host id, 16 bit epoch, 32 bit sequence}. Source starts with an epoch taken
+// from the clock and bumps it on each wrap of the sequence, so ids of a source do not repeat
+// while parts of its waves may still be gathered.
+enum class wave_id_t : std::uint64_t {};
+
+constexpr wave_id_t make_wave_id(std::uint16_t host, std::uint16_t epoch, std::uint32_t sequence) noexcept {
+    return static_cast<wave_id_t>(
+        (std::uint64_t{host} << 48) | (std::uint64_t{epoch} << 32) | sequence
+    );
+}
+
+constexpr std::uint16_t wave_host(wave_id_t wave) noexcept {
+    return static_cast<std::uint16_t>(static_cast<std::uint64_t>(wave) >> 48);
+}
+
+constexpr std::uint16_t wave_epoch(wave_id_t wave) noexcept {
+    return static_cast<std::uint16_t>(static_cast<std::uint64_t>(wave) >> 32);
+}
+
+constexpr std::uint32_t wave_sequence(wave_id_t wave) noexcept {
+    return static_cast<std::uint32_t>(static_cast<std::uint64_t>(wave));
+}
+
+// Body layout of the packet. Value is also the version of the header: 1 and 2 were used
+// by the 16 byte headers with 32 bit wave ids, packets_reader_t upgrades them on receive.
+enum class packet_layout_enum: std::uint16_t {
+    // Body is a sequence of records {uint32 type length, type, uint32 data length, data}.
+    LINEAR = 3,
+
+    // Body is a sequence of sections, one per merged packet part. Each section starts with
+    // a field directory (open addressing hash table of {type hash, record offset}) followed
+    // by records in the LINEAR format. Lookup is O(1) per section.
+    // Records of fields with field_id_t type are just {uint32 data length, data}, the id is
+    // stored only in the directory.
+    INDEXED = 4,
 };
 
-enum class wave_id_t : std::uint32_t {};
+constexpr bool is_supported_version(packet_layout_enum version) noexcept {
+    return version == packet_layout_enum::LINEAR || version == packet_layout_enum::INDEXED;
+}
 
 struct packet_header_t {
-    std::uint16_t       version = 1;
+    packet_layout_enum  version = packet_layout_enum::INDEXED;
     packet_types_enum   packet_type = packet_types_enum::DATA;
     std::uint16_t       edge_id = 0;
-    wave_id_t           wave_id; // TODO:
+    std::uint16_t       reserved = 0;
     std::uint32_t       size = 0;
+    wave_id_t           wave_id{};
 };
+static_assert(sizeof(packet_header_t) == 24, "Packet header must have no padding");
 
-using packet_storage_t = std::vector<unsigned char>;
+using packet_storage_t = std::vector<unsigned char, pool_allocator<unsigned char>>;
 
 class packet_t {
 protected:
+    // Header, followed by the body unless the body is in `body_slice_`
     packet_storage_t data_;
 
+    // Body of a received packet that stays in the receive buffer. Moved into `data_` before
+    // the body is resized.
+    buffer_slice_t body_slice_;
+
+    struct segment_t {
+        packet_storage_t    storage;    // Header, followed by the body unless the body is in `slice`
+        buffer_slice_t      slice;
+    };
+
+    // Merged packets, each one with its own header. Their bodies are logically appended
+    // to the body of the packet and are copied into `data_` only by flatten().
+    std::vector<segment_t> segments_;
+
 
     void clear() noexcept {
         data_.clear();
+        body_slice_ = buffer_slice_t{};
+        segments_.clear();
+    }
+
+    static std::pair<const unsigned char*, const unsigned char*> body_range(const packet_storage_t& storage, const buffer_slice_t& slice) noexcept {
+        if (slice.data) {
+            return {slice.data, slice.data + slice.size};
+        }
+        return {storage.data() + sizeof(packet_header_t), storage.data() + storage.size()};
     }
+
+    // Copies the body from the receive buffer into `data_`
+    void own_body();
 public:
 
     void place_header();
@@ -43,6 +120,28 @@ public:
     void add_data(const unsigned char* data, std::uint32_t size, const char* type);
     std::pair<const unsigned char*, std::size_t> get_data(const char* type) const noexcept;
 
+    void add_data(const unsigned char* data, std::uint32_t size, field_id_t id);
+    std::pair<const unsigned char*, std::size_t> get_data(field_id_t id) const noexcept;
+
+    // For in place updates of the node's own fixed size fields
+    std::pair<unsigned char*, std::size_t> get_mutable_data(field_id_t id) noexcept {
+        const auto res = static_cast<const packet_t&>(*this).get_data(id);
+        return {const_cast<unsigned char*>(res.first), res.second};
+    }
+
+private:
+    void add_data_linear(const unsigned char* data, std::uint32_t size, const char* type, std::uint32_t type_len);
+    void add_data_indexed(const unsigned char* data, std::uint32_t size, const char* type, std::uint32_t type_len);
+    unsigned char* insert_indexed_record(std::uint32_t type_hash, bool interned, std::size_t record_size);
+
+    // Sets the header size to the size of all the bodies, including the merged segments
+    void update_size() noexcept;
+
+    template <class Find>
+    std::pair<const unsigned char*, std::size_t> find_in_bodies(Find find) const noexcept;
+
+public:
+
     packet_t() = default;
     packet_t(packet_t&& ) noexcept = default;
     packet_t& operator=(packet_t&&) noexcept = default;
@@ -51,7 +150,24 @@ public:
         : data_(std::move(storage))
     {}
 
+    // Packet with a body in the receive buffer, `header` is the storage of the header only
+    packet_t(packet_storage_t&& header, buffer_slice_t&& body) noexcept
+        : data_(std::move(header))
+        , body_slice_(std::move(body))
+    {
+        BOOST_ASSERT_MSG(data_.size() == sizeof(packet_header_t), "Storage must hold only the header");
+    }
+
+    bool is_segmented() const noexcept {
+        return !segments_.empty();
+    }
+
+    // Copies bodies of all the merged packets and the body from the receive buffer into a single contiguous storage
+    void flatten();
+
     const packet_storage_t& raw_storage() const noexcept {
+        BOOST_ASSERT_MSG(!is_segmented(), "Attempt to get contiguous storage of a segmented packet. Call flatten() first");
+        BOOST_ASSERT_MSG(!body_slice_.data, "Attempt to get contiguous storage of a packet with body in the receive buffer. Call flatten() first");
         return data_;
     }
 
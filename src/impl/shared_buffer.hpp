@@ -0,0 +1,71 @@
+#pragma once
+
+#include "impl/buffer_pool.hpp"
+#include "utility.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <boost/assert.hpp>
+#include <boost/intrusive_ptr.hpp>
+
+namespace dmn {
+
+// Receive buffer that is shared by the packets parsed out of it. Each packet references its own
+// part of the buffer, so the buffer is returned to the pool with the last of those packets.
+class shared_buffer_t {
+    DMN_PINNED(shared_buffer_t);
+
+    std::atomic<std::size_t>    refs_{0};
+    const std::size_t           size_;
+
+    explicit shared_buffer_t(std::size_t size) noexcept
+        : size_(size)
+    {}
+
+    ~shared_buffer_t() = default;
+
+public:
+    // Buffer occupies exactly `allocation_size` bytes of the pool, including this header
+    static boost::intrusive_ptr<shared_buffer_t> make(std::size_t allocation_size) {
+        BOOST_ASSERT_MSG(allocation_size > sizeof(shared_buffer_t), "Buffer allocation is too small");
+        void* p = buffer_pool_allocate(allocation_size);
+        return boost::intrusive_ptr<shared_buffer_t>{
+            new (p) shared_buffer_t{allocation_size - sizeof(shared_buffer_t)}
+        };
+    }
+
+    unsigned char* data() noexcept {
+        return reinterpret_cast<unsigned char*>(this + 1);
+    }
+
+    std::size_t size() const noexcept {
+        return size_;
+    }
+
+    // No packets reference the buffer, so it may be overwritten
+    bool unique() const noexcept {
+        return refs_.load(std::memory_order_acquire) == 1;
+    }
+
+    friend void intrusive_ptr_add_ref(shared_buffer_t* p) noexcept {
+        p->refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    friend void intrusive_ptr_release(shared_buffer_t* p) noexcept {
+        if (p->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            p->~shared_buffer_t();
+            buffer_pool_deallocate(p);
+        }
+    }
+};
+
+// Part of a shared buffer that belongs to a single packet. Bytes are not shared with other
+// packets, so they may be modified in place.
+struct buffer_slice_t {
+    boost::intrusive_ptr<shared_buffer_t>   buffer;
+    unsigned char*                          data = nullptr;
+    std::size_t                             size = 0;
+};
+
+} // namespace dmn
@@ -1,58 +1,189 @@
 #pragma once
 
+#include <atomic>
 #include <deque>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <type_traits>
 #include <boost/optional.hpp>
 #include "utility.hpp"
 
 namespace dmn {
 
-template <class T>
+// Multiple producers multiple consumers queue. Common path is a lock free bounded ring
+// (D. Vyukov's MPMC queue): push and pop are a single CAS each. Rare paths take a mutex:
+// - silent_push_front(), used only for rescheduling packets after a send error;
+// - overflow of the ring. Once it overflowed, all the pushes go into the overflow storage
+//   till it is drained, even if the ring has free cells again.
+// Values of each producer are popped in FIFO order: the overflow is drained only after all the
+// claimed cells of the ring. Values of producers that push concurrently with the overflow may be
+// reordered relative to each other, as if they were pushed in another order.
+// try_pop() may return nothing while a producer is in the middle of a push, producers must
+// recheck for a free consumer after the push.
+template <class T, std::size_t Capacity = 1024>
 class alignas(hardware_destructive_interference_size) silent_mt_queue {
     DMN_PINNED(silent_mt_queue);
 
-    std::mutex      data_mutex_;
-    std::deque<T>   data_;
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of 2");
+
+    struct cell_t {
+        std::atomic<std::size_t>                                sequence;
+        std::aligned_storage_t<sizeof(T), alignof(T)>           storage;
+
+        T& value() noexcept {
+            return *reinterpret_cast<T*>(&storage);
+        }
+    };
+
+    const std::unique_ptr<cell_t[]>    cells_;
+
+    alignas(hardware_destructive_interference_size) std::atomic<std::size_t> enqueue_pos_{0};
+    alignas(hardware_destructive_interference_size) std::atomic<std::size_t> dequeue_pos_{0};
+
+    // Packets pushed to front and ring overflow. Counters allow to skip the mutex when those are empty.
+    alignas(hardware_destructive_interference_size) std::atomic<std::size_t> front_size_{0};
+    std::atomic<std::size_t>    overflow_size_{0};
+    std::mutex                  slow_path_mutex_;
+    std::deque<T>               front_;
+    std::deque<T>               overflow_;
+
+    bool ring_try_push(T& value);
+    bool ring_try_pop(boost::optional<T>& ret);
 
 public:
     using value_type = T;
 
-    silent_mt_queue() = default;
+    silent_mt_queue();
+    ~silent_mt_queue();
 
     inline void silent_push(T value);
     inline void silent_push_front(T value);
 
     inline boost::optional<T> try_pop();
+
+    // Not exact while pushes and pops are in progress. Used by the consumers to recheck for the
+    // packets pushed while they were finishing.
+    bool empty() const noexcept {
+        return enqueue_pos_.load() == dequeue_pos_.load() && !front_size_.load() && !overflow_size_.load();
+    }
 };
 
-template <class T>
-void silent_mt_queue<T>::silent_push(T value) {
-    // TODO: deal with that by using intrusive slist
-    //static_assert(sizeof(silent_mt_queue<T>) <= hardware_constructive_interference_size, "");
+template <class T, std::size_t Capacity>
+silent_mt_queue<T, Capacity>::silent_mt_queue()
+    : cells_(new cell_t[Capacity])
+{
+    for (std::size_t i = 0; i < Capacity; ++i) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
 
-    std::lock_guard<std::mutex> lock(data_mutex_);
-    data_.push_back(std::move(value));
+template <class T, std::size_t Capacity>
+silent_mt_queue<T, Capacity>::~silent_mt_queue() {
+    boost::optional<T> ignore;
+    while (ring_try_pop(ignore)) {
+        ignore.reset();
+    }
 }
 
+// Moves out the value only on success
+template <class T, std::size_t Capacity>
+bool silent_mt_queue<T, Capacity>::ring_try_push(T& value) {
+    std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    cell_t* cell;
+    for (;;) {
+        cell = &cells_[pos & (Capacity - 1)];
+        const std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;   // Full
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
 
-template <class T>
-void silent_mt_queue<T>::silent_push_front(T value) {
-    // TODO: deal with that by using intrusive slist
-    //static_assert(sizeof(silent_mt_queue<T>) <= hardware_constructive_interference_size, "");
+    new (&cell->storage) T(std::move(value));
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
 
-    std::lock_guard<std::mutex> lock(data_mutex_);
-    data_.push_front(std::move(value));
+template <class T, std::size_t Capacity>
+bool silent_mt_queue<T, Capacity>::ring_try_pop(boost::optional<T>& ret) {
+    std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    cell_t* cell;
+    for (;;) {
+        cell = &cells_[pos & (Capacity - 1)];
+        const std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+        if (diff == 0) {
+            if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;   // Empty or the producer has not finished the push yet
+        } else {
+            pos = dequeue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+
+    ret.emplace(std::move(cell->value()));
+    cell->value().~T();
+    cell->sequence.store(pos + Capacity, std::memory_order_release);
+    return true;
+}
+
+template <class T, std::size_t Capacity>
+void silent_mt_queue<T, Capacity>::silent_push(T value) {
+    if (!overflow_size_.load(std::memory_order_acquire) && ring_try_push(value)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(slow_path_mutex_);
+    overflow_.push_back(std::move(value));
+    overflow_size_.fetch_add(1, std::memory_order_release);
+}
+
+template <class T, std::size_t Capacity>
+void silent_mt_queue<T, Capacity>::silent_push_front(T value) {
+    std::lock_guard<std::mutex> lock(slow_path_mutex_);
+    front_.push_front(std::move(value));
+    front_size_.fetch_add(1, std::memory_order_release);
 }
 
-template <class T>
-boost::optional<T> silent_mt_queue<T>::try_pop() {
+template <class T, std::size_t Capacity>
+boost::optional<T> silent_mt_queue<T, Capacity>::try_pop() {
     boost::optional<T> ret;
 
-    {
-        std::lock_guard<std::mutex> lock(data_mutex_);
-        if (!data_.empty()) {
-            ret.emplace(std::move(data_.front()));
-            data_.pop_front();
+    if (front_size_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(slow_path_mutex_);
+        if (!front_.empty()) {
+            ret.emplace(std::move(front_.front()));
+            front_.pop_front();
+            front_size_.fetch_sub(1, std::memory_order_release);
+            return ret;
+        }
+    }
+
+    if (ring_try_pop(ret)) {
+        return ret;
+    }
+
+    // Cell of the ring may be claimed by a producer that did not finish the push yet. Its value
+    // goes before the overflow, and the producer rechecks for a consumer after the push.
+    if (enqueue_pos_.load(std::memory_order_acquire) != dequeue_pos_.load(std::memory_order_acquire)) {
+        return ret;
+    }
+
+    if (overflow_size_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(slow_path_mutex_);
+        if (!overflow_.empty()) {
+            ret.emplace(std::move(overflow_.front()));
+            overflow_.pop_front();
+            overflow_size_.fetch_sub(1, std::memory_order_release);
         }
     }
 
@@ -0,0 +1,219 @@
+#include "impl/tracing.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+#include <boost/assert.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+namespace dmn {
+
+namespace {
+    std::mutex                                  rings_mutex;
+    std::vector<std::unique_ptr<trace_ring_t>>  rings;
+
+    std::atomic<std::uint64_t>                  next_tracer_id{1};
+
+    void escape_json(std::ostream& out, const std::string& value) {
+        for (char c: value) {
+            switch (c) {
+            case '\\': out << "\\\\"; break;
+            case '"': out << "\\\""; break;
+            case '\n': out << "\\n"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out << ' ';
+                } else {
+                    out << c;
+                }
+            }
+        }
+    }
+
+    struct merged_event_t {
+        std::size_t pid;
+        std::string ph;
+        std::string name;
+        std::uint64_t tid;
+        std::string ts;     // Numbers are copied as is, to keep the precision
+        std::string dur;
+        std::string wave;
+        double      ts_us;
+    };
+
+    // Chrome trace timestamps are in microseconds
+    void write_us(std::ostream& out, std::uint64_t ns) {
+        out << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000 << std::setfill(' ');
+    }
+}
+
+trace_ring_t::trace_ring_t(std::uint32_t thread_id)
+    : events_(new trace_event_t[capacity])
+    , thread_id_(thread_id)
+{}
+
+trace_ring_t& trace_ring_t::this_thread() {
+    thread_local trace_ring_t* const ring = []() {
+        std::lock_guard<std::mutex> l(rings_mutex);
+        rings.push_back(std::unique_ptr<trace_ring_t>(new trace_ring_t(static_cast<std::uint32_t>(rings.size() + 1))));
+        return rings.back().get();
+    }();
+    return *ring;
+}
+
+wave_tracer_t::wave_tracer_t(std::uint32_t sample_every, std::string process_name)
+    : id_(next_tracer_id.fetch_add(1, std::memory_order_relaxed))
+    , sample_every_(sample_every)
+    , process_name_(std::move(process_name))
+{}
+
+void wave_tracer_t::write(std::ostream& out) const {
+    std::vector<std::pair<std::uint32_t, trace_event_t>> events;
+    {
+        std::lock_guard<std::mutex> l(rings_mutex);
+        for (const auto& ring: rings) {
+            ring->for_each([this, &ring, &events](const trace_event_t& e) {
+                if (e.tracer_id == id_) {
+                    events.emplace_back(ring->thread_id(), e);
+                }
+            });
+        }
+    }
+    std::stable_sort(events.begin(), events.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.second.start_ns < rhs.second.start_ns;
+    });
+
+    // Process id is unique within the process only, merge_traces() renumbers the processes
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+        << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << id_ << ",\"tid\":0,\"args\":{\"name\":\"";
+    escape_json(out, process_name_);
+    out << "\"}}";
+
+    for (const auto& te: events) {
+        const trace_event_t& e = te.second;
+        out << ",\n{\"ph\":\"" << (e.duration_ns ? 'X' : 'i') << "\",\"cat\":\"dmn\",\"name\":\"" << e.name
+            << "\",\"pid\":" << id_ << ",\"tid\":" << te.first << ",\"ts\":";
+        write_us(out, e.start_ns);
+        if (e.duration_ns) {
+            out << ",\"dur\":";
+            write_us(out, e.duration_ns);
+        } else {
+            out << ",\"s\":\"t\"";
+        }
+        // Wave ids do not fit into the double precision of JSON numbers
+        out << ",\"args\":{\"wave\":\"" << static_cast<std::uint64_t>(e.wave) << "\"}}";
+    }
+    out << "\n]}\n";
+}
+
+void wave_tracer_t::write(const std::string& path) const {
+    std::ofstream out{path, std::ios::trunc};
+    write(out);
+}
+
+void merge_traces(const std::vector<std::string>& paths, std::ostream& out, boost::optional<wave_id_t> only_wave) {
+    namespace pt = boost::property_tree;
+
+    std::vector<std::pair<std::size_t, std::string>> processes;
+    std::vector<merged_event_t> events;
+    const std::string wave_filter = only_wave ? std::to_string(static_cast<std::uint64_t>(*only_wave)) : std::string{};
+
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        const std::size_t pid = i + 1;
+        pt::ptree trace;
+        pt::read_json(paths[i], trace);
+
+        const auto trace_events = trace.get_child_optional("traceEvents");
+        if (!trace_events) {
+            throw std::runtime_error("No traceEvents in '" + paths[i] + "'");
+        }
+
+        processes.emplace_back(pid, paths[i]);
+        for (const auto& child: *trace_events) {
+            const pt::ptree& e = child.second;
+            const std::string ph = e.get<std::string>("ph", "");
+            if (ph == "M") {
+                if (e.get<std::string>("name", "") == "process_name") {
+                    processes.back().second = e.get<std::string>("args.name", paths[i]);
+                }
+                continue;
+            }
+
+            // Numbers are parsed to make sure that they are numbers, throws on malformed ones
+            merged_event_t m{pid, ph, e.get<std::string>("name", ""), e.get<std::uint64_t>("tid", 0), e.get<std::string>("ts", "0"),
+                e.get<std::string>("dur", ""), e.get<std::string>("args.wave", ""), e.get<double>("ts", 0.0)};
+            if (!m.dur.empty()) {
+                e.get<double>("dur");
+            }
+            if (!wave_filter.empty() && m.wave != wave_filter) {
+                continue;
+            }
+            events.push_back(std::move(m));
+        }
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](const merged_event_t& lhs, const merged_event_t& rhs) {
+        return lhs.ts_us < rhs.ts_us;
+    });
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    const char* separator = "\n";
+    for (const auto& p: processes) {
+        out << separator << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << p.first << ",\"tid\":0,\"args\":{\"name\":\"";
+        escape_json(out, p.second);
+        out << "\"}}";
+        separator = ",\n";
+    }
+
+    std::map<std::string, std::vector<const merged_event_t*>> waves;
+    for (const auto& e: events) {
+        out << separator << "{\"ph\":\"";
+        escape_json(out, e.ph);
+        out << "\",\"cat\":\"dmn\",\"name\":\"";
+        escape_json(out, e.name);
+        out << "\",\"pid\":" << e.pid << ",\"tid\":" << e.tid << ",\"ts\":" << e.ts;
+        if (!e.dur.empty()) {
+            out << ",\"dur\":" << e.dur;
+        }
+        if (e.ph == "i") {
+            out << ",\"s\":\"t\"";
+        }
+        out << ",\"args\":{\"wave\":\"";
+        escape_json(out, e.wave);
+        out << "\"}}";
+        separator = ",\n";
+
+        if (!e.wave.empty()) {
+            waves[e.wave].push_back(&e);
+        }
+    }
+
+    // Flow arrows from each event of a wave to the next one, across the nodes
+    for (const auto& w: waves) {
+        const auto& wave_events = w.second;
+        if (wave_events.size() < 2) {
+            continue;
+        }
+
+        for (std::size_t i = 0; i < wave_events.size(); ++i) {
+            const merged_event_t& e = *wave_events[i];
+            const char* ph = (i == 0 ? "s" : (i + 1 == wave_events.size() ? "f" : "t"));
+            out << separator << "{\"ph\":\"" << ph << "\",\"cat\":\"wave\",\"name\":\"wave\",\"id\":\"";
+            escape_json(out, w.first);
+            out << "\",\"pid\":" << e.pid << ",\"tid\":" << e.tid << ",\"ts\":" << e.ts;
+            if (*ph == 'f') {
+                out << ",\"bp\":\"e\"";
+            }
+            out << '}';
+        }
+    }
+    out << "\n]}\n";
+}
+
+} // namespace dmn
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "impl/latency.hpp"
+#include "impl/packet.hpp"
+#include "utility.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/optional.hpp>
+
+// Sampled tracing of waves in the Chrome trace event format, viewable in chrome://tracing and
+// ui.perfetto.dev. Compiled in only with the DMN_TRACING build option. Otherwise the DMN_TRACE_* macros
+// expand to nothing and their arguments are not evaluated, so the hot paths do not pay for tracing.
+#if DMN_TRACING
+#   define DMN_TRACE_CONCAT_IMPL(a, b) a ## b
+#   define DMN_TRACE_CONCAT(a, b) DMN_TRACE_CONCAT_IMPL(a, b)
+
+    // Event with the duration of the enclosing scope. `tracer` is a pointer, nullptr disables the event.
+#   define DMN_TRACE_SPAN(tracer, name, wave) \
+        const ::dmn::trace_span_t DMN_TRACE_CONCAT(dmn_trace_span_, __LINE__){(tracer), (name), (wave)}
+
+#   define DMN_TRACE_INSTANT(tracer, name, wave) \
+        do { if (tracer) { (tracer)->instant((name), (wave)); } } while (false)
+#else
+#   define DMN_TRACE_SPAN(tracer, name, wave) static_cast<void>(0)
+#   define DMN_TRACE_INSTANT(tracer, name, wave) static_cast<void>(0)
+#endif
+
+namespace dmn {
+
+struct trace_event_t {
+    std::uint64_t   tracer_id = 0;
+    const char*     name = nullptr;     // String literal
+    wave_id_t       wave{};
+    std::uint64_t   start_ns = 0;
+    std::uint64_t   duration_ns = 0;    // 0 for the instant events
+};
+
+// Lock free ring of the events of a single thread. Only the owning thread writes, the oldest events are
+// overwritten. Rings of the finished threads are kept till the process exit, so their events are flushed too.
+class trace_ring_t {
+    DMN_PINNED(trace_ring_t);
+
+public:
+    static constexpr std::size_t capacity = 1 << 14;
+
+private:
+    const std::unique_ptr<trace_event_t[]>  events_;
+    std::atomic<std::uint64_t>              head_{0};
+    const std::uint32_t                     thread_id_;
+
+public:
+    explicit trace_ring_t(std::uint32_t thread_id);
+
+    // Ring of the calling thread, created on the first call
+    static trace_ring_t& this_thread();
+
+    std::uint32_t thread_id() const noexcept {
+        return thread_id_;
+    }
+
+    void push(const trace_event_t& e) noexcept {
+        const std::uint64_t head = head_.load(std::memory_order_relaxed);
+        events_[head % capacity] = e;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    // Owning thread must not push meanwhile
+    template <class F>
+    void for_each(F f) const {
+        const std::uint64_t head = head_.load(std::memory_order_acquire);
+        for (std::uint64_t i = (head > capacity ? head - capacity : 0); i < head; ++i) {
+            f(events_[i % capacity]);
+        }
+    }
+};
+
+// Tracer of a node. Waves are sampled by the hash of their id, so that all the nodes of a graph trace
+// the same waves and the traces of different nodes could be merged by the wave id (see merge_traces()).
+class wave_tracer_t {
+    DMN_PINNED(wave_tracer_t);
+
+    const std::uint64_t id_;
+    const std::uint32_t sample_every_;
+    const std::string   process_name_;
+
+public:
+    // Traces one of `sample_every` waves, 0 disables tracing
+    wave_tracer_t(std::uint32_t sample_every, std::string process_name);
+
+    static bool is_sampled(wave_id_t wave, std::uint32_t sample_every) noexcept {
+        if (!sample_every) {
+            return false;
+        }
+
+        std::uint64_t x = static_cast<std::uint64_t>(wave); // splitmix64 finalizer
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x % sample_every == 0;
+    }
+
+    bool sampled(wave_id_t wave) const noexcept {
+        return is_sampled(wave, sample_every_);
+    }
+
+    void instant(const char* name, wave_id_t wave) const noexcept {
+        if (sampled(wave)) {
+            trace_ring_t::this_thread().push(trace_event_t{id_, name, wave, timestamp_now(), 0});
+        }
+    }
+
+    void complete(const char* name, wave_id_t wave, std::uint64_t start_ns, std::uint64_t end_ns) const noexcept {
+        if (sampled(wave)) {
+            trace_ring_t::this_thread().push(trace_event_t{id_, name, wave, start_ns, (end_ns > start_ns ? end_ns - start_ns : 1)});
+        }
+    }
+
+    // Chrome trace JSON with the events of this tracer from all the threads. Threads that
+    // trace must be idle, for example the io_context of the node must be stopped.
+    void write(std::ostream& out) const;
+    void write(const std::string& path) const;
+};
+
+class trace_span_t {
+    DMN_PINNED(trace_span_t);
+
+    const wave_tracer_t* const  tracer_;
+    const char* const           name_;
+    const wave_id_t             wave_;
+    const std::uint64_t         start_ns_;
+
+public:
+    trace_span_t(const wave_tracer_t* tracer, const char* name, wave_id_t wave) noexcept
+        : tracer_(tracer && tracer->sampled(wave) ? tracer : nullptr)
+        , name_(name)
+        , wave_(wave)
+        , start_ns_(tracer_ ? timestamp_now() : 0)
+    {}
+
+    ~trace_span_t() {
+        if (tracer_) {
+            tracer_->complete(name_, wave_, start_ns_, timestamp_now());
+        }
+    }
+};
+
+// Merges the traces written by wave_tracer_t into a single Chrome trace. Each input becomes a separate
+// process and the events of each wave are linked by the flow arrows in the order of their timestamps.
+// If `only_wave` is set, events of the other waves are skipped. Throws std::runtime_error on malformed inputs.
+void merge_traces(const std::vector<std::string>& paths, std::ostream& out, boost::optional<wave_id_t> only_wave = boost::none);
+
+} // namespace dmn
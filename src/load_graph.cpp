@@ -1,4 +1,5 @@
 #include "load_graph.hpp"
+#include "impl/net/stream_endpoint.hpp"
 
 #include <boost/graph/graphviz.hpp>
 #include <boost/property_map/property_map.hpp>
@@ -187,9 +188,16 @@ static std::istream& operator>>(std::istream& in, hosts_strong_t& hosts) {
     std::vector<std::string> hosts_with_port;
     boost::split(hosts_with_port, hosts_raw, boost::is_any_of(";"), boost::token_compress_on);
     for (auto& v: hosts_with_port) {
+        boost::trim_left(v);
+        if (is_unix_host(v) || is_shm_host(v)) {
+            // "unix:/run/dmn/b.sock" or "shm:/run/dmn/b.sock" - port is meaningless for AF_UNIX sockets
+            hosts.base().emplace_back(std::move(v), 0);
+            continue;
+        }
+
         const auto delim = v.find(':');
         hosts.base().emplace_back(
-            boost::trim_left_copy(v.substr(0, v.find(':'))),
+            v.substr(0, delim),
             (delim == std::string::npos ? 63101 : boost::lexical_cast<unsigned short>(v.substr(delim + 1)))
         );
     }
@@ -198,6 +206,10 @@ static std::istream& operator>>(std::istream& in, hosts_strong_t& hosts) {
 
 static std::ostream& operator<<(std::ostream& os, const hosts_strong_t& hosts) {
     for (const auto& h : hosts.base()) {
+        if (is_unix_host(h.first) || is_shm_host(h.first)) {
+            os << h.first << ';';
+            continue;
+        }
         os << h.first << ':' << h.second << ';';
     }
     return os;
@@ -1,7 +1,11 @@
 #include "node_base.hpp"
 
 #include "load_graph.hpp"
+#include <cstring>
+#include <fstream>
 #include <istream>
+#include <mutex>
+#include <stdexcept>
 
 #include "impl/node_parts/read_0.hpp"
 #include "impl/node_parts/read_1.hpp"
@@ -9,12 +13,26 @@
 #include "impl/node_parts/write_0.hpp"
 #include "impl/node_parts/write_1.hpp"
 #include "impl/node_parts/write_n.hpp"
+#include "impl/net/metrics_endpoint.hpp"
 
 #include <boost/make_unique.hpp>
 
 namespace dmn {
 
 namespace {
+    std::mutex              partial_waves_limits_mutex;
+    partial_waves_limits_t  partial_waves_limits_value;
+
+    std::mutex                  metrics_endpoint_mutex;
+    metrics_endpoint_config_t   metrics_endpoint_value;
+
+    std::mutex                  latency_tracking_mutex;
+    latency_tracking_config_t   latency_tracking_value;
+    std::mutex                  latency_dump_mutex;        // Nodes of a process may share the dump file
+
+    std::mutex                  tracing_mutex;
+    tracing_config_t            tracing_value;
+
     auto get_this_node_descriptor(const graph_t& g, const char* node_id) {
         BOOST_ASSERT_MSG(node_id, "Searching for node without ID. Error in load_graph function or in make_node");
         const auto vds = vertices(g);
@@ -29,13 +47,147 @@ namespace {
     }
 }
 
+void set_partial_waves_limits(partial_waves_limits_t limits) {
+    if (limits.timeout.count() <= 0) {
+        throw std::runtime_error("Timeout of partial waves must be positive");
+    }
+    if (limits.policy == partial_waves_policy_enum::CALLBACK && !limits.on_expired) {
+        throw std::runtime_error("CALLBACK policy of partial waves requires on_expired");
+    }
+
+    std::lock_guard<std::mutex> l(partial_waves_limits_mutex);
+    partial_waves_limits_value = std::move(limits);
+}
+
+partial_waves_limits_t partial_waves_limits() {
+    std::lock_guard<std::mutex> l(partial_waves_limits_mutex);
+    return partial_waves_limits_value;
+}
+
+void set_metrics_endpoint(metrics_endpoint_config_t config) {
+    std::lock_guard<std::mutex> l(metrics_endpoint_mutex);
+    metrics_endpoint_value = config;
+}
+
+metrics_endpoint_config_t metrics_endpoint_config() {
+    std::lock_guard<std::mutex> l(metrics_endpoint_mutex);
+    return metrics_endpoint_value;
+}
+
+void set_latency_tracking(latency_tracking_config_t config) {
+    std::lock_guard<std::mutex> l(latency_tracking_mutex);
+    latency_tracking_value = std::move(config);
+}
+
+latency_tracking_config_t latency_tracking_config() {
+    std::lock_guard<std::mutex> l(latency_tracking_mutex);
+    return latency_tracking_value;
+}
+
+void set_tracing(tracing_config_t config) {
+#if !DMN_TRACING
+    if (config.sample_every) {
+        throw std::runtime_error("Tracing is compiled out, rebuild with the DMN_TRACING option");
+    }
+#endif
+
+    std::lock_guard<std::mutex> l(tracing_mutex);
+    tracing_value = std::move(config);
+}
+
+tracing_config_t tracing_config() {
+    std::lock_guard<std::mutex> l(tracing_mutex);
+    return tracing_value;
+}
+
 node_base_t::node_base_t(boost::asio::io_context& ios, graph_t in, const char* node_id, std::uint16_t host_id)
     : node_t{ios}
     , config(std::move(in))
     , this_node_descriptor(get_this_node_descriptor(config, node_id))
     , this_node(config[this_node_descriptor])
     , host_id_(host_id)
-{}
+    , metric_labels_{{"node", node_id}, {"host", std::to_string(host_id)}}
+    , is_sink_(boost::out_degree(this_node_descriptor, config) == 0)
+    , latency_dump_path_(latency_tracking_config().dump_path)
+#if DMN_TRACING
+    , trace_path_(tracing_config().output_dir + "/" + node_id + "." + std::to_string(host_id) + ".trace.json")
+#endif
+{
+    metrics_registrations_.push_back(
+        metrics_.add_counter("dmn_callback_calls_total", "Calls of the node callback", metric_labels_, callback_calls_)
+    );
+
+    if (latency_tracking_config().enabled) {
+        latency_ = boost::make_unique<latency_stats_t>();
+        register_latency_metrics();
+    }
+
+#if DMN_TRACING
+    const tracing_config_t tracing = tracing_config();
+    if (tracing.sample_every) {
+        tracer_ = boost::make_unique<wave_tracer_t>(tracing.sample_every, std::string{node_id} + " host=" + std::to_string(host_id));
+    }
+#endif
+
+    const metrics_endpoint_config_t endpoint = metrics_endpoint_config();
+    if (endpoint.enabled) {
+        metrics_endpoint_ = boost::make_unique<metrics_endpoint_t>(ios, metrics_, endpoint.port);
+    }
+}
+
+boost::optional<std::uint16_t> node_base_t::metrics_port() const noexcept {
+    if (!metrics_endpoint_) {
+        return boost::none;
+    }
+    return metrics_endpoint_->port();
+}
+
+void node_base_t::register_latency_metrics() {
+    const std::pair<const char*, double> quantiles[] = {{"0.5", 0.5}, {"0.99", 0.99}, {"0.999", 0.999}};
+    for (unsigned i = 0; i < static_cast<unsigned>(latency_stage_enum::COUNT_); ++i) {
+        const auto& histogram = (*latency_)[static_cast<latency_stage_enum>(i)];
+        const metric_labels_t labels = with_label(metric_labels_, "stage", to_string(static_cast<latency_stage_enum>(i)));
+        for (const auto& q: quantiles) {
+            const double value = q.second;
+            metrics_registrations_.push_back(metrics_.add_gauge("dmn_latency_seconds", "Latency percentiles of the wave processing stages", with_label(labels, "quantile", q.first), [&histogram, value]() {
+                return static_cast<double>(histogram.percentile(value)) / 1e9;
+            }));
+        }
+        metrics_registrations_.push_back(metrics_.add(
+            "dmn_latency_samples_total", "Measurements of the wave processing stages",
+            metrics_registry_t::type_enum::COUNTER, labels,
+            [&histogram]() { return static_cast<double>(histogram.count()); }
+        ));
+    }
+}
+
+void node_base_t::on_wave_created(packet_t& p) {
+    if (!latency_) {
+        return;
+    }
+
+    wave_timestamps_t ts;
+    ts.created_ns = ts.sent_ns = ts.accepted_ns = timestamp_now();
+    p.add_data(reinterpret_cast<const unsigned char*>(&ts), sizeof(ts), wave_timestamps_field);
+}
+
+void node_base_t::single_threaded_io_detach_base() noexcept {
+    if (metrics_endpoint_) {
+        metrics_endpoint_->close();
+    }
+
+    if (latency_ && !latency_dump_path_.empty()) {
+        std::lock_guard<std::mutex> l(latency_dump_mutex);
+        std::ofstream out{latency_dump_path_, std::ios::app};
+        latency_->dump(out, "node=" + this_node.node_id + " host=" + std::to_string(host_id_));
+    }
+
+#if DMN_TRACING
+    if (tracer_) {
+        tracer_->write(trace_path_);
+    }
+#endif
+}
 
 std::uint16_t node_base_t::edge_id_for_receiver(std::uint16_t out_edge_index) {
     auto edges_out = boost::out_edges(
@@ -99,12 +251,45 @@ std::uint16_t node_base_t::count_out_edges() const noexcept {
 }
 
 packet_t node_base_t::call_callback(packet_t packet) {
+    callback_calls_.add(1);
+    DMN_TRACE_SPAN(tracer(), "callback", packet.header().wave_id);
+    if (latency_) {
+        const auto field = packet.get_data(wave_timestamps_field);
+        if (field.second == sizeof(wave_timestamps_t)) {
+            wave_timestamps_t ts;
+            std::memcpy(&ts, field.first, sizeof(ts));
+            return call_callback_timed(std::move(packet), ts);
+        }
+    }
+
     stream_t s{*this, std::move(packet)};
 
     node_base_t::callback_(s);
     return s.move_out_data();
 }
 
+packet_t node_base_t::call_callback_timed(packet_t packet, const wave_timestamps_t& ts) {
+    const std::uint64_t start = timestamp_now();
+    (*latency_)[latency_stage_enum::QUEUEING].record(ts.accepted_ns, start);
+
+    stream_t s{*this, std::move(packet)};
+    node_base_t::callback_(s);
+    packet_t out = s.move_out_data();
+
+    const std::uint64_t end = timestamp_now();
+    (*latency_)[latency_stage_enum::CALLBACK].record(start, end);
+    if (is_sink_) {
+        (*latency_)[latency_stage_enum::END_TO_END].record(ts.created_ns, end);
+        return out;
+    }
+
+    wave_timestamps_t out_ts;
+    out_ts.created_ns = ts.created_ns;
+    out_ts.sent_ns = end;
+    out.add_data(reinterpret_cast<const unsigned char*>(&out_ts), sizeof(out_ts), wave_timestamps_field);
+    return out;
+}
+
 node_base_t::~node_base_t() noexcept = default;
 
 
@@ -125,6 +310,7 @@ struct node_in_x_out_x final: Read, Write {
         BOOST_ASSERT_MSG(Write::ios().stopped(), "Running single_threaded_io_detach() while ios() is not stopped is forbidden!");
         Read::single_threaded_io_detach_read();
         Write::single_threaded_io_detach_write();
+        node_base_t::single_threaded_io_detach_base();
     }
 
     ~node_in_x_out_x() noexcept = default;
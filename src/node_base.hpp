@@ -2,17 +2,23 @@
 
 #include "node.hpp"
 #include "load_graph.hpp"
+#include "impl/latency.hpp"
+#include "impl/metrics.hpp"
 #include "impl/packet.hpp"
 #include "impl/state_tracker.hpp"
+#include "impl/tracing.hpp"
 
 #include <memory>
 #include <atomic>
+#include <chrono>
 #include <functional>
 #include <boost/dll/shared_library.hpp>
+#include <boost/optional/optional.hpp>
 
 namespace dmn {
 
 class stream_t;
+class metrics_endpoint_t;
 
 class node_base_t: public node_t {
     DMN_PINNED(node_base_t);
@@ -28,6 +34,47 @@ public:
     using callback_t = std::function<void(stream_t&)>;
     callback_t callback_{};
 
+private:
+    metrics_registry_t                      metrics_;
+    const metric_labels_t                   metric_labels_;
+    metrics_counter_t                       callback_calls_;
+    const bool                              is_sink_;
+    std::unique_ptr<latency_stats_t>        latency_;           // Set if latency tracking is enabled
+    const std::string                       latency_dump_path_;
+    metrics_registry_t::registrations_t     metrics_registrations_;
+    std::unique_ptr<metrics_endpoint_t>     metrics_endpoint_;
+#if DMN_TRACING
+    std::unique_ptr<wave_tracer_t>          tracer_;            // Set if tracing is enabled
+    const std::string                       trace_path_;
+#endif
+
+    void register_latency_metrics();
+    packet_t call_callback_timed(packet_t packet, const wave_timestamps_t& ts);
+
+protected:
+    // Closes the metrics endpoint, dumps the latency histograms and the trace
+    void single_threaded_io_detach_base() noexcept;
+
+#if DMN_TRACING
+    // For the DMN_TRACE_* macros, nullptr if tracing is disabled
+    const wave_tracer_t* tracer() const noexcept {
+        return tracer_.get();
+    }
+#endif
+
+    // Source puts the timestamps into the new wave
+    void on_wave_created(packet_t& p);
+
+    // Read parts account the network time of each received packet
+    template <class Packet>
+    void on_packet_received(Packet& p) noexcept {
+        if (latency_) {
+            latency_->on_received(p.get_mutable_data(wave_timestamps_field));
+        }
+    }
+
+public:
+
     // Functions:
     node_base_t(boost::asio::io_context& ios, graph_t in, const char* node_id, std::uint16_t host_id);
 
@@ -36,12 +83,95 @@ public:
     std::uint16_t count_in_edges_for_receiver(std::uint16_t out_edge_index) const noexcept;
     std::uint16_t count_out_edges() const noexcept;
 
+    // Thread safe. Parts of the node, edges and links register their metrics here.
+    metrics_registry_t& metrics() noexcept {
+        return metrics_;
+    }
+
+    // Labels that identify metrics of this node: {node, host}
+    const metric_labels_t& metric_labels() const noexcept {
+        return metric_labels_;
+    }
+
+    // Port of the metrics endpoint, if it is enabled
+    boost::optional<std::uint16_t> metrics_port() const noexcept;
+
+    // Thread safe. Latency histograms of the node, nullptr if latency tracking is disabled.
+    const latency_stats_t* latency_stats() const noexcept {
+        return latency_.get();
+    }
+
+    // Receiver gathers waves from multiple in-edges, so all the parts of a wave must be sent to one of its hosts
+    bool is_wave_affine_receiver(std::uint16_t out_edge_index) const noexcept {
+        return count_in_edges_for_receiver(out_edge_index) > 1;
+    }
+
     virtual void on_packet_accept(packet_t packet) = 0;
+
+    // Backpressure between parts of the node. Write part reports that too much data waits for sending,
+    // read part stops accepting new packets till on_write_unloaded() is called.
+    virtual bool is_write_overloaded() const noexcept = 0;
+    virtual void on_write_unloaded() = 0;
+
     packet_t call_callback(packet_t packet);
     virtual void single_threaded_io_detach() noexcept = 0;
     virtual ~node_base_t() noexcept;
 };
 
+enum class partial_waves_policy_enum {
+    DROP,           // Parts are dropped
+    EMIT_PARTIAL,   // Parts are passed to the node callback, stream_t::is_partial() returns true
+    CALLBACK,       // Parts are passed to partial_waves_limits_t::on_expired
+};
+
+// Limits for the waves that did not get all of their parts on nodes with multiple in-edges
+struct partial_waves_limits_t {
+    std::chrono::milliseconds   timeout{10000};
+    std::size_t                 max_bytes = 256 << 20;      // Oldest partial waves are evicted when exceeded
+    partial_waves_policy_enum   policy = partial_waves_policy_enum::DROP;
+    std::function<void(packet_t)> on_expired{};             // Called on one of the io_context threads
+};
+
+// Limits for the nodes that are created after the call
+void set_partial_waves_limits(partial_waves_limits_t limits);
+partial_waves_limits_t partial_waves_limits();
+
+// HTTP endpoint with the metrics of a node in the Prometheus text format, served by the io_context
+// of the node at http://127.0.0.1:<port>/metrics. Nodes of the same process need different ports.
+struct metrics_endpoint_config_t {
+    bool            enabled = false;
+    std::uint16_t   port = 9464;    // 0 picks a free port, see node_base_t::metrics_port()
+};
+
+// Config for the nodes that are created after the call
+void set_metrics_endpoint(metrics_endpoint_config_t config);
+metrics_endpoint_config_t metrics_endpoint_config();
+
+// Latency from the sources to the sinks and per vertex. Sources put timestamps into the waves, each vertex
+// accounts the network, queueing and callback time of the packets and passes the timestamps further.
+// Results are available via node_base_t::latency_stats() and as the metrics of the node.
+struct latency_tracking_config_t {
+    bool        enabled = false;
+    std::string dump_path{};    // If set, summaries are appended to the file when the node is detached
+};
+
+// Config for the nodes that are created after the call. Must be the same for all the nodes of a graph.
+void set_latency_tracking(latency_tracking_config_t config);
+latency_tracking_config_t latency_tracking_config();
+
+// Sampled tracing of the waves, requires the DMN_TRACING build option. Each node records when the
+// sampled waves were received, gathered, processed by the callback, queued and written to the links.
+// Traces of different nodes are merged by the wave id with the dmn_trace_merge tool.
+struct tracing_config_t {
+    std::uint32_t   sample_every = 0;   // Traces one of `sample_every` waves, 0 disables tracing
+    std::string     output_dir = ".";   // Node writes <output_dir>/<node>.<host>.trace.json when detached
+};
+
+// Config for the nodes that are created after the call. Must be the same for all the nodes of a graph.
+// Throws std::runtime_error if tracing is requested, but was compiled out.
+void set_tracing(tracing_config_t config);
+tracing_config_t tracing_config();
+
 std::unique_ptr<node_base_t> make_node(boost::asio::io_context& ios, const std::string& in, const char* node_id, std::uint16_t host_id);
 
 }
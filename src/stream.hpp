@@ -1,6 +1,7 @@
 #pragma once
 
 #include "node_base.hpp"
+#include "field_tag.hpp"
 #include "impl/packet.hpp"
 
 namespace dmn {
@@ -23,6 +24,11 @@ public:
         out_data_.header().wave_id = in_data_.header().wave_id;
     }
 
+    // Input is a part of the wave that expired before all of its parts were gathered
+    bool is_partial() const noexcept {
+        return in_data_.header().packet_type == packet_types_enum::PARTIAL_DATA;
+    }
+
     packet_t&& move_out_data() noexcept {
         return std::move(out_data_);
     }
@@ -40,6 +46,16 @@ public:
         }
         return { in_data_.get_data(type) };
     }
+
+    template <field_id_t Id>
+    void add(const void* data, std::size_t size) {
+        out_data_.add_data(static_cast<const unsigned char*>(data), size, Id);
+    }
+
+    template <field_id_t Id>
+    std::pair<const void*, std::size_t> get_data() const noexcept {
+        return { in_data_.get_data(Id) };
+    }
 };
 
 }
@@ -1,7 +1,9 @@
 #include "nodes_tester.hpp"
 
 #include <boost/asio/io_service.hpp>
+#include <boost/algorithm/string/replace.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/make_unique.hpp>
 #include <thread>
@@ -48,6 +50,11 @@ void nodes_tester_t::set_seq_and_ethalon() {
 
 void nodes_tester_t::generate_sequence(void* s_void) const {
     dmn::stream_t& s = *static_cast<dmn::stream_t*>(s_void);
+    if (bench_mode_) {
+        s.add(bench_payload_.data(), bench_payload_.size(), "payload");
+        return;
+    }
+
     const int seq = sequence_counter_.fetch_add(1);
 
     if (seq < max_seq_) {
@@ -62,6 +69,12 @@ void nodes_tester_t::generate_sequence(void* s_void) const {
 
 void nodes_tester_t::remember_sequence(void* s_void) const {
     dmn::stream_t& s = *static_cast<dmn::stream_t*>(s_void);
+    if (bench_mode_) {
+        bench_packets_.fetch_add(1, std::memory_order_relaxed);
+        bench_bytes_.fetch_add(s.get_data("payload").second, std::memory_order_relaxed);
+        return;
+    }
+
     for (const char* data_type: {"seq", "seq0", "seq1", "seq2", "seq3", "seq4", "seq5", "seq6", "seq7", "seq8", "seq9", "seq10"}) {
         const auto data = s.get_data(data_type);
         if (data.second == 0) {
@@ -110,8 +123,9 @@ void nodes_tester_t::remember_sequence(void* s_void) const {
 
 void nodes_tester_t::resend_sequence(void* s_void) const {
     dmn::stream_t& s = *static_cast<dmn::stream_t*>(s_void);
-    const auto data = s.get_data("seq");
-    s.add(data.first, data.second, "seq");
+    const char* type = (bench_mode_ ? "payload" : "seq");
+    const auto data = s.get_data(type);
+    s.add(data.first, data.second, type);
 }
 
 
@@ -127,6 +141,9 @@ void nodes_tester_t::run_impl(boost::asio::io_context& ios) {
                 } catch (shutdown_generator g) {
                     ok_to_restart = true;
                 }
+
+                // Benchmark is stopped by its timer only
+                ok_to_restart = ok_to_restart || (bench_mode_ && !ios.stopped());
             } while (ok_to_restart);
 
         } catch (const std::exception& e) {
@@ -272,6 +289,14 @@ void nodes_tester_t::validate_results() const {
     }
 }
 
+// Every node renders metrics of all of its parts
+void nodes_tester_t::validate_metrics() const {
+    for (const auto& n: nodes_) {
+        const std::string metrics = n->metrics().render();
+        MT_BOOST_TEST(metrics.find("dmn_callback_calls_total{node=\"") != std::string::npos);
+    }
+}
+
 void nodes_tester_t::test(start_order order) {
     set_seq_and_ethalon();
     {
@@ -280,6 +305,7 @@ void nodes_tester_t::test(start_order order) {
         init_nodes_by(order, ios);
 
         run_impl(ios);
+        validate_metrics();
     }
 
     nodes_.clear();
@@ -380,6 +406,58 @@ void nodes_tester_t::test_death(percent match_in_param) {
     validate_results();
 }
 
+bench_result_t nodes_tester_t::bench(std::chrono::milliseconds duration) {
+    test_function_called_ = true;
+    bench_mode_ = true;
+    bench_packets_ = 0;
+    bench_bytes_ = 0;
+
+    bench_result_t res;
+    {
+        // Only the timestamps are needed, nodes are measured by the sinks
+        const dmn::latency_tracking_config_t latency_config = dmn::latency_tracking_config();
+        dmn::set_latency_tracking({true, ""});
+        boost::asio::io_context ios{threads_count_};
+        nodes_guard ng{ios, nodes_};
+        init_nodes_by(start_order::node_host, ios);
+        dmn::set_latency_tracking(latency_config);
+
+        std::uint64_t warm_packets = 0;
+        std::uint64_t warm_bytes = 0;
+        std::chrono::steady_clock::time_point warm_time{};
+        boost::asio::steady_timer warmup_timer{ios};
+        warmup_timer.expires_after(duration / 10);
+        warmup_timer.async_wait([&](const boost::system::error_code& /*e*/) {
+            warm_time = std::chrono::steady_clock::now();
+            warm_packets = bench_packets_.load();
+            warm_bytes = bench_bytes_.load();
+        });
+
+        boost::asio::steady_timer stop_timer{ios};
+        stop_timer.expires_after(duration / 10 + duration);
+        stop_timer.async_wait([&](const boost::system::error_code& /*e*/) {
+            res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - warm_time).count();
+            res.packets = bench_packets_.load() - warm_packets;
+            res.payload_bytes = bench_bytes_.load() - warm_bytes;
+            ios.stop();
+        });
+
+        run_impl(ios);
+
+        dmn::latency_histogram_t end_to_end;
+        for (const auto& n: nodes_) {
+            if (const dmn::latency_stats_t* stats = n->latency_stats()) {
+                end_to_end.merge((*stats)[dmn::latency_stage_enum::END_TO_END]);
+            }
+        }
+        res.end_to_end = end_to_end.summary();
+    }
+
+    nodes_.clear();
+    bench_mode_ = false;
+    return res;
+}
+
 namespace {
     bool is_port_in_use(unsigned short port) noexcept {
         static boost::asio::io_context ios;
@@ -436,6 +514,20 @@ nodes_tester_t::nodes_tester_t(const graph_t& graph, std::initializer_list<node_
     nodes_.reserve(params_.size());
 }
 
+nodes_tester_t& nodes_tester_t::transport(transport_t t) {
+    switch (t) {
+    case transport_t::in_process:
+        break;
+    case transport_t::unix_socket:
+        boost::replace_all(graph_, "127.0.0.1:", "unix:/tmp/dmn_tests_");
+        break;
+    case transport_t::shared_memory:
+        boost::replace_all(graph_, "127.0.0.1:", "shm:/tmp/dmn_tests_");
+        break;
+    }
+    return *this;
+}
+
 nodes_tester_t::~nodes_tester_t() noexcept {
     BOOST_TEST(test_function_called_);
 }
@@ -5,9 +5,12 @@
 #include <memory>
 #include <mutex>
 #include <atomic>
+#include <chrono>
+#include <string>
 #include <boost/test/unit_test.hpp>
 #include <boost/test/data/test_case.hpp>
 #include <boost/asio/io_context.hpp>
+#include "impl/latency.hpp"
 
 namespace dmn {
     class node_base_t;
@@ -40,6 +43,12 @@ enum class start_order: int {
 
 enum class percent: int {};
 
+enum class transport_t {
+    in_process,     // nodes of the same process talk directly, others via loopback
+    unix_socket,
+    shared_memory,
+};
+
 template <class T>
 constexpr auto operator*(percent lhs, T value) {
     return static_cast<double>(lhs) / 100 * value;
@@ -69,6 +78,14 @@ inline bool operator==(node_name_and_host_id lhs, node_name_and_host_id rhs) noe
     return !std::strcmp(lhs.node_name, rhs.node_name) && lhs.host_id == rhs.host_id;
 }
 
+// Throughput of a graph measured by nodes_tester_t::bench()
+struct bench_result_t {
+    double                  seconds = 0;
+    std::uint64_t           packets = 0;        // Callbacks of the sinks
+    std::uint64_t           payload_bytes = 0;  // Payload received by the sinks
+    dmn::latency_summary_t  end_to_end{};       // Of all the sinks, includes the warmup
+};
+
 class nodes_tester_t {
     nodes_tester_t(const nodes_tester_t&) = delete;
     nodes_tester_t& operator=(const nodes_tester_t&) = delete;
@@ -105,7 +122,14 @@ class nodes_tester_t {
     void init_nodes_by_node_hosts_reverse(boost::asio::io_context& ios);
     void init_nodes_by_hosts_node(boost::asio::io_context& ios);
 
+    // Sources generate waves with a payload till the time is out, see bench()
+    bool bench_mode_ = false;
+    std::string bench_payload_ = std::string(256, 'x');
+    mutable std::atomic<std::uint64_t> bench_packets_{0};
+    mutable std::atomic<std::uint64_t> bench_bytes_{0};
+
     void validate_results() const;
+    void validate_metrics() const;
 public:
     nodes_tester_t(const links_t& links, std::initializer_list<node_params> params);
     nodes_tester_t(const graph_t& graph, std::initializer_list<node_params> params);
@@ -125,11 +149,22 @@ public:
         return *this;
     }
 
+    nodes_tester_t& transport(transport_t t);
+
+    // Payload of each wave in bench()
+    nodes_tester_t& payload(std::size_t bytes) {
+        bench_payload_.assign(bytes, 'x');
+        return *this;
+    }
+
     void test(start_order order = start_order::node_host);
     void test_cancellation(start_order order = start_order::node_host);
     void test_immediate_cancellation(start_order order = start_order::node_host);
     void test_death(percent match);
 
+    // Runs the graph for `duration` after a warmup of duration / 10, results are for the `duration` only
+    bench_result_t bench(std::chrono::milliseconds duration);
+
     ~nodes_tester_t() noexcept;
 };
 
@@ -1,4 +1,12 @@
 #include "nodes_tester.hpp"
+#include "node_base.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <boost/property_tree/json_parser.hpp>
 
 BOOST_AUTO_TEST_SUITE(read_1_write_1)
 
@@ -20,6 +28,158 @@ BOOST_DATA_TEST_CASE(hosts_x_threads,
 }
 
 
+BOOST_DATA_TEST_CASE(shared_memory_hosts_x_threads,
+    (boost::unit_test::data::xrange(1, 8) * boost::unit_test::data::xrange(1, 5)),
+    hosts_num, threads_count
+) {
+    nodes_tester_t{
+        tests::links_t{"a -> b -> c"},
+        {
+            {"a", actions::generate, hosts_count_from_num<0>(hosts_num)},
+            {"b", actions::resend, hosts_count_from_num<1>(hosts_num)},
+            {"c", actions::remember, hosts_count_from_num<2>(hosts_num)},
+        }
+    }
+    .threads(threads_count)
+    .sequence_max(256)
+    .transport(tests::transport_t::shared_memory)
+    .test();
+}
+
+BOOST_DATA_TEST_CASE(unix_socket_hosts_x_threads,
+    (boost::unit_test::data::xrange(1, 8) * boost::unit_test::data::xrange(1, 5)),
+    hosts_num, threads_count
+) {
+    nodes_tester_t{
+        tests::links_t{"a -> b -> c"},
+        {
+            {"a", actions::generate, hosts_count_from_num<0>(hosts_num)},
+            {"b", actions::resend, hosts_count_from_num<1>(hosts_num)},
+            {"c", actions::remember, hosts_count_from_num<2>(hosts_num)},
+        }
+    }
+    .threads(threads_count)
+    .sequence_max(256)
+    .transport(tests::transport_t::unix_socket)
+    .test();
+}
+
+BOOST_AUTO_TEST_CASE(transports_comparison) {
+    auto run = [](tests::transport_t transport) {
+        nodes_tester_t t{
+            tests::links_t{"a -> b -> c"},
+            {
+                {"a", actions::generate, 1},
+                {"b", actions::resend, 1},
+                {"c", actions::remember, 1},
+            }
+        };
+        t.threads(2).sequence_max(1 << 14).transport(transport);
+
+        const auto start = std::chrono::steady_clock::now();
+        t.test();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    const auto sockets_ms = run(tests::transport_t::unix_socket);
+    const auto shared_memory_ms = run(tests::transport_t::shared_memory);
+    const auto in_process_ms = run(tests::transport_t::in_process);
+    BOOST_TEST_MESSAGE("read_1_write_1 with 16384 packets: sockets " << sockets_ms
+        << "ms, shared memory " << shared_memory_ms << "ms, in process " << in_process_ms << "ms");
+}
+
+BOOST_AUTO_TEST_CASE(latency_tracking) {
+    const std::string dump_path = "dmn_latency_tracking_test.txt";
+    std::remove(dump_path.c_str());
+
+    dmn::set_latency_tracking({true, dump_path});
+    nodes_tester_t{
+        tests::links_t{"a -> b -> c"},
+        {
+            {"a", actions::generate, 1},
+            {"b", actions::resend, 1},
+            {"c", actions::remember, 1},
+        }
+    }
+    .threads(2)
+    .sequence_max(256)
+    .test();
+    dmn::set_latency_tracking({});
+
+    // "node=<n> host=<h> stage=<s> count=<c> p50_ns=<v> p99_ns=<v> p999_ns=<v> max_ns=<v>"
+    std::map<std::string, std::map<std::string, unsigned long long>> stages;
+    std::ifstream in{dump_path};
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ss{line};
+        std::map<std::string, std::string> values;
+        std::string kv;
+        while (ss >> kv) {
+            const auto eq = kv.find('=');
+            values[kv.substr(0, eq)] = kv.substr(eq + 1);
+        }
+        auto& stage = stages[values["node"] + "." + values["stage"]];
+        for (const char* key: {"count", "p50_ns", "p99_ns", "max_ns"}) {
+            stage[key] = std::stoull(values[key]);
+        }
+    }
+    std::remove(dump_path.c_str());
+
+    BOOST_TEST(stages.size() == 12u); // 3 nodes x 4 stages
+    BOOST_TEST(stages["c.end_to_end"]["count"] >= 256u);
+    BOOST_TEST(stages["a.end_to_end"]["count"] == 0u);
+    BOOST_TEST(stages["b.network"]["count"] > 0u);
+    BOOST_TEST(stages["c.network"]["count"] > 0u);
+    BOOST_TEST(stages["b.callback"]["count"] > 0u);
+    BOOST_TEST(stages["c.end_to_end"]["p50_ns"] <= stages["c.end_to_end"]["p99_ns"]);
+    BOOST_TEST(stages["c.end_to_end"]["p99_ns"] <= stages["c.end_to_end"]["max_ns"]);
+    BOOST_TEST_MESSAGE("a -> b -> c end to end latency: p50 " << stages["c.end_to_end"]["p50_ns"]
+        << "ns, p99 " << stages["c.end_to_end"]["p99_ns"] << "ns");
+}
+
+BOOST_AUTO_TEST_CASE(tracing) {
+#if DMN_TRACING
+    dmn::set_tracing({4, "."});
+    nodes_tester_t{
+        tests::links_t{"a -> b -> c"},
+        {
+            {"a", actions::generate, 1},
+            {"b", actions::resend, 1},
+            {"c", actions::remember, 1},
+        }
+    }
+    .threads(2)
+    .sequence_max(256)
+    .test();
+    dmn::set_tracing({});
+
+    const std::vector<std::string> paths = {"./a.0.trace.json", "./b.0.trace.json", "./c.0.trace.json"};
+    std::stringstream merged;
+    dmn::merge_traces(paths, merged);
+    for (const auto& p: paths) {
+        std::remove(p.c_str());
+    }
+
+    boost::property_tree::ptree trace;
+    boost::property_tree::read_json(merged, trace);
+    std::map<std::string, std::size_t> names;
+    for (const auto& e: trace.get_child("traceEvents")) {
+        ++names[e.second.get<std::string>("ph") + ":" + e.second.get<std::string>("name")];
+    }
+
+    BOOST_TEST(names["M:process_name"] == 3u);
+    BOOST_TEST(names["i:created"] > 0u);
+    BOOST_TEST(names["i:received"] > 0u);
+    BOOST_TEST(names["X:callback"] > names["i:created"]);
+    BOOST_TEST(names["X:tcp_write"] + names["i:sent_directly"] > 0u);
+    BOOST_TEST(names["s:wave"] > 0u);
+    BOOST_TEST(names["s:wave"] == names["f:wave"]);
+#else
+    BOOST_CHECK_THROW(dmn::set_tracing({4, "."}), std::runtime_error);
+    BOOST_CHECK_NO_THROW(dmn::set_tracing({}));
+#endif
+}
+
 BOOST_DATA_TEST_CASE(node_start_permutations,
     (boost::unit_test::data::xrange(1, 8) * boost::unit_test::data::xrange(1, 5) * boost::unit_test::data::xrange(0, (int)tests::start_order::end_)),
     hosts_num, threads_count, start_order_int
@@ -20,6 +20,43 @@ BOOST_DATA_TEST_CASE(hosts_x_threads,
     .test();
 }
 
+BOOST_DATA_TEST_CASE(unix_socket_hosts_x_threads,
+    (boost::unit_test::data::xrange(1, 8) * boost::unit_test::data::xrange(1, 5)),
+    hosts_num, threads_count
+) {
+    nodes_tester_t{
+        tests::links_t{"a -> b0 -> c; a -> b1 -> c;"},
+        {
+            {"a", actions::generate, hosts_count_from_num<0>(hosts_num)},
+            {"b0", actions::resend, 1},
+            {"b1", actions::resend, 1},
+            {"c", actions::remember, hosts_count_from_num<2>(hosts_num)},
+        }
+    }
+    .threads(threads_count)
+    .sequence_max(256)
+    .transport(tests::transport_t::unix_socket)
+    .test();
+}
+
+BOOST_DATA_TEST_CASE(middle_hosts_x_threads,
+    (boost::unit_test::data::xrange(1, 8) * boost::unit_test::data::xrange(1, 5)),
+    hosts_num, threads_count
+) {
+    nodes_tester_t{
+        tests::links_t{"a -> b0 -> c; a -> b1 -> c;"},
+        {
+            {"a", actions::generate, hosts_count_from_num<0>(hosts_num)},
+            {"b0", actions::resend, hosts_count_from_num<1>(hosts_num)},
+            {"b1", actions::resend, hosts_count_from_num<1>(hosts_num) + 1},
+            {"c", actions::remember, hosts_count_from_num<2>(hosts_num) + 1},
+        }
+    }
+    .threads(threads_count)
+    .sequence_max(256)
+    .test();
+}
+
 /*
 BOOST_DATA_TEST_CASE(node_start_permutations,
     (boost::unit_test::data::xrange(1, 8) * boost::unit_test::data::xrange(1, 5) * boost::unit_test::data::xrange(0, (int)tests::start_order::end_)),
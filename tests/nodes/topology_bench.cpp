@@ -0,0 +1,191 @@
+#include "nodes_tester.hpp"
+#include "node_base.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Throughput of the standard topologies on localhost. Disabled by default, run explicitly:
+//      ./dmn_tests -t topology_bench -- [--duration-ms 2000] [--threads 1,2,4,8] [--payload 256]
+//                                      [--transport in_process|unix_socket|shared_memory] [--csv dmn_topology_bench.csv]
+// Appends a CSV line per topology and thread count, so that the scaling curves could be tracked over time.
+
+namespace {
+
+struct bench_options_t {
+    std::chrono::milliseconds   duration{2000};
+    std::vector<int>            threads{1, 2, 4, 8};
+    std::size_t                 payload = 256;
+    tests::transport_t          transport = tests::transport_t::in_process;
+    std::string                 transport_name = "in_process";
+    std::string                 csv = "dmn_topology_bench.csv";
+};
+
+bench_options_t parse_options() {
+    bench_options_t res;
+    const auto& suite = boost::unit_test::framework::master_test_suite();
+    for (int i = 1; i + 1 < suite.argc; i += 2) {
+        const std::string key = suite.argv[i];
+        const std::string value = suite.argv[i + 1];
+        if (key == "--duration-ms") {
+            res.duration = std::chrono::milliseconds{std::stoul(value)};
+        } else if (key == "--threads") {
+            res.threads.clear();
+            std::istringstream ss{value};
+            std::string t;
+            while (std::getline(ss, t, ',')) {
+                res.threads.push_back(std::stoi(t));
+            }
+        } else if (key == "--payload") {
+            res.payload = std::stoul(value);
+        } else if (key == "--transport") {
+            res.transport_name = value;
+            if (value == "unix_socket") {
+                res.transport = tests::transport_t::unix_socket;
+            } else if (value == "shared_memory") {
+                res.transport = tests::transport_t::shared_memory;
+            } else {
+                BOOST_TEST_REQUIRE(value == "in_process");
+            }
+        } else if (key == "--csv") {
+            res.csv = value;
+        } else {
+            BOOST_FAIL("Unknown option " << key);
+        }
+    }
+    return res;
+}
+
+const bench_options_t& options() {
+    static const bench_options_t res = parse_options();
+    return res;
+}
+
+void write_row(const char* topology, int threads, const tests::bench_result_t& r) {
+    const bool new_file = !std::ifstream{options().csv}.good();
+    std::ofstream out{options().csv, std::ios::app};
+    if (new_file) {
+        out << "topology,transport,threads,payload_bytes,seconds,packets,packets_per_s,mb_per_s,p50_us,p99_us,p999_us,max_us\n";
+    }
+
+    const double seconds = (r.seconds > 0 ? r.seconds : 1);
+    out << std::fixed << std::setprecision(3)
+        << topology << ',' << options().transport_name << ',' << threads << ',' << options().payload << ','
+        << r.seconds << ',' << r.packets << ','
+        << r.packets / seconds << ',' << r.payload_bytes / seconds / 1e6 << ','
+        << r.end_to_end.p50_ns / 1e3 << ',' << r.end_to_end.p99_ns / 1e3 << ','
+        << r.end_to_end.p999_ns / 1e3 << ',' << r.end_to_end.max_ns / 1e3 << '\n';
+
+    BOOST_TEST_MESSAGE(topology << " threads=" << threads << ": " << static_cast<std::uint64_t>(r.packets / seconds)
+        << " packets/s, p99 " << r.end_to_end.p99_ns / 1000 << "us");
+    BOOST_TEST(r.packets > 0u);
+    BOOST_TEST(r.end_to_end.count > 0u);
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(topology_bench, * boost::unit_test::disabled())
+
+BOOST_AUTO_TEST_CASE(chain) {
+    for (int threads: options().threads) {
+        const auto r = nodes_tester_t{
+            tests::links_t{"a -> b0 -> b1 -> b2 -> c"},
+            {
+                {"a", actions::generate},
+                {"b0", actions::resend},
+                {"b1", actions::resend},
+                {"b2", actions::resend},
+                {"c", actions::remember},
+            }
+        }
+        .threads(threads)
+        .transport(options().transport)
+        .payload(options().payload)
+        .bench(options().duration);
+        write_row("chain", threads, r);
+    }
+}
+
+// Graphs have a single source and a single sink, so the fan-out and the fan-in are over the hosts:
+// one writer balances the waves between the links to 4 hosts...
+BOOST_AUTO_TEST_CASE(fan_out) {
+    for (int threads: options().threads) {
+        const auto r = nodes_tester_t{
+            tests::links_t{"a -> b -> c"},
+            {
+                {"a", actions::generate},
+                {"b", actions::resend, 4},
+                {"c", actions::remember},
+            }
+        }
+        .threads(threads)
+        .transport(options().transport)
+        .payload(options().payload)
+        .bench(options().duration);
+        write_row("fan_out", threads, r);
+    }
+}
+
+// ...and one reader accepts the links from 4 hosts
+BOOST_AUTO_TEST_CASE(fan_in) {
+    for (int threads: options().threads) {
+        const auto r = nodes_tester_t{
+            tests::links_t{"a -> b -> c"},
+            {
+                {"a", actions::generate, 4},
+                {"b", actions::resend},
+                {"c", actions::remember},
+            }
+        }
+        .threads(threads)
+        .transport(options().transport)
+        .payload(options().payload)
+        .bench(options().duration);
+        write_row("fan_in", threads, r);
+    }
+}
+
+// Each wave is sent to both branches, sink gathers its parts
+BOOST_AUTO_TEST_CASE(diamond) {
+    for (int threads: options().threads) {
+        const auto r = nodes_tester_t{
+            tests::links_t{"a -> b0 -> c; a -> b1 -> c;"},
+            {
+                {"a", actions::generate},
+                {"b0", actions::resend},
+                {"b1", actions::resend},
+                {"c", actions::remember},
+            }
+        }
+        .threads(threads)
+        .transport(options().transport)
+        .payload(options().payload)
+        .bench(options().duration);
+        write_row("diamond", threads, r);
+    }
+}
+
+// Links are balanced between the hosts of each vertex
+BOOST_AUTO_TEST_CASE(many_hosts) {
+    for (int threads: options().threads) {
+        const auto r = nodes_tester_t{
+            tests::links_t{"a -> b -> c"},
+            {
+                {"a", actions::generate, 2},
+                {"b", actions::resend, 4},
+                {"c", actions::remember, 2},
+            }
+        }
+        .threads(threads)
+        .transport(options().transport)
+        .payload(options().payload)
+        .bench(options().duration);
+        write_row("many_hosts", threads, r);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
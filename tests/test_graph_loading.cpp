@@ -45,6 +45,24 @@ BOOST_AUTO_TEST_CASE(base) {
     BOOST_TEST(boost::num_vertices(dmn::load_graph(ss)) == 2);
 }
 
+BOOST_AUTO_TEST_CASE(unix_hosts) {
+    const std::string ss{R"(
+        digraph test
+        {
+            a [hosts = "unix:/run/dmn/a.sock"];
+            b [hosts = "127.0.0.1:44003; unix:/run/dmn/b.sock"];
+            a -> b;
+        }
+    )"};
+    const auto g = dmn::load_graph(ss);
+    BOOST_TEST(g[0].hosts.size() == 1);
+    BOOST_TEST(g[0].hosts[0].first == "unix:/run/dmn/a.sock");
+    BOOST_TEST(g[1].hosts.size() == 2);
+    BOOST_TEST(g[1].hosts[0].first == "127.0.0.1");
+    BOOST_TEST(g[1].hosts[0].second == 44003);
+    BOOST_TEST(g[1].hosts[1].first == "unix:/run/dmn/b.sock");
+}
+
 BOOST_AUTO_TEST_CASE(graph_loading) {
     const std::string ss{R"(
         digraph test
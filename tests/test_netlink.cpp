@@ -1,9 +1,15 @@
+#include "impl/net/metrics_endpoint.hpp"
 #include "impl/net/netlink.hpp"
 #include "impl/net/packet_network.hpp"
 #include "impl/net/tcp_acceptor.hpp"
 #include "impl/net/tcp_read_proto.hpp"
 #include "impl/net/tcp_write_proto.hpp"
+#include "impl/net/uring_service.hpp"
+#include <future>
 #include <numeric>
+#include <thread>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
 
 #include <boost/test/unit_test.hpp>
 #include "tests_common.hpp"
@@ -12,14 +18,14 @@ BOOST_AUTO_TEST_SUITE(netlink)
 
 namespace {
 
-void netlink_back_and_forth_test_impl(dmn::packet_t&& packet) {
+void netlink_back_and_forth_test_impl(dmn::packet_t&& packet, const dmn::link_endpoint_t& ep = dmn::make_stream_endpoint("127.0.0.1", 63101)) {
     boost::asio::io_context ios;
 
-    dmn::tcp_acceptor acceptor{ios, "127.0.0.1", 63101};
+    dmn::tcp_acceptor acceptor{ios, ep.address};
     const dmn::packet_t ethalon = tests::clone(packet);
     dmn::packet_network_t packet_network{std::move(packet)};
 
-    using netlink_in_t = dmn::netlink_t<std::vector<unsigned char>, dmn::tcp_read_proto_t>;
+    using netlink_in_t = dmn::netlink_t<dmn::packet_storage_t, dmn::tcp_read_proto_t>;
     std::unique_ptr<netlink_in_t> netlink_in;
 
 
@@ -51,7 +57,7 @@ void netlink_back_and_forth_test_impl(dmn::packet_t&& packet) {
     });
 
     using netlink_out_t = dmn::netlink_t<int, dmn::tcp_write_proto_t>;
-    std::unique_ptr<netlink_out_t> netlink_out = netlink_out_t::construct("127.0.0.1", 63101, ios,
+    std::unique_ptr<netlink_out_t> netlink_out = netlink_out_t::construct(ep, ios,
         [&](const boost::system::error_code&, auto g, dmn::tcp_write_proto_t::send_error_tag) {
             BOOST_TEST(static_cast<bool>(g));
             BOOST_TEST(false);
@@ -122,6 +128,176 @@ BOOST_AUTO_TEST_CASE(back_and_forth_multiple_flags) {
     netlink_back_and_forth_test_impl(std::move(p));
 }
 
+BOOST_AUTO_TEST_CASE(back_and_forth_unix_loopback) {
+    dmn::packet_t p;
+    const unsigned char d1[] = "hello";
+    p.add_data(d1, 5, "type1");
+
+    const auto ep = dmn::make_link_endpoint("127.0.0.1", 63101);
+    BOOST_TEST(dmn::is_unix_endpoint(ep.address));
+    netlink_back_and_forth_test_impl(std::move(p), ep);
+}
+
+BOOST_AUTO_TEST_CASE(back_and_forth_unix_path) {
+    dmn::packet_t p;
+    std::vector<unsigned char> data;
+    data.resize(1024*1024*4, 'X');
+    p.add_data(&data.front(), data.size(), "type_huge");
+
+    const auto ep = dmn::make_link_endpoint("unix:/tmp/dmn_test_netlink.sock", 0);
+    BOOST_TEST(dmn::is_unix_endpoint(ep.address));
+    BOOST_TEST(!ep.shared_memory);
+    netlink_back_and_forth_test_impl(std::move(p), ep);
+    ::unlink("/tmp/dmn_test_netlink.sock");
+}
+
+BOOST_AUTO_TEST_CASE(back_and_forth_shared_memory) {
+    dmn::packet_t p;
+    std::vector<unsigned char> data;
+    data.resize(1024*1024*16, 'X');
+    p.add_data(&data.front(), data.size(), "type_huge");
+
+    const auto ep = dmn::make_link_endpoint("shm:/tmp/dmn_test_netlink.sock", 0);
+    BOOST_TEST(dmn::is_unix_endpoint(ep.address));
+    BOOST_TEST(ep.shared_memory);
+    netlink_back_and_forth_test_impl(std::move(p), ep);
+    ::unlink("/tmp/dmn_test_netlink.sock");
+}
+
+BOOST_AUTO_TEST_CASE(credits_round_trip) {
+    boost::asio::io_context ios;
+    const auto ep = dmn::make_stream_endpoint("127.0.0.1", 63102);
+    dmn::tcp_acceptor acceptor{ios, ep};
+
+    using netlink_in_t = dmn::netlink_t<dmn::packet_storage_t, dmn::tcp_read_proto_t>;
+    std::unique_ptr<netlink_in_t> netlink_in;
+    std::unique_ptr<netlink_in_t> netlink_in_old;
+    const auto accept = [&](const boost::system::error_code& error) {
+        BOOST_TEST(!error);
+        netlink_in_old = std::move(netlink_in);
+        netlink_in = netlink_in_t::construct(
+            acceptor.extract_socket(),
+            [&](auto& /*proto*/, auto& /*e*/){},
+            [&](auto& /*proto*/) {}
+        );
+    };
+    acceptor.async_accept(accept);
+
+    int connected = 0;
+    int credits_received = 0;
+    using netlink_out_t = dmn::netlink_t<int, dmn::tcp_write_proto_t>;
+    std::unique_ptr<netlink_out_t> netlink_out = netlink_out_t::construct(ep, ios,
+        [&](const boost::system::error_code&, auto /*g*/, dmn::tcp_write_proto_t::send_error_tag) {
+            BOOST_TEST(false);
+        },
+        [&](auto /*g*/) {
+            ++connected;
+        },
+        [&](const boost::system::error_code&, auto g, dmn::tcp_write_proto_t::reconnect_error_tag) {
+            g.mutex()->async_reconnect(std::move(g));
+        }
+    );
+    netlink_out->set_on_credits([&](dmn::tcp_write_proto_t&) { ++credits_received; });
+    BOOST_TEST(netlink_out->available_credits() == 0);
+    netlink_out->async_reconnect(netlink_out->try_lock());
+
+    ios.reset();
+    ios.poll();
+    BOOST_TEST(connected == 1);
+    BOOST_REQUIRE(netlink_in);
+    BOOST_TEST(netlink_out->available_credits() == dmn::credits_window);
+
+    netlink_out->consume_credits(dmn::credits_window);
+    BOOST_TEST(netlink_out->available_credits() == 0);
+
+    // Small grants are accumulated
+    netlink_in->packets_consumed(1);
+    netlink_in->grant_credits(false);
+    ios.reset();
+    ios.poll();
+    BOOST_TEST(credits_received == 0);
+
+    netlink_in->packets_consumed(dmn::credits_grant_threshold);
+    netlink_in->grant_credits(false);
+    netlink_in->packets_consumed(2);
+    netlink_in->grant_credits(true);
+    for (int i = 0; i < 100 && netlink_out->available_credits() != dmn::credits_grant_threshold + 3; ++i) {
+        ios.reset();
+        ios.run_one_for(std::chrono::milliseconds(10));
+    }
+    BOOST_TEST(credits_received >= 1);
+    BOOST_TEST(netlink_out->available_credits() == dmn::credits_grant_threshold + 3);
+
+    // Grants that do not fit into the socket buffers are sent once the writer reads the previous ones
+    constexpr std::size_t grants = 200000;
+    for (std::size_t i = 0; i < grants; ++i) {
+        netlink_in->packets_consumed(1);
+        netlink_in->grant_credits(true);
+    }
+    for (int i = 0; i < 1000 && netlink_out->available_credits() != dmn::credits_grant_threshold + 3 + grants; ++i) {
+        ios.reset();
+        ios.run_for(std::chrono::milliseconds(10));
+    }
+    BOOST_TEST(netlink_out->available_credits() == dmn::credits_grant_threshold + 3 + grants);
+
+    // New connection gets its own control read, pending read of the previous one does not interfere
+    acceptor.async_accept(accept);
+    netlink_out->async_reconnect(netlink_out->try_lock());
+    for (int i = 0; i < 100 && (connected != 2 || !netlink_in_old); ++i) {
+        ios.reset();
+        ios.run_one_for(std::chrono::milliseconds(10));
+    }
+    BOOST_TEST(connected == 2);
+    BOOST_REQUIRE(netlink_in_old);
+    BOOST_TEST(netlink_out->available_credits() == dmn::credits_window);
+    netlink_out->consume_credits(dmn::credits_window);
+    netlink_in->packets_consumed(5);
+    netlink_in->grant_credits(true);
+    for (int i = 0; i < 100 && netlink_out->available_credits() != 5; ++i) {
+        ios.reset();
+        ios.run_one_for(std::chrono::milliseconds(10));
+    }
+    BOOST_TEST(netlink_out->available_credits() == 5u);
+
+    acceptor.close();
+    netlink_in_old->close();
+    netlink_in_old.reset();
+    netlink_in->close();
+    netlink_in.reset();
+    netlink_out->close();
+    netlink_out.reset();
+}
+
+// Falls back to epoll if io_uring was not compiled in or is not supported by the kernel
+BOOST_AUTO_TEST_CASE(back_and_forth_io_uring) {
+    dmn::set_net_backend(dmn::net_backend_enum::IO_URING);
+
+    dmn::packet_t small;
+    const unsigned char d1[] = "hello";
+    small.add_data(d1, 5, "type1");
+    small.add_data(d1+2, 3, "type2");
+    netlink_back_and_forth_test_impl(std::move(small));
+
+    dmn::packet_t huge;
+    std::vector<unsigned char> data;
+    data.resize(1024*1024*16, 'X');
+    huge.add_data(&data.front(), data.size(), "type_huge");
+    netlink_back_and_forth_test_impl(tests::clone(huge));
+
+    netlink_back_and_forth_test_impl(std::move(huge), dmn::make_link_endpoint("unix:/tmp/dmn_test_netlink.sock", 0));
+    ::unlink("/tmp/dmn_test_netlink.sock");
+
+    dmn::set_net_backend(dmn::net_backend_enum::EPOLL);
+}
+
+BOOST_AUTO_TEST_CASE(link_endpoint_selection) {
+    BOOST_TEST(!dmn::is_unix_endpoint(dmn::make_stream_endpoint("127.0.0.1", 63101)));
+    BOOST_TEST(!dmn::is_unix_endpoint(dmn::make_link_endpoint("10.0.0.1", 63101).address));
+    BOOST_TEST(dmn::is_unix_endpoint(dmn::make_link_endpoint("127.0.0.1", 63101).address));
+    BOOST_TEST(dmn::is_unix_endpoint(dmn::make_link_endpoint("::1", 63101).address));
+    BOOST_TEST((dmn::make_link_endpoint("127.0.0.1", 63101).address != dmn::make_link_endpoint("127.0.0.1", 63102).address));
+}
+
 // Tries to reconnect untill succeeds
 
 struct socket_reconnect_t {
@@ -185,4 +361,66 @@ BOOST_AUTO_TEST_CASE(acceptor_rebind) {
     BOOST_TEST(socket2.success); // socket reconnected
 }
 
+BOOST_AUTO_TEST_CASE(metrics_endpoint_scrape) {
+    boost::asio::io_context ios;
+    dmn::metrics_registry_t registry;
+    dmn::metrics_counter_t counter;
+    counter.add(42);
+    auto registration = registry.add_counter("dmn_test_total", "Test counter", {{"node", "a"}}, counter);
+
+    dmn::metrics_endpoint_t endpoint{ios, registry, 0, std::chrono::milliseconds{100}};
+    BOOST_TEST(endpoint.port() != 0u);
+    auto work = boost::asio::make_work_guard(ios);
+    std::thread t{[&ios]() { ios.run(); }};
+
+    const auto request = [&endpoint](const std::string& req) {
+        boost::asio::io_context client_ios;
+        boost::asio::ip::tcp::socket socket{client_ios};
+        socket.connect({boost::asio::ip::address_v4::loopback(), endpoint.port()});
+        boost::asio::write(socket, boost::asio::buffer(req));
+
+        std::string response;
+        boost::system::error_code ec;
+        boost::asio::read(socket, boost::asio::dynamic_buffer(response), ec);
+        BOOST_TEST(ec == boost::asio::error::eof);
+        return response;
+    };
+
+    const std::string metrics = request("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    BOOST_TEST(metrics.find("HTTP/1.0 200 OK") == 0u);
+    BOOST_TEST(metrics.find("\r\n\r\n# HELP dmn_test_total Test counter\n") != std::string::npos);
+    BOOST_TEST(metrics.find("dmn_test_total{node=\"a\"} 42\n") != std::string::npos);
+
+    BOOST_TEST(request("GET /other HTTP/1.1\r\n\r\n").find("HTTP/1.0 404") == 0u);
+    BOOST_TEST(request("GET /metrics HTTP/1.1\r\n").empty()); // Incomplete request is dropped by the timeout
+
+    // Scrape in progress is closed together with the endpoint instead of waiting for its timeout
+    dmn::metrics_endpoint_t slow_endpoint{ios, registry, 0, std::chrono::seconds{30}};
+    boost::asio::io_context client_ios;
+    boost::asio::ip::tcp::socket pending{client_ios};
+    pending.connect({boost::asio::ip::address_v4::loopback(), slow_endpoint.port()});
+    boost::asio::write(pending, boost::asio::buffer(std::string{"GET /metrics HTTP/1.1\r\n"}));
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+
+    const auto close_start = std::chrono::steady_clock::now();
+    std::promise<void> closed;
+    boost::asio::post(ios, [&slow_endpoint, &closed]() {
+        slow_endpoint.close();
+        closed.set_value();
+    });
+    closed.get_future().wait();
+
+    std::string response;
+    boost::system::error_code ec;
+    boost::asio::read(pending, boost::asio::dynamic_buffer(response), ec);
+    BOOST_TEST(!!ec);
+    BOOST_TEST(response.empty());
+    BOOST_TEST((std::chrono::steady_clock::now() - close_start < std::chrono::seconds{10}));
+
+    work.reset();
+    ios.stop();
+    t.join();
+    endpoint.close();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
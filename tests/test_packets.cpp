@@ -1,6 +1,15 @@
 #include "impl/packet.hpp"
 #include "impl/net/packet_network.hpp"
+#include "impl/net/packets_reader.hpp"
+#include "impl/net/shared_packet.hpp"
+#include "impl/node_parts/packets_gatherer.hpp"
+#include "load_graph.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <limits>
 #include <numeric>
+#include <thread>
 
 #include <boost/test/unit_test.hpp>
 #include "tests_common.hpp"
@@ -27,6 +36,65 @@ BOOST_AUTO_TEST_CASE(packet_nonempty_body_conversions) {
     BOOST_CHECK(native1.raw_storage() == native2.raw_storage());
 }
 
+BOOST_AUTO_TEST_CASE(shared_packet_refcounting) {
+    using namespace dmn::literals;
+    dmn::packet_t native;
+    const unsigned char d[] = "body";
+    native.add_data(d, sizeof(d), "type"_tag);
+    native.header().wave_id = static_cast<dmn::wave_id_t>(7);
+    dmn::packet_header_t header = native.header();
+    dmn::packet_network_t whole{std::move(native)};
+    const void* const storage = whole.data_address();
+    const auto whole_body = *whole.body_const_buffer().begin();
+    const std::string bytes(static_cast<const char*>(whole_body.data()), whole_body.size());
+    auto body = dmn::make_shared_body(std::move(whole));
+
+    header.edge_id = 1;
+    dmn::shared_packet_t first{header, body};
+    header.edge_id = 2;
+    dmn::shared_packet_t second{header, body};
+
+    // Holders of the body send the same bytes, no copies are made
+    BOOST_TEST(first.body_const_buffer().data() == whole_body.data());
+    BOOST_TEST(second.body_const_buffer().data() == whole_body.data());
+    const auto shared_bytes = [&second]() {
+        const auto b = second.body_const_buffer();
+        return std::string(static_cast<const char*>(b.data()), b.size());
+    };
+
+    // Body is still shared, so the receiver gets a copy
+    auto copy = std::move(first).to_packet_network();
+    BOOST_TEST(!first.body);
+    BOOST_TEST(copy.data_address() != storage);
+    BOOST_TEST(copy.edge_id_from_packet() == 1u);
+
+    // Mutation of the copy does not touch the shared body
+    auto copy_native = std::move(copy).to_native();
+    copy_native.get_mutable_data("type"_tag).first[0] = 'X';
+    BOOST_TEST(shared_bytes() == bytes);
+    BOOST_TEST(reinterpret_cast<const char*>(copy_native.get_data("type"_tag).first) == std::string("Xody"));
+
+    // Last holder takes the storage
+    body.reset();
+    auto last = std::move(second).to_packet_network();
+    BOOST_TEST(!second.body);
+    BOOST_TEST(last.data_address() == storage);
+    BOOST_TEST(last.edge_id_from_packet() == 2u);
+    BOOST_TEST(static_cast<std::uint64_t>(last.wave_id_from_packet()) == 7u);
+    auto last_native = std::move(last).to_native();
+    BOOST_TEST(reinterpret_cast<const char*>(last_native.get_data("type"_tag).first) == std::string("body"));
+
+    // Packets without body share nothing and are rebuilt from the header
+    dmn::packet_t empty;
+    empty.place_header();
+    BOOST_TEST(!dmn::make_shared_body(dmn::packet_network_t{std::move(empty)}));
+    header.size = 0;
+    auto rebuilt = dmn::shared_packet_t{header, {}}.to_packet_network();
+    BOOST_TEST(rebuilt.expected_body_size() == 0u);
+    BOOST_TEST(rebuilt.edge_id_from_packet() == 2u);
+    BOOST_TEST(static_cast<std::uint64_t>(rebuilt.wave_id_from_packet()) == 7u);
+}
+
 BOOST_AUTO_TEST_CASE(packet_set_get_small_type_name) {
     dmn::packet_t native;
 
@@ -81,5 +149,496 @@ BOOST_AUTO_TEST_CASE(packet_merge_basic) {
     BOOST_TEST(reinterpret_cast<const char*>(result.get_data("type4").first) == std::string("llo"));
 }
 
+BOOST_AUTO_TEST_CASE(packet_merge_segmented) {
+    const unsigned char d[] = "hello";
+    dmn::packet_network_t merged{dmn::packet_t{}};
+
+    for (unsigned i = 0; i < 10; ++i) {
+        const std::string type = "type" + std::to_string(i);
+        dmn::packet_t part;
+        part.add_data(d, sizeof(d) - i % 3, type.c_str());
+        part.header().wave_id = static_cast<dmn::wave_id_t>(42);
+
+        if (i == 0) {
+            merged = dmn::packet_network_t{std::move(part)};
+        } else {
+            merged.merge_packet(dmn::packet_network_t{std::move(part)});
+        }
+    }
+    BOOST_TEST(merged.is_segmented());
+
+    dmn::packet_t result = std::move(merged).to_native();
+    for (unsigned i = 0; i < 10; ++i) {
+        const std::string type = "type" + std::to_string(i);
+        BOOST_TEST(result.get_data(type.c_str()).second == sizeof(d) - i % 3);
+    }
+
+    const auto body_size = result.header().size;
+    result.flatten();
+    BOOST_TEST(!result.is_segmented());
+    BOOST_TEST(result.raw_storage().size() == body_size + sizeof(dmn::packet_header_t));
+    for (unsigned i = 0; i < 10; ++i) {
+        const std::string type = "type" + std::to_string(i);
+        BOOST_TEST(result.get_data(type.c_str()).second == sizeof(d) - i % 3);
+        const auto data = result.get_data(type.c_str());
+        BOOST_TEST(std::string(reinterpret_cast<const char*>(data.first), data.second) == std::string("hello", sizeof(d)).substr(0, sizeof(d) - i % 3));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(packet_add_data_after_segmented_merge) {
+    using namespace dmn::literals;
+    const unsigned char d[] = "hello";
+    for (const auto layout: {dmn::packet_layout_enum::INDEXED, dmn::packet_layout_enum::LINEAR}) {
+        dmn::packet_network_t merged{dmn::packet_t{}};
+        for (unsigned i = 0; i < 3; ++i) {
+            const std::string type = "type" + std::to_string(i);
+            dmn::packet_t part;
+            part.place_header();
+            part.header().version = layout;
+            part.add_data(d, sizeof(d), type.c_str());
+            part.header().wave_id = static_cast<dmn::wave_id_t>(42);
+
+            if (i == 0) {
+                merged = dmn::packet_network_t{std::move(part)};
+            } else {
+                merged.merge_packet(dmn::packet_network_t{std::move(part)});
+            }
+        }
+        BOOST_TEST(merged.is_segmented());
+
+        dmn::packet_t result = std::move(merged).to_native();
+        result.add_data(d, 3, "added");
+        if (layout == dmn::packet_layout_enum::INDEXED) {
+            BOOST_TEST(result.is_segmented());  // Merged bodies are not copied
+            result.add_data(d, 2, "seq"_tag);
+            BOOST_TEST(result.get_data("seq"_tag).second == 2u);
+        }
+        BOOST_TEST(result.get_data("added").second == 3u);
+
+        const auto body_size = result.header().size;
+        result.flatten();
+        BOOST_TEST(result.raw_storage().size() == body_size + sizeof(dmn::packet_header_t));
+        BOOST_TEST(result.get_data("added").second == 3u);
+        for (unsigned i = 0; i < 3; ++i) {
+            const std::string type = "type" + std::to_string(i);
+            BOOST_TEST(result.get_data(type.c_str()).second == sizeof(d));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(packet_set_get_many_types) {
+    dmn::packet_t native;
+
+    for (unsigned i = 0; i < 100; ++i) {
+        const std::string type = "type" + std::to_string(i);
+        native.add_data(reinterpret_cast<const unsigned char*>(&i), sizeof(i), type.c_str());
+    }
+
+    for (unsigned i = 0; i < 100; ++i) {
+        const std::string type = "type" + std::to_string(i);
+        const auto res = native.get_data(type.c_str());
+        BOOST_TEST(res.second == sizeof(i));
+        BOOST_TEST(*reinterpret_cast<const unsigned*>(res.first) == i);
+    }
+
+    BOOST_TEST(!native.get_data("type100").first);
+    BOOST_TEST(!native.get_data("").first);
+}
+
+BOOST_AUTO_TEST_CASE(packet_linear_layout) {
+    dmn::packet_t native;
+    native.place_header();
+    native.header().version = dmn::packet_layout_enum::LINEAR;
+
+    const unsigned char d[] = "hello";
+    native.add_data(d, sizeof(d), "type1");
+    native.add_data(d + 2, 4, "type2");
+    BOOST_TEST(native.header().size == 2 * (sizeof(std::uint32_t) * 2 + 5) + sizeof(d) + 4);
+
+    const dmn::packet_t result {
+        dmn::packet_network_t(tests::clone(native)).to_native()
+    };
+    BOOST_TEST(result.get_data("type1").second == sizeof(d));
+    BOOST_TEST(result.get_data("type2").second == 4);
+    BOOST_TEST(reinterpret_cast<const char*>(result.get_data("type1").first) == std::string("hello"));
+    BOOST_TEST(reinterpret_cast<const char*>(result.get_data("type2").first) == std::string("llo"));
+    BOOST_TEST(!result.get_data("type3").first);
+}
+
+DMN_FIELD(registered_field, "registered_field");
+
+BOOST_AUTO_TEST_CASE(packet_set_get_interned_types) {
+    using namespace dmn::literals;
+    static_assert(static_cast<std::uint32_t>("seq"_tag) != static_cast<std::uint32_t>("seq0"_tag), "");
+
+    dmn::packet_t native;
+    const unsigned char d[] = "hello";
+    native.add_data(d, sizeof(d), "seq"_tag);
+    native.add_data(d + 2, 4, "seq");
+
+    dmn::packet_t by_name;
+    by_name.add_data(d, sizeof(d), "seq");
+    by_name.add_data(d + 2, 4, "seq");
+    BOOST_TEST(native.header().size + 3 + sizeof(std::uint32_t) == by_name.header().size);
+
+    BOOST_TEST(native.get_data("seq"_tag).second == sizeof(d));
+    BOOST_TEST(reinterpret_cast<const char*>(native.get_data("seq"_tag).first) == std::string("hello"));
+    BOOST_TEST(native.get_data("seq").second == 4);
+    BOOST_TEST(reinterpret_cast<const char*>(native.get_data("seq").first) == std::string("llo"));
+    BOOST_TEST(!native.get_data("seq0"_tag).first);
+
+    BOOST_TEST((dmn::register_field_name("seq") == "seq"_tag));
+    BOOST_TEST((registered_field == "registered_field"_tag));
+#if DMN_DEBUG
+    BOOST_TEST(dmn::field_name("seq"_tag) == std::string("seq"));
+    BOOST_TEST(dmn::field_name(registered_field) == std::string("registered_field"));
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(packets_reader_fragmented) {
+    std::vector<dmn::packet_t> ethalons;
+    std::vector<unsigned char> stream;
+    for (unsigned i = 0; i < 100; ++i) {
+        dmn::packet_t p;
+        const std::string data(i % 7 == 6 ? 100000 : i * 10, static_cast<char>('a' + i % 26));
+        p.add_data(reinterpret_cast<const unsigned char*>(data.data()), data.size(), "data");
+        p.header().wave_id = static_cast<dmn::wave_id_t>(i);
+        stream.insert(stream.end(), p.raw_storage().begin(), p.raw_storage().end());
+        ethalons.push_back(std::move(p));
+    }
+
+    dmn::packets_reader_t reader;
+    dmn::received_packets_t received;
+    std::size_t pos = 0;
+    for (std::size_t chunk = 1; pos < stream.size(); chunk = chunk * 3 % 70001) {
+        const auto buf = reader.prepare();
+        const std::size_t bytes = std::min({chunk, boost::asio::buffer_size(buf), stream.size() - pos});
+        std::memcpy(boost::asio::buffer_cast<unsigned char*>(buf), stream.data() + pos, bytes);
+        pos += bytes;
+        reader.commit(bytes, received);
+    }
+
+    BOOST_TEST_REQUIRE(received.size() == ethalons.size());
+    for (std::size_t i = 0; i < received.size(); ++i) {
+        dmn::packet_t p = std::move(received[i]).to_native();
+        p.flatten();
+        BOOST_TEST(p.raw_storage() == ethalons[i].raw_storage());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(packets_reader_zero_copy) {
+    using namespace dmn::literals;
+    std::vector<unsigned char> stream;
+    for (unsigned i = 0; i < 2000; ++i) {
+        dmn::packet_t p;
+        const std::uint32_t seq = i;
+        p.add_data(reinterpret_cast<const unsigned char*>(&seq), sizeof(seq), "seq"_tag);
+        p.header().wave_id = static_cast<dmn::wave_id_t>(i);
+        stream.insert(stream.end(), p.raw_storage().begin(), p.raw_storage().end());
+    }
+
+    dmn::packets_reader_t reader;
+    dmn::received_packets_t received;
+    std::size_t pos = 0;
+    while (pos < stream.size()) {
+        const auto buf = reader.prepare();
+        const std::size_t bytes = std::min(boost::asio::buffer_size(buf), stream.size() - pos);
+        const unsigned char* const buf_begin = boost::asio::buffer_cast<unsigned char*>(buf);
+        std::memcpy(boost::asio::buffer_cast<unsigned char*>(buf), stream.data() + pos, bytes);
+        pos += bytes;
+
+        const std::size_t first_new = received.size();
+        BOOST_TEST(reader.commit(bytes, received));
+        for (std::size_t i = first_new; i < received.size(); ++i) {
+            // Bodies are handed out right from the receive buffer, one after another
+            const auto body = *received[i].body_const_buffer().begin();
+            const auto body_end = boost::asio::buffer_cast<const unsigned char*>(body) + boost::asio::buffer_size(body);
+            if (i + 1 < received.size()) {
+                const auto next = boost::asio::buffer_cast<const unsigned char*>(*received[i + 1].body_const_buffer().begin());
+                BOOST_TEST((next == body_end + sizeof(dmn::packet_header_t)));
+            } else {
+                BOOST_TEST((body_end <= buf_begin + bytes));
+            }
+        }
+    }
+
+    // Buffers of the held packets are never overwritten by the next reads
+    BOOST_TEST_REQUIRE(received.size() == 2000u);
+    for (std::size_t i = 0; i < received.size(); ++i) {
+        dmn::packet_t p = std::move(received[i]).to_native();
+        const auto seq = p.get_mutable_data("seq"_tag);
+        BOOST_TEST_REQUIRE(seq.second == sizeof(std::uint32_t));
+        std::uint32_t v;
+        std::memcpy(&v, seq.first, sizeof(v));
+        BOOST_TEST(v == i);
+        BOOST_TEST((p.header().wave_id == static_cast<dmn::wave_id_t>(i)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(packets_reader_legacy_header) {
+    // Packet of a writer with the 16 byte header: {version, type, edge, padding, wave, size}
+    dmn::packet_t body;
+    body.place_header();
+    body.header().version = dmn::packet_layout_enum::LINEAR;
+    const unsigned char d[] = "legacy";
+    body.add_data(d, sizeof(d), "type");
+    const std::uint32_t body_size = body.header().size;
+
+    std::vector<unsigned char> stream(16);
+    const std::uint16_t legacy_header[] = {1, 0, 3, 0};
+    const std::uint32_t legacy_wave = (7u << 16) | 42u;
+    std::memcpy(stream.data(), legacy_header, sizeof(legacy_header));
+    std::memcpy(stream.data() + 8, &legacy_wave, sizeof(legacy_wave));
+    std::memcpy(stream.data() + 12, &body_size, sizeof(body_size));
+    stream.insert(stream.end(), body.raw_storage().begin() + sizeof(dmn::packet_header_t), body.raw_storage().end());
+
+    dmn::packets_reader_t reader;
+    dmn::received_packets_t received;
+    const auto buf = reader.prepare();
+    std::memcpy(boost::asio::buffer_cast<unsigned char*>(buf), stream.data(), stream.size());
+    BOOST_TEST(reader.commit(stream.size(), received));
+
+    BOOST_TEST_REQUIRE(received.size() == 1u);
+    BOOST_TEST((received[0].version() == dmn::packet_layout_enum::LINEAR));
+    BOOST_TEST(received[0].edge_id_from_packet() == 3u);
+    BOOST_TEST((received[0].wave_id_from_packet() == dmn::make_wave_id(7, 0, 42)));
+
+    const dmn::packet_t p = std::move(received[0]).to_native();
+    BOOST_TEST(p.get_data("type").second == sizeof(d));
+    BOOST_TEST(!std::memcmp(p.get_data("type").first, d, sizeof(d)));
+}
+
+BOOST_AUTO_TEST_CASE(packets_reader_malformed) {
+    const auto feed = [](dmn::packet_header_t h) {
+        dmn::packets_reader_t reader;
+        dmn::received_packets_t received;
+        const auto buf = reader.prepare();
+        std::memcpy(boost::asio::buffer_cast<unsigned char*>(buf), &h, sizeof(h));
+        const bool res = reader.commit(sizeof(h), received);
+        BOOST_TEST(received.empty() != res);
+        return res;
+    };
+
+    BOOST_TEST(feed(dmn::packet_header_t{}));
+
+    dmn::packet_header_t unknown_version;
+    unknown_version.version = static_cast<dmn::packet_layout_enum>(100);
+    BOOST_TEST(!feed(unknown_version));
+
+    dmn::packet_header_t not_data;
+    not_data.packet_type = dmn::packet_types_enum::SHUTDOWN_GRACEFULLY;
+    BOOST_TEST(!feed(not_data));
+}
+
 // TODO: tests for data types deduplication on add_data
 
+
+namespace {
+
+const auto ignore_expired = [](dmn::packet_network_t) {};
+
+dmn::packet_network_t make_part(std::uint32_t wave, std::uint16_t edge) {
+    dmn::packet_t native;
+    const unsigned char d[] = "part";
+    native.add_data(d, sizeof(d), "type");
+    native.header().wave_id = static_cast<dmn::wave_id_t>(wave);
+    native.header().edge_id = edge;
+    return dmn::packet_network_t{std::move(native)};
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(wave_id_layout) {
+    const dmn::wave_id_t wave = dmn::make_wave_id(0xABCD, 0x1234, 0xFFFFFFFF);
+    BOOST_TEST(dmn::wave_host(wave) == 0xABCDu);
+    BOOST_TEST(dmn::wave_epoch(wave) == 0x1234u);
+    BOOST_TEST(dmn::wave_sequence(wave) == 0xFFFFFFFFu);
+
+    // Sequence wraps into the next epoch, ids of other hosts are not reached
+    const auto next = static_cast<dmn::wave_id_t>(static_cast<std::uint64_t>(wave) + 1);
+    BOOST_TEST(dmn::wave_host(next) == 0xABCDu);
+    BOOST_TEST(dmn::wave_epoch(next) == 0x1235u);
+    BOOST_TEST(dmn::wave_sequence(next) == 0u);
+
+    // Waves that differ only in the high bits are gathered separately
+    dmn::packets_gatherer_t gatherer{2, 1 << 20, ignore_expired};
+    auto part = [](dmn::wave_id_t w, std::uint16_t edge) {
+        auto p = make_part(0, edge);
+        dmn::packet_t native = std::move(p).to_native();
+        native.header().wave_id = w;
+        return dmn::packet_network_t{std::move(native)};
+    };
+    BOOST_TEST(!gatherer.combine_packets(part(dmn::make_wave_id(1, 0, 7), 0)));
+    BOOST_TEST(!gatherer.combine_packets(part(dmn::make_wave_id(1, 1, 7), 1)));
+    BOOST_TEST(!gatherer.combine_packets(part(dmn::make_wave_id(2, 0, 7), 1)));
+    BOOST_TEST(!!gatherer.combine_packets(part(dmn::make_wave_id(1, 0, 7), 1)));
+}
+
+BOOST_AUTO_TEST_CASE(packets_gatherer_duplicates) {
+    dmn::packets_gatherer_t gatherer{3, 1 << 20, ignore_expired};
+    BOOST_TEST(!gatherer.combine_packets(make_part(1, 2)));
+    BOOST_TEST(!gatherer.combine_packets(make_part(1, 2)));
+    BOOST_TEST(!gatherer.combine_packets(make_part(2, 0)));
+    BOOST_TEST(!gatherer.combine_packets(make_part(1, 0)));
+    BOOST_TEST(!gatherer.combine_packets(make_part(1, 3)));     // Unknown edge
+    BOOST_TEST(!gatherer.combine_packets(make_part(1, 0xFFFF)));
+
+    auto res = gatherer.combine_packets(make_part(1, 1));
+    BOOST_TEST_REQUIRE(!!res);
+    BOOST_TEST(static_cast<std::uint32_t>(res->wave_id_from_packet()) == 1u);
+    BOOST_TEST(res->expected_body_size() == 3 * make_part(1, 0).expected_body_size());
+}
+
+BOOST_AUTO_TEST_CASE(packets_gatherer_expiry) {
+    std::vector<std::uint32_t> expired;
+    dmn::packets_gatherer_t gatherer{2, 1 << 20, [&expired](dmn::packet_network_t p) {
+        expired.push_back(static_cast<std::uint32_t>(p.wave_id_from_packet()));
+    }};
+
+    BOOST_TEST(!gatherer.combine_packets(make_part(1, 0)));
+    BOOST_TEST(!gatherer.combine_packets(make_part(2, 0)));
+    BOOST_TEST(!!gatherer.combine_packets(make_part(2, 1)));
+    BOOST_TEST(gatherer.stats().partial_bytes > 0u);
+
+    for (std::uint64_t i = 0; i < dmn::packets_gatherer_t::ticks_per_timeout; ++i) {
+        gatherer.expire_tick();
+    }
+    BOOST_TEST(expired.empty());
+
+    gatherer.expire_tick();
+    BOOST_TEST(expired == std::vector<std::uint32_t>{1});
+    BOOST_TEST(gatherer.stats().expired_waves == 1u);
+    BOOST_TEST(gatherer.stats().partial_bytes == 0u);
+
+    // Late part starts a new wave
+    BOOST_TEST(!gatherer.combine_packets(make_part(1, 1)));
+}
+
+BOOST_AUTO_TEST_CASE(packets_gatherer_memory_limit) {
+    const std::size_t part_bytes = sizeof(dmn::packet_header_t) + make_part(0, 0).expected_body_size();
+    std::vector<std::uint32_t> evicted;
+    dmn::packets_gatherer_t gatherer{2, part_bytes * 2, [&evicted](dmn::packet_network_t p) {
+        evicted.push_back(static_cast<std::uint32_t>(p.wave_id_from_packet()));
+    }};
+
+    // Waves that go to the same shard as wave 0
+    std::vector<std::uint32_t> waves{0};
+    for (std::uint32_t w = 1; waves.size() < 3; ++w) {
+        if (((w * 0x9E3779B97F4A7C15ull) >> 58) == 0) {
+            waves.push_back(w);
+        }
+    }
+
+    for (std::uint32_t w: waves) {
+        BOOST_TEST(!gatherer.combine_packets(make_part(w, 0)));
+    }
+    BOOST_TEST(evicted == std::vector<std::uint32_t>{waves[0]});
+    BOOST_TEST(gatherer.stats().evicted_waves == 1u);
+    BOOST_TEST(gatherer.stats().partial_bytes == part_bytes * 2);
+}
+
+BOOST_AUTO_TEST_CASE(packets_gatherer_reused_wave_id) {
+    const std::size_t part_bytes = sizeof(dmn::packet_header_t) + make_part(0, 0).expected_body_size();
+    std::vector<std::uint32_t> evicted;
+    dmn::packets_gatherer_t gatherer{2, part_bytes * 2, [&evicted](dmn::packet_network_t p) {
+        evicted.push_back(static_cast<std::uint32_t>(p.wave_id_from_packet()));
+    }};
+
+    // Waves that go to the same shard as wave 0
+    std::vector<std::uint32_t> waves{0};
+    for (std::uint32_t w = 1; waves.size() < 3; ++w) {
+        if (((w * 0x9E3779B97F4A7C15ull) >> 58) == 0) {
+            waves.push_back(w);
+        }
+    }
+
+    // Gathered wave leaves its entry in the wheel
+    BOOST_TEST(!gatherer.combine_packets(make_part(waves[0], 0)));
+    BOOST_TEST(!!gatherer.combine_packets(make_part(waves[0], 1)));
+    gatherer.expire_tick();
+
+    // Id of the gathered wave is reused after another wave, the stale entry must not make it the oldest one
+    BOOST_TEST(!gatherer.combine_packets(make_part(waves[1], 0)));
+    BOOST_TEST(!gatherer.combine_packets(make_part(waves[0], 0)));
+    BOOST_TEST(!gatherer.combine_packets(make_part(waves[2], 0)));
+    BOOST_TEST(evicted == std::vector<std::uint32_t>{waves[1]});
+
+    // Reused wave expires by its own deadline
+    for (std::uint64_t i = 0; i <= dmn::packets_gatherer_t::ticks_per_timeout; ++i) {
+        gatherer.expire_tick();
+    }
+    BOOST_TEST(gatherer.stats().expired_waves == 2u);
+    BOOST_TEST(gatherer.stats().partial_bytes == 0u);
+}
+
+// Cost of a part must not grow with the count of in-edges
+BOOST_AUTO_TEST_CASE(packets_gatherer_scaling) {
+    constexpr std::size_t parts_per_run = 100000;
+
+    for (std::size_t edges: {std::size_t{2}, std::size_t{16}, std::size_t{128}, std::size_t{1024}, dmn::max_in_or_out_edges_per_node}) {
+        const std::size_t waves = parts_per_run / edges + 1;
+
+        // Parts of many waves are interleaved, as if each edge was delivering its own stream
+        std::vector<dmn::packet_network_t> parts;
+        parts.reserve(waves * edges);
+        for (std::size_t e = 0; e < edges; ++e) {
+            for (std::size_t w = 0; w < waves; ++w) {
+                parts.push_back(make_part(static_cast<std::uint32_t>(w), static_cast<std::uint16_t>(e)));
+            }
+        }
+
+        dmn::packets_gatherer_t gatherer{edges, std::numeric_limits<std::size_t>::max(), ignore_expired};
+        std::size_t completed = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (auto& p: parts) {
+            completed += !!gatherer.combine_packets(std::move(p));
+        }
+        const auto duration = std::chrono::steady_clock::now() - start;
+
+        BOOST_TEST(completed == waves);
+        const double ns_per_part = std::chrono::duration<double, std::nano>(duration).count() / parts.size();
+        BOOST_TEST_MESSAGE("packets_gatherer_t " << edges << " in-edges: " << ns_per_part << " ns/part");
+    }
+}
+
+// Each wave is emitted exactly once, whatever threads deliver its parts
+BOOST_AUTO_TEST_CASE(packets_gatherer_threads) {
+    constexpr std::size_t edges = 8;
+    constexpr std::size_t waves = 20000;
+
+    for (std::size_t threads_count: {std::size_t{1}, std::size_t{2}, std::size_t{4}, std::size_t{8}}) {
+        // Thread `t` delivers parts of the edges `t`, `t + threads_count`...
+        std::vector<std::vector<dmn::packet_network_t>> parts(threads_count);
+        for (std::size_t w = 0; w < waves; ++w) {
+            for (std::size_t e = 0; e < edges; ++e) {
+                parts[e % threads_count].push_back(make_part(static_cast<std::uint32_t>(w), static_cast<std::uint16_t>(e)));
+            }
+        }
+
+        dmn::packets_gatherer_t gatherer{edges, std::numeric_limits<std::size_t>::max(), ignore_expired};
+        std::vector<std::atomic<int>> completed(waves);
+        for (auto& v: completed) {
+            v = 0;
+        }
+
+        std::vector<std::thread> threads;
+        const auto start = std::chrono::steady_clock::now();
+        for (auto& thread_parts: parts) {
+            threads.emplace_back([&gatherer, &completed, &thread_parts]() {
+                for (auto& p: thread_parts) {
+                    if (auto res = gatherer.combine_packets(std::move(p))) {
+                        ++completed[static_cast<std::uint32_t>(res->wave_id_from_packet())];
+                    }
+                }
+            });
+        }
+        for (auto& t: threads) {
+            t.join();
+        }
+        const auto duration = std::chrono::steady_clock::now() - start;
+
+        BOOST_TEST(std::all_of(completed.begin(), completed.end(), [](const auto& v) { return v.load() == 1; }));
+        const double parts_per_second = waves * edges / std::chrono::duration<double>(duration).count();
+        BOOST_TEST_MESSAGE("packets_gatherer_t " << threads_count << " threads: " << parts_per_second << " parts/s");
+    }
+}
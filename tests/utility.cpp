@@ -1,9 +1,26 @@
+#include "impl/buffer_pool.hpp"
 #include "impl/circular_iterator.hpp"
+#include "impl/edges/idle_links.hpp"
+#include "impl/edges/wave_hash_ring.hpp"
+#include "impl/latency.hpp"
 #include "impl/lazy_array.hpp"
+#include "impl/metrics.hpp"
+#include "impl/net/packets_batch.hpp"
 #include "impl/net/slab_allocator.hpp"
-
+#include "impl/silent_mt_queue.hpp"
+#include "impl/tracing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <mutex>
 #include <vector>
 #include <random>
+#include <sstream>
+#include <thread>
+#include <boost/property_tree/json_parser.hpp>
 #include <boost/test/unit_test.hpp>
 
 BOOST_AUTO_TEST_CASE(circular_iterator_test) {
@@ -257,3 +274,490 @@ BOOST_AUTO_TEST_CASE(lazy_array_derived_test) {
     }
     BOOST_TEST(destructions_count == 8);
 }
+
+BOOST_AUTO_TEST_CASE(lazy_array_over_aligned_test) {
+    struct alignas(dmn::hardware_destructive_interference_size) padded {
+        int value = 0;
+    };
+
+    dmn::lazy_array<padded> la;
+    la.init(5);
+    for (std::size_t i = 0; i < 5; ++i) {
+        la.inplace_construct(i);
+        BOOST_TEST(reinterpret_cast<std::uintptr_t>(&la[i]) % dmn::hardware_destructive_interference_size == 0u);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(buffer_pool_test) {
+    const auto stats_before = dmn::buffer_pool_stats();
+
+    for (unsigned i = 0; i < 10; ++i) {
+        void* p = dmn::buffer_pool_allocate(1000);
+        BOOST_TEST(p);
+        std::memset(p, 0, 1000);
+        dmn::buffer_pool_deallocate(p);
+    }
+
+    auto stats = dmn::buffer_pool_stats();
+    BOOST_TEST(stats.hits - stats_before.hits >= 9u);
+
+    // Buffer freed on other thread returns to the owner
+    void* p = dmn::buffer_pool_allocate(1000);
+    std::thread([p]() { dmn::buffer_pool_deallocate(p); }).join();
+    const auto stats_remote = dmn::buffer_pool_stats();
+    BOOST_TEST(stats_remote.remote_frees - stats.remote_frees == 1u);
+
+    void* p2 = dmn::buffer_pool_allocate(1000);
+    BOOST_TEST(dmn::buffer_pool_stats().hits - stats_remote.hits == 1u);
+    dmn::buffer_pool_deallocate(p2);
+
+    // Buffer outlives the allocating thread
+    void* p3 = nullptr;
+    std::thread([&p3]() { p3 = dmn::buffer_pool_allocate(100); }).join();
+    std::memset(p3, 0, 100);
+    dmn::buffer_pool_deallocate(p3);
+
+    // Huge buffers are not pooled
+    void* p4 = dmn::buffer_pool_allocate(16 * 1024 * 1024);
+    BOOST_TEST(p4);
+    dmn::buffer_pool_deallocate(p4);
+}
+
+BOOST_AUTO_TEST_CASE(packets_batch_test) {
+    const char data[] = "0123456789";
+    dmn::packets_batch_t<boost::asio::const_buffer> batch;
+    for (unsigned i = 1; i < 5; ++i) {
+        batch.push_back(boost::asio::const_buffer(data, i));
+    }
+    BOOST_TEST(batch.size() == 4u);
+    BOOST_TEST(batch.bytes() == 10u);
+
+    const auto bufs = batch.buffers();
+    BOOST_TEST(boost::asio::buffer_size(bufs) == 10u);
+    BOOST_TEST(bufs.end() - bufs.begin() == 4);
+
+    // First two packets were written completely, third one partially
+    std::vector<std::size_t> unsent;
+    batch.extract_unsent_reversed(1 + 2 + 1, [&unsent](boost::asio::const_buffer b) {
+        unsent.push_back(boost::asio::buffer_size(b));
+    });
+    BOOST_TEST(batch.empty());
+    BOOST_TEST(unsent == (std::vector<std::size_t>{4, 3}));
+}
+
+BOOST_AUTO_TEST_CASE(silent_mt_queue_test) {
+    dmn::silent_mt_queue<std::unique_ptr<int>, 4> q;
+    BOOST_TEST(!q.try_pop());
+    BOOST_TEST(q.empty());
+
+    // Overflows the ring, FIFO order is kept
+    for (int i = 0; i < 10; ++i) {
+        q.silent_push(std::make_unique<int>(i));
+    }
+    q.silent_push_front(std::make_unique<int>(-1));
+    for (int i = -1; i < 10; ++i) {
+        BOOST_TEST(!q.empty());
+        auto v = q.try_pop();
+        BOOST_TEST_REQUIRE(!!v);
+        BOOST_TEST(**v == i);
+    }
+    BOOST_TEST(!q.try_pop());
+    BOOST_TEST(q.empty());
+
+    // Pushes go to the overflow till it is drained, even if the ring got free cells
+    for (int i = 0; i < 6; ++i) {
+        q.silent_push(std::make_unique<int>(i));
+    }
+    for (int i = 0; i < 8; ++i) {
+        auto v = q.try_pop();
+        BOOST_TEST_REQUIRE(!!v);
+        BOOST_TEST(**v == i);
+        q.silent_push(std::make_unique<int>(i + 6));
+    }
+    for (int i = 8; i < 14; ++i) {
+        auto v = q.try_pop();
+        BOOST_TEST_REQUIRE(!!v);
+        BOOST_TEST(**v == i);
+    }
+    BOOST_TEST(q.empty());
+
+    // Remaining values are destroyed
+    q.silent_push(std::make_unique<int>(0));
+}
+
+namespace {
+
+// Move into the queue storage waits till the gate is opened, as if the producer was preempted in
+// the middle of a push
+struct gated_value_t {
+    int                 value;
+    std::atomic<int>*   gate;   // 0 - not reached, 1 - waiting, 2 - opened
+
+    gated_value_t(int v, std::atomic<int>* g = nullptr) noexcept
+        : value(v)
+        , gate(g)
+    {}
+
+    gated_value_t(gated_value_t&& other) noexcept
+        : value(other.value)
+        , gate(nullptr)
+    {
+        if (other.gate) {
+            other.gate->store(1);
+            while (other.gate->load() != 2) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    gated_value_t& operator=(gated_value_t&& other) noexcept {
+        value = other.value;
+        gate = nullptr;
+        return *this;
+    }
+};
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(silent_mt_queue_unpublished_cell) {
+    dmn::silent_mt_queue<gated_value_t, 4> q;
+
+    // Other producer claims the first cell of the ring and stalls
+    std::atomic<int> gate{0};
+    std::thread stalled([&q, &gate]() {
+        q.silent_push(gated_value_t{-1, &gate});
+    });
+    while (gate.load() != 1) {
+        std::this_thread::yield();
+    }
+
+    // Fills the rest of the ring and overflows it
+    for (int i = 0; i < 4; ++i) {
+        q.silent_push(gated_value_t{i});
+    }
+
+    // Overflow must not be popped before the values of the same producer in the ring
+    BOOST_TEST(!q.try_pop());
+
+    gate.store(2);
+    stalled.join();
+    for (int i = -1; i < 4; ++i) {
+        auto v = q.try_pop();
+        BOOST_TEST_REQUIRE(!!v);
+        BOOST_TEST(v->value == i);
+    }
+    BOOST_TEST(q.empty());
+}
+
+namespace {
+
+// Baseline for the benchmark: the previous implementation of the silent_mt_queue
+class locked_deque_queue {
+    std::mutex          mutex_;
+    std::deque<int>     data_;
+public:
+    void silent_push(int v) {
+        std::lock_guard<std::mutex> l(mutex_);
+        data_.push_back(v);
+    }
+
+    boost::optional<int> try_pop() {
+        std::lock_guard<std::mutex> l(mutex_);
+        if (data_.empty()) {
+            return {};
+        }
+        const int v = data_.front();
+        data_.pop_front();
+        return v;
+    }
+};
+
+// Each value in [0, producers * per_producer) must be popped exactly once. Returns ns per pushed value.
+template <class Queue>
+double mpmc_contention_run(Queue& q, unsigned producers, unsigned consumers, int per_producer) {
+    const int total = static_cast<int>(producers) * per_producer;
+    std::vector<std::atomic<int>> seen(total);
+    for (auto& v: seen) {
+        v = 0;
+    }
+    std::atomic<int> popped{0};
+
+    std::vector<std::thread> threads;
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned p = 0; p < producers; ++p) {
+        threads.emplace_back([&q, p, per_producer]() {
+            for (int i = 0; i < per_producer; ++i) {
+                q.silent_push(static_cast<int>(p) * per_producer + i);
+            }
+        });
+    }
+    for (unsigned c = 0; c < consumers; ++c) {
+        threads.emplace_back([&]() {
+            while (popped.load() < total) {
+                if (auto v = q.try_pop()) {
+                    ++seen[*v];
+                    ++popped;
+                }
+            }
+        });
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+    const auto duration = std::chrono::steady_clock::now() - start;
+
+    BOOST_TEST(popped.load() == total);
+    BOOST_TEST(std::all_of(seen.begin(), seen.end(), [](const auto& v) { return v.load() == 1; }));
+    BOOST_TEST(!q.try_pop());
+
+    return std::chrono::duration<double, std::nano>(duration).count() / total;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(silent_mt_queue_contention) {
+    const unsigned threads = std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+    constexpr int per_producer = 100000;
+
+    for (unsigned producers: {1u, threads / 2, threads}) {
+        const unsigned consumers = std::max(1u, threads - producers);
+
+        dmn::silent_mt_queue<int> lock_free;
+        const double lock_free_ns = mpmc_contention_run(lock_free, producers, consumers, per_producer);
+
+        locked_deque_queue locked;
+        const double locked_ns = mpmc_contention_run(locked, producers, consumers, per_producer);
+
+        BOOST_TEST_MESSAGE("silent_mt_queue " << producers << "P/" << consumers << "C: " << lock_free_ns
+            << " ns/op, mutex+deque: " << locked_ns << " ns/op");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(wave_hash_ring_test) {
+    const std::vector<std::pair<std::string, unsigned short>> hosts{
+        {"127.0.0.1", 63101}, {"127.0.0.1", 63102}, {"127.0.0.1", 63103}, {"127.0.0.1", 63104},
+    };
+    const dmn::wave_hash_ring_t ring{hosts};
+    const dmn::wave_hash_ring_t same_ring{hosts};
+
+    constexpr std::uint32_t waves = 10000;
+    std::vector<std::size_t> per_host(hosts.size(), 0);
+    std::size_t moved = 0;
+    for (std::uint32_t i = 0; i < waves; ++i) {
+        const auto wave = static_cast<dmn::wave_id_t>(i);
+        const std::size_t host = ring.host_for(wave);
+        BOOST_TEST_REQUIRE(host < hosts.size());
+        BOOST_TEST(host == same_ring.host_for(wave));
+        ++per_host[host];
+
+        // Only the waves of the failed host are remapped
+        const std::size_t host_on_failure = ring.host_for(wave, [](std::size_t h) { return h != 1; });
+        BOOST_TEST(host_on_failure != 1u);
+        if (host != 1) {
+            BOOST_TEST(host_on_failure == host);
+        } else {
+            ++moved;
+        }
+
+        // Everything is down, owner is returned
+        BOOST_TEST(ring.host_for(wave, [](std::size_t) { return false; }) == host);
+    }
+
+    BOOST_TEST(moved == per_host[1]);
+    for (std::size_t count: per_host) {
+        BOOST_TEST(count > waves / hosts.size() / 2);
+        BOOST_TEST(count < waves / hosts.size() * 2);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(idle_links_test) {
+    dmn::idle_links_t idle;
+    idle.init(200);
+    const auto no_score = [](std::size_t) { return 0; };
+    BOOST_TEST(idle.claim(0, no_score) == dmn::idle_links_t::npos);
+
+    idle.release(5);
+    idle.release(150);
+    BOOST_TEST(idle.claim(100, no_score) == 150u);
+    BOOST_TEST(!idle.try_claim(150));
+    BOOST_TEST(idle.claim(100, no_score) == 5u);
+    BOOST_TEST(idle.claim(100, no_score) == dmn::idle_links_t::npos);
+
+    // Less loaded of the two candidates is claimed
+    idle.release(70);
+    idle.release(71);
+    BOOST_TEST(idle.claim(64, [](std::size_t i) { return i == 70 ? 10 : 1; }) == 71u);
+    BOOST_TEST(idle.claim(64, [](std::size_t i) { return i == 70 ? 10 : 1; }) == 70u);
+
+    // Each released link is claimed exactly once
+    std::vector<std::atomic<int>> claimed(200);
+    for (auto& v: claimed) {
+        v = 0;
+    }
+    for (std::size_t i = 0; i < 200; ++i) {
+        idle.release(i);
+    }
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < 4; ++t) {
+        threads.emplace_back([&idle, &claimed, t, no_score]() {
+            for (std::size_t hint = t * 50;; hint += 7) {
+                const std::size_t i = idle.claim(hint, no_score);
+                if (i == dmn::idle_links_t::npos) {
+                    return;
+                }
+                ++claimed[i];
+            }
+        });
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+    BOOST_TEST(std::all_of(claimed.begin(), claimed.end(), [](const auto& v) { return v.load() == 1; }));
+}
+
+BOOST_AUTO_TEST_CASE(metrics_registry_test) {
+    dmn::metrics_counter_t counter;
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < 4; ++t) {
+        threads.emplace_back([&counter]() {
+            for (unsigned i = 0; i < 10000; ++i) {
+                counter.add();
+            }
+        });
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+    BOOST_TEST(counter.value() == 40000u);
+
+    dmn::metrics_registry_t registry;
+    const dmn::metric_labels_t labels{{"node", "a\"b"}};
+    auto sent = registry.add_counter("dmn_sent_total", "Sent packets", dmn::with_label(labels, "edge", "0"), counter);
+    auto queued = registry.add_gauge("dmn_queued", "Queued packets", labels, []() { return 7.0; });
+    auto sent2 = registry.add_counter("dmn_sent_total", "Sent packets", dmn::with_label(labels, "edge", "1"), counter);
+    BOOST_TEST(registry.size() == 3u);
+
+    BOOST_TEST(registry.render() ==
+        "# HELP dmn_queued Queued packets\n"
+        "# TYPE dmn_queued gauge\n"
+        "dmn_queued{node=\"a\\\"b\"} 7\n"
+        "# HELP dmn_sent_total Sent packets\n"
+        "# TYPE dmn_sent_total counter\n"
+        "dmn_sent_total{node=\"a\\\"b\",edge=\"0\"} 40000\n"
+        "dmn_sent_total{node=\"a\\\"b\",edge=\"1\"} 40000\n"
+    );
+
+    sent.reset();
+    { auto moved = std::move(queued); }
+    BOOST_TEST(registry.size() == 1u);
+}
+
+BOOST_AUTO_TEST_CASE(latency_histogram_test) {
+    using histogram_t = dmn::latency_histogram_t;
+
+    std::mt19937_64 gen{42};
+    for (unsigned i = 0; i < 100000; ++i) {
+        const std::uint64_t v = gen() >> (gen() % 64);
+        const std::size_t bucket = histogram_t::bucket_of(v);
+        BOOST_TEST_REQUIRE(bucket < histogram_t::buckets_count);
+        BOOST_TEST_REQUIRE(v <= histogram_t::bucket_upper(bucket));
+        BOOST_TEST_REQUIRE(histogram_t::bucket_upper(bucket) - v <= v / (histogram_t::half_sub_buckets - 1));
+        if (bucket) {
+            BOOST_TEST_REQUIRE(histogram_t::bucket_upper(bucket - 1) < v);
+        }
+    }
+    BOOST_TEST(histogram_t::bucket_of(~std::uint64_t{0}) == histogram_t::buckets_count - 1);
+
+    histogram_t h;
+    BOOST_TEST(h.percentile(0.5) == 0u);
+    for (std::uint64_t v = 1; v <= 10000; ++v) {
+        h.record(v * 1000);
+    }
+    h.record(2000, 1000);   // Clock went backwards
+    BOOST_TEST(h.count() == 10001u);
+    BOOST_TEST(h.max() == 10000000u);
+
+    const auto near = [](std::uint64_t value, std::uint64_t expected) {
+        return value >= expected && value - expected <= expected / 64;
+    };
+    BOOST_TEST(near(h.percentile(0.5), 5000000));
+    BOOST_TEST(near(h.percentile(0.99), 9900000));
+    BOOST_TEST(h.percentile(1.0) == 10000000u);
+
+    histogram_t merged;
+    merged.record(20000000);
+    merged.merge(h);
+    BOOST_TEST(merged.count() == 10002u);
+    BOOST_TEST(merged.max() == 20000000u);
+    BOOST_TEST(near(merged.percentile(0.5), 5000000));
+}
+
+BOOST_AUTO_TEST_CASE(wave_tracer_test) {
+    using dmn::wave_tracer_t;
+
+    std::vector<dmn::wave_id_t> sampled;
+    for (std::uint32_t seq = 0; seq < 16000; ++seq) {
+        const auto wave = dmn::make_wave_id(1, 2, seq);
+        BOOST_TEST_REQUIRE(!wave_tracer_t::is_sampled(wave, 0));
+        BOOST_TEST_REQUIRE(wave_tracer_t::is_sampled(wave, 1));
+        if (wave_tracer_t::is_sampled(wave, 16)) {
+            sampled.push_back(wave);
+        }
+    }
+    BOOST_TEST(sampled.size() > 800u);
+    BOOST_TEST(sampled.size() < 1200u);
+
+    const std::vector<std::string> paths = {"dmn_wave_tracer_test_a.json", "dmn_wave_tracer_test_b.json"};
+    {
+        wave_tracer_t a{16, "a host=0"};
+        wave_tracer_t b{16, "b host=0"};
+        for (std::uint32_t seq = 0; seq < 64; ++seq) {
+            const auto wave = dmn::make_wave_id(1, 2, seq);
+            a.instant("created", wave);
+            { const dmn::trace_span_t span{&a, "callback", wave}; }
+            std::thread{[&b, wave]() { b.instant("received", wave); }}.join();
+        }
+        a.write(paths[0]);
+        b.write(paths[1]);
+    }
+
+    const auto count_of = [](const boost::property_tree::ptree& trace, const std::string& ph) {
+        std::size_t res = 0;
+        for (const auto& e: trace.get_child("traceEvents")) {
+            res += (e.second.get<std::string>("ph") == ph);
+        }
+        return res;
+    };
+
+    const std::size_t waves = static_cast<std::size_t>(std::count_if(sampled.begin(), sampled.end(), [](dmn::wave_id_t w) {
+        return dmn::wave_sequence(w) < 64;
+    }));
+    BOOST_TEST_REQUIRE(waves > 0u);
+
+    std::stringstream merged;
+    dmn::merge_traces(paths, merged);
+    boost::property_tree::ptree trace;
+    boost::property_tree::read_json(merged, trace);
+    BOOST_TEST(count_of(trace, "M") == 2u);
+    BOOST_TEST(count_of(trace, "X") == waves);
+    BOOST_TEST(count_of(trace, "i") == 2 * waves);
+    BOOST_TEST(count_of(trace, "s") == waves);  // created -> callback -> received on the other node
+    BOOST_TEST(count_of(trace, "t") == waves);
+    BOOST_TEST(count_of(trace, "f") == waves);
+
+    std::stringstream one_wave;
+    dmn::merge_traces(paths, one_wave, sampled.front());
+    trace.clear();
+    boost::property_tree::read_json(one_wave, trace);
+    BOOST_TEST(count_of(trace, "X") == 1u);
+    BOOST_TEST(count_of(trace, "i") == 2u);
+    for (const auto& e: trace.get_child("traceEvents")) {
+        if (e.second.get<std::string>("ph") == "X") {
+            BOOST_TEST(e.second.get<std::string>("args.wave") == std::to_string(static_cast<std::uint64_t>(sampled.front())));
+        }
+    }
+
+    for (const auto& p: paths) {
+        std::remove(p.c_str());
+    }
+}
@@ -0,0 +1,40 @@
+// Merges the wave traces of several nodes into a single Chrome trace:
+//      dmn_trace_merge [--wave <id>] <output.json> <node trace>...
+// Node traces are written when the DMN_TRACING build option is on, see dmn::set_tracing().
+
+#include "impl/tracing.hpp"
+
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    boost::optional<dmn::wave_id_t> only_wave;
+    if (args.size() >= 2 && args[0] == "--wave") {
+        only_wave = static_cast<dmn::wave_id_t>(std::strtoull(args[1].c_str(), nullptr, 0));
+        args.erase(args.begin(), args.begin() + 2);
+    }
+
+    if (args.size() < 2) {
+        std::cerr << "Usage: " << argv[0] << " [--wave <id>] <output.json> <node trace>...\n";
+        return 1;
+    }
+
+    try {
+        std::ofstream out{args[0], std::ios::trunc};
+        dmn::merge_traces(std::vector<std::string>(args.begin() + 1, args.end()), out, only_wave);
+        if (!out) {
+            std::cerr << "Failed to write '" << args[0] << "'\n";
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}